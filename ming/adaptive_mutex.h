@@ -0,0 +1,19 @@
+#ifndef MING_ADAPTIVE_MUTEX_H_
+#define MING_ADAPTIVE_MUTEX_H_
+
+#if defined(_MSC_VER)
+// Microsoft Visual C++
+// the critical section of Mutex already spins before waiting
+#include "ming/win/win_mutex.h"
+namespace ming {
+typedef ming::Mutex AdaptiveMutex;
+typedef ming::Mutex McsLock;
+}
+#elif defined(__GNUC__)
+// GNU C++
+#include "ming/linux/linux_adaptive_mutex.h"
+#else
+#error "Support Windows and Linux platform Only!"
+#endif
+
+#endif  // MING_ADAPTIVE_MUTEX_H_
@@ -0,0 +1,358 @@
+#include "ming/async_logging.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <chrono>
+
+#include "ming/likely.h"
+#include "ming/ring_buffer.h"
+#include "ming/time.h"
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+namespace ming {
+
+namespace {
+
+std::atomic<uint64_t> g_next_instance_id(1);
+
+// one entry cache of the ThreadBuffer of the last AsyncLogging used by
+// this thread, so the common case never takes AsyncLogging::mutex_
+struct ThreadBufferCache {
+  uint64_t instance_id;
+  void* thread_buffer;
+};
+thread_local ThreadBufferCache t_cache = {0, NULL};
+
+}  // namespace
+
+AsyncLogging::AsyncLogging(const std::string& basename, uint64_t roll_size,
+                           uint32_t roll_interval, uint32_t flush_interval,
+                           OverflowPolicy policy)
+    : basename_(basename),
+      roll_size_(roll_size),
+      roll_interval_(roll_interval),
+      flush_interval_(flush_interval > 0 ? flush_interval : 1),
+      policy_(policy),
+      instance_id_(g_next_instance_id.fetch_add(1)),
+      running_(false),
+      dropped_(0),
+      fd_(-1),
+      file_size_(0),
+      file_open_time_(0),
+      file_seq_(0),
+      dropped_reported_(0) {}
+
+AsyncLogging::~AsyncLogging() {
+  Stop();
+  for (size_t i = 0; i < thread_buffers_.size(); i++) {
+    ThreadBuffer* tb = thread_buffers_[i].get();
+    delete tb->current;
+    for (size_t j = 0; j < tb->full.size(); j++) delete tb->full[j];
+    for (size_t j = 0; j < tb->spare.size(); j++) delete tb->spare[j];
+  }
+  if (fd_ > STDERR_FILENO) {
+    ::close(fd_);
+  }
+}
+
+bool AsyncLogging::Start() {
+  if (running_.exchange(true)) {
+    return true;
+  }
+  RollFile(seconds_since_epoch());
+  writer_ = std::thread(&AsyncLogging::WriterThread, this);
+  return fd_ >= 0;
+}
+
+void AsyncLogging::Stop() {
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+    if (!running_.exchange(false)) {
+      return;
+    }
+  }
+  cond_.notify_one();
+  if (writer_.joinable()) {
+    writer_.join();
+  }
+}
+
+AsyncLogging::ThreadBuffer* AsyncLogging::GetThreadBuffer() {
+  if (LIKELY(t_cache.instance_id == instance_id_)) {
+    return static_cast<ThreadBuffer*>(t_cache.thread_buffer);
+  }
+
+  // ThreadBuffers are owned by AsyncLogging and outlive their threads, so
+  // the records of an exited thread are still flushed by the writer.
+  std::lock_guard<std::mutex> guard(mutex_);
+  ThreadBuffer*& tb = threads_[std::this_thread::get_id()];
+  if (tb == NULL) {
+    thread_buffers_.push_back(std::unique_ptr<ThreadBuffer>(new ThreadBuffer));
+    tb = thread_buffers_.back().get();
+    tb->current = new Buffer;
+    tb->num_buffers = 1;
+  }
+  t_cache.instance_id = instance_id_;
+  t_cache.thread_buffer = tb;
+  return tb;
+}
+
+AsyncLogging::Buffer* AsyncLogging::NextBuffer(ThreadBuffer* tb) {
+  if (!tb->spare.empty()) {
+    Buffer* b = tb->spare.back();
+    tb->spare.pop_back();
+    return b;
+  }
+  if (tb->num_buffers < kMaxBuffersPerThread) {
+    tb->num_buffers++;
+    return new Buffer;
+  }
+  return NULL;
+}
+
+bool AsyncLogging::Append(const char* data, int len) {
+  struct iovec iov;
+  iov.iov_base = const_cast<char*>(data);
+  iov.iov_len = len;
+  return Append(&iov, 1);
+}
+
+static inline void append_iovec(AsyncLogging::Buffer* buffer,
+                                const struct iovec* iov, int iovcnt) {
+  for (int i = 0; i < iovcnt; i++) {
+    buffer->append(static_cast<const char*>(iov[i].iov_base),
+                   static_cast<int>(iov[i].iov_len));
+  }
+}
+
+bool AsyncLogging::Append(const struct iovec* iov, int iovcnt) {
+  size_t len = 0;
+  for (int i = 0; i < iovcnt; i++) {
+    len += iov[i].iov_len;
+  }
+  if (UNLIKELY(len >= static_cast<size_t>(kBufferSize))) {
+    dropped_.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+
+  ThreadBuffer* tb = GetThreadBuffer();
+  int k = 1;
+  for (;;) {
+    bool wakeup = false;
+    {
+      SpinLock::ScopedLock guard(tb->lock);
+      if (tb->current->avail() > static_cast<int>(len)) {
+        append_iovec(tb->current, iov, iovcnt);
+        return true;
+      }
+      Buffer* next = NextBuffer(tb);
+      if (next != NULL) {
+        tb->full.push_back(tb->current);
+        tb->current = next;
+        append_iovec(tb->current, iov, iovcnt);
+        wakeup = true;
+      }
+    }
+    if (wakeup) {
+      // the writer always wakes up after flush_interval, a lost wakeup
+      // only delays the flush
+      cond_.notify_one();
+      return true;
+    }
+
+    // out of buffers, the writer can not keep up with us
+    cond_.notify_one();
+    if (policy_ == kDropOnFull || !running_.load(std::memory_order_relaxed)) {
+      dropped_.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    if (k < 4096) {
+      k <<= 1;
+    }
+    sched_yield(k);  // Exponential backoff
+  }
+}
+
+void AsyncLogging::Collect(std::vector<PendingBuffer>* pending, bool final) {
+  std::lock_guard<std::mutex> guard(mutex_);
+  for (size_t i = 0; i < thread_buffers_.size(); i++) {
+    ThreadBuffer* tb = thread_buffers_[i].get();
+    SpinLock::ScopedLock tb_guard(tb->lock);
+    for (size_t j = 0; j < tb->full.size(); j++) {
+      PendingBuffer p = {tb->full[j], tb};
+      pending->push_back(p);
+    }
+    tb->full.clear();
+
+    // swap out the partially filled buffer so that no record stays in
+    // memory longer than flush_interval
+    if (tb->current->length() > 0) {
+      Buffer* next = NextBuffer(tb);
+      if (next == NULL && final) {
+        // nothing comes back after the last write, go over the limit once
+        // rather than lose the tail of the log. Recycle() trims it again.
+        tb->num_buffers++;
+        next = new Buffer;
+      }
+      if (next != NULL) {
+        PendingBuffer p = {tb->current, tb};
+        pending->push_back(p);
+        tb->current = next;
+      }
+    }
+  }
+}
+
+void AsyncLogging::Recycle(const std::vector<PendingBuffer>& pending) {
+  for (size_t i = 0; i < pending.size(); i++) {
+    ThreadBuffer* tb = pending[i].owner;
+    pending[i].buffer->reset();
+    SpinLock::ScopedLock guard(tb->lock);
+    // keep two spare buffers, give the rest back to the system
+    if (tb->spare.size() < 2) {
+      tb->spare.push_back(pending[i].buffer);
+    } else {
+      tb->num_buffers--;
+      delete pending[i].buffer;
+    }
+  }
+}
+
+void AsyncLogging::WriterThread() {
+  std::vector<PendingBuffer> pending;
+  pending.reserve(64);
+  bool running = true;
+  while (running) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      running = running_.load(std::memory_order_acquire);
+      if (running) {
+        cond_.wait_for(lock, std::chrono::seconds(flush_interval_));
+      }
+    }
+
+    Collect(&pending, !running);
+    uint64_t dropped = dropped_.load(std::memory_order_relaxed);
+    if (dropped != dropped_reported_) {
+      WriteDroppedNote(dropped - dropped_reported_);
+      dropped_reported_ = dropped;
+    }
+    if (!pending.empty()) {
+      WriteBuffers(pending);
+      Recycle(pending);
+      pending.clear();
+    }
+  }
+}
+
+void AsyncLogging::WriteDroppedNote(uint64_t dropped) {
+  char buf[128];
+  int len = snprintf(buf, sizeof(buf),
+                     "AsyncLogging: dropped %llu log records\n",
+                     static_cast<unsigned long long>(dropped));
+  struct iovec iov;
+  iov.iov_base = buf;
+  iov.iov_len = len;
+  WriteAll(&iov, 1);
+}
+
+void AsyncLogging::WriteBuffers(const std::vector<PendingBuffer>& pending) {
+  struct iovec iov[IOV_MAX];
+  int iovcnt = 0;
+  uint64_t batch_size = 0;
+  for (size_t i = 0; i < pending.size(); i++) {
+    Buffer* b = pending[i].buffer;
+    iov[iovcnt].iov_base = const_cast<char*>(b->data());
+    iov[iovcnt].iov_len = b->length();
+    batch_size += b->length();
+    iovcnt++;
+    if (iovcnt == IOV_MAX || i + 1 == pending.size()) {
+      // rolling happens between batches, never in the middle of a buffer
+      uint32_t now = seconds_since_epoch();
+      if ((roll_size_ > 0 && file_size_ + batch_size > roll_size_ &&
+           file_size_ > 0) ||
+          (roll_interval_ > 0 && now >= file_open_time_ + roll_interval_)) {
+        RollFile(now);
+      }
+      WriteAll(iov, iovcnt);
+      iovcnt = 0;
+      batch_size = 0;
+    }
+  }
+}
+
+void AsyncLogging::WriteAll(const struct iovec* iov, int iovcnt) {
+  int fd = fd_ >= 0 ? fd_ : STDERR_FILENO;
+  struct iovec local[IOV_MAX];
+  memcpy(local, iov, sizeof(struct iovec) * iovcnt);
+  struct iovec* cur = local;
+  while (iovcnt > 0) {
+    ssize_t n = ::writev(fd, cur, iovcnt);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return;  // nowhere to report the error, give up this batch
+    }
+    file_size_ += n;
+    // skip the fully written iovecs and adjust the partially written one
+    while (iovcnt > 0 && static_cast<size_t>(n) >= cur->iov_len) {
+      n -= cur->iov_len;
+      cur++;
+      iovcnt--;
+    }
+    if (iovcnt > 0) {
+      cur->iov_base = static_cast<char*>(cur->iov_base) + n;
+      cur->iov_len -= n;
+    }
+  }
+}
+
+bool AsyncLogging::RollFile(uint32_t now) {
+  char suffix[64];
+  struct tm tm_time;
+  time_t t = now;
+  localtime_r(&t, &tm_time);
+  int n = static_cast<int>(
+      strftime(suffix, sizeof(suffix), ".%Y%m%d-%H%M%S", &tm_time));
+  // the size limit can roll more than once a second, a file reopened with
+  // O_APPEND would keep growing
+  uint32_t seq = (fd_ > STDERR_FILENO && now == file_open_time_) ? file_seq_ + 1
+                                                                 : 0;
+  if (seq > 0) {
+    snprintf(suffix + n, sizeof(suffix) - n, ".%u.log", seq);
+  } else {
+    snprintf(suffix + n, sizeof(suffix) - n, ".log");
+  }
+
+  std::string filename = basename_ + suffix;
+  int fd = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC,
+                  0644);
+  if (fd < 0) {
+    // keep writing to the old file (or stderr) and retry on the next roll
+    file_open_time_ = now;
+    return false;
+  }
+  if (fd_ > STDERR_FILENO) {
+    ::close(fd_);
+  }
+  fd_ = fd;
+  // the file exists already if the process was restarted within a second
+  struct stat st;
+  file_size_ = ::fstat(fd, &st) == 0 ? st.st_size : 0;
+  file_open_time_ = now;
+  file_seq_ = seq;
+  return true;
+}
+
+}  // namespace ming
@@ -0,0 +1,151 @@
+#ifndef MING_ASYNC_LOGGING_H_
+#define MING_ASYNC_LOGGING_H_
+
+#include <stdint.h>
+#include <sys/uio.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ming/log_stream.h"
+#include "ming/noncopyable.h"
+#include "ming/spin_lock.h"
+
+namespace ming {
+
+// Asynchronous double-buffered log backend.
+//
+// Front-end threads append formatted records (usually a LogStream's
+// data()/length()) into their own FixedBuffer. A thread only touches its
+// own buffer under an uncontended per-thread SpinLock, so appending is a
+// memcpy in the common case. When the buffer is full it is queued on the
+// thread's full list and a spare buffer takes its place.
+//
+// A background writer wakes up every flush_interval seconds (or as soon as
+// a buffer fills up), collects the full buffers plus whatever is pending in
+// the current ones and writes them in one writev() batch. Emptied buffers
+// are handed back to the thread that filled them.
+//
+// The number of buffers per thread is bounded. When a thread runs out of
+// buffers the OverflowPolicy decides: kDropOnFull discards the record and
+// counts it (the writer reports the count in the log), kBlockOnFull waits
+// for the writer to return a buffer.
+//
+// The log file is rolled when it grows over roll_size bytes or when
+// roll_interval seconds have passed since it was opened.
+class AsyncLogging : private noncopyable {
+ public:
+  enum OverflowPolicy { kDropOnFull, kBlockOnFull };
+
+  static const int kBufferSize = 1024 * 1024;
+  static const int kMaxBuffersPerThread = 16;
+  // ChainBuffer blocks are 4KB, a 256KB record is 66 pieces if the blocks
+  // are full. A reserve() that spills leaves the tail of a block unused, so
+  // the pieces of a longer chain are gathered on the heap.
+  static const int kMaxRecordPieces = kChainBufferMaxSize / kBufferBlockSize + 2;
+  typedef FixedBuffer<kBufferSize> Buffer;
+
+  // basename: path prefix of the log files,
+  //           e.g. "/var/log/app" -> "/var/log/app.20171225-120102.log",
+  //           then "/var/log/app.20171225-120102.1.log" and so on for the
+  //           files rolled within the same second
+  // roll_size: bytes written before the file is rolled, 0 for no limit
+  // roll_interval: seconds before the file is rolled, 0 for no limit
+  // flush_interval: max seconds a record stays in memory
+  AsyncLogging(const std::string& basename, uint64_t roll_size,
+               uint32_t roll_interval = 24 * 3600, uint32_t flush_interval = 3,
+               OverflowPolicy policy = kDropOnFull);
+  ~AsyncLogging();
+
+  bool Start();
+  // flush everything appended so far and stop the writer thread
+  void Stop();
+
+  // return false if the record was dropped
+  bool Append(const char* data, int len);
+  // append the pieces as one record, they are never split by a flush
+  bool Append(const struct iovec* iov, int iovcnt);
+
+  template <int SIZE>
+  bool Append(LogStream<SIZE>& stream) {
+    return Append(stream.data(), stream.length());
+  }
+
+  // a chained stream is gathered without linearizing it first
+  template <int SIZE, int INLINE_SIZE>
+  bool Append(LogStream<SIZE, ChainBuffer<INLINE_SIZE> >& stream) {
+    int count = stream.iovec_count();
+    if (count <= kMaxRecordPieces) {
+      struct iovec iov[kMaxRecordPieces];
+      return Append(iov, stream.to_iovec(iov, kMaxRecordPieces));
+    }
+    std::vector<struct iovec> iov(count);
+    return Append(&iov[0], stream.to_iovec(&iov[0], count));
+  }
+
+  // records dropped since start because of kDropOnFull
+  uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+ private:
+  struct ThreadBuffer {
+    ThreadBuffer() : current(NULL), num_buffers(0) {}
+    SpinLock lock;
+    Buffer* current;
+    std::vector<Buffer*> full;
+    std::vector<Buffer*> spare;
+    int num_buffers;  // buffers owned by this thread, including in-flight
+  };
+  // a buffer being written and the thread it goes back to
+  struct PendingBuffer {
+    Buffer* buffer;
+    ThreadBuffer* owner;
+  };
+
+  ThreadBuffer* GetThreadBuffer();
+  // called with tb->lock held. return NULL if the thread is out of buffers
+  Buffer* NextBuffer(ThreadBuffer* tb);
+  void WriterThread();
+  // final: the last drain at Stop(), the current buffers are taken even if
+  // their threads are out of buffers
+  void Collect(std::vector<PendingBuffer>* pending, bool final);
+  void WriteBuffers(const std::vector<PendingBuffer>& pending);
+  void WriteDroppedNote(uint64_t dropped);
+  void Recycle(const std::vector<PendingBuffer>& pending);
+  bool RollFile(uint32_t now);
+  void WriteAll(const struct iovec* iov, int iovcnt);
+
+ private:
+  const std::string basename_;
+  const uint64_t roll_size_;
+  const uint32_t roll_interval_;
+  const uint32_t flush_interval_;
+  const OverflowPolicy policy_;
+  const uint64_t instance_id_;
+
+  std::atomic<bool> running_;
+  std::atomic<uint64_t> dropped_;
+
+  // guards thread_buffers_ and threads_, and is used by the writer to sleep
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  std::vector<std::unique_ptr<ThreadBuffer> > thread_buffers_;
+  std::map<std::thread::id, ThreadBuffer*> threads_;
+  std::thread writer_;
+
+  // owned by the writer thread
+  int fd_;
+  uint64_t file_size_;
+  uint32_t file_open_time_;
+  uint32_t file_seq_;  // of the files opened in the second file_open_time_
+  uint64_t dropped_reported_;
+};
+
+}  // namespace ming
+
+#endif  // MING_ASYNC_LOGGING_H_
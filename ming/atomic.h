@@ -23,7 +23,7 @@
 // boundary; otherwise, this function fails on multiprocessor x86 systems and
 // any non-x86 systems.
 
-#if _MSC_VER < 1600
+#if defined(_MSC_VER) && _MSC_VER < 1600
 typedef int int32_t;
 typedef long long int64_t;
 #else
@@ -83,7 +83,7 @@ inline int64_t atomic_add64(int64_t volatile *addend, int64_t value) {
   return _InterlockedAdd64(addend, value);
 }
 // The return value is the initial value of the Destination pointer.
-inline int64_t atomic_cas32(int64_t volatile *destination, int64_t exchange,
+inline int64_t atomic_cas64(int64_t volatile *destination, int64_t exchange,
                             int64_t comparand) {
   return _InterlockedCompareExchange64(destination, exchange, comparand);
 }
@@ -113,7 +113,7 @@ inline int32_t atomic_add32(int32_t volatile *addend, int32_t value) {
 // The return value is the initial value of the Destination pointer.
 inline int32_t atomic_cas32(int32_t volatile *destination, int32_t exchange,
                             int32_t comparand) {
-  return __sync_val_compare_and_swap(destination, exchange, comparand);
+  return __sync_val_compare_and_swap(destination, comparand, exchange);
 }
 // The return value is the resulting incremented value.
 inline int64_t atomic_inc64(int64_t volatile *addend) {
@@ -128,13 +128,168 @@ inline int64_t atomic_add64(int64_t volatile *addend, int64_t value) {
   return __sync_add_and_fetch(addend, value);
 }
 // The return value is the initial value of the Destination pointer.
-inline int64_t atomic_cas32(int64_t volatile *destination, int64_t exchange,
+inline int64_t atomic_cas64(int64_t volatile *destination, int64_t exchange,
                             int64_t comparand) {
-  return __sync_val_compare_and_swap(destination, exchange, comparand);
+  return __sync_val_compare_and_swap(destination, comparand, exchange);
 }
 }  // namespace ming
 #else
 #error "Support Windows and Linux platform Only!"
 #endif
 
+#if __cplusplus >= 201103L || (defined(_MSC_VER) && _MSC_VER >= 1700)
+//-----------------------------------------------------------------------------
+// c++ 11 helpers with explicit memory orders
+//
+// Statistics and heuristics rarely need more than relaxed atomics; the
+// atomic_* functions above and the default seq_cst order of std::atomic put
+// a full barrier on every update.
+//-----------------------------------------------------------------------------
+#include <stddef.h>
+
+#include <atomic>
+
+namespace ming {
+
+enum { kCacheLineSize = 64 };
+
+// T alone on its cache lines, so that the writes to it do not slow down the
+// access to its neighbours (false sharing). The padding is explicit rather
+// than alignas, which new ignores before c++17.
+template <typename T>
+class CachePadded {
+ public:
+  CachePadded() : value_() {}
+  explicit CachePadded(const T &value) : value_(value) {}
+
+  T &get() { return value_; }
+  const T &get() const { return value_; }
+  T *operator->() { return &value_; }
+  const T *operator->() const { return &value_; }
+  T &operator*() { return value_; }
+  const T &operator*() const { return value_; }
+
+ private:
+  char pad_before_[kCacheLineSize];
+  T value_;
+  char pad_after_[kCacheLineSize - sizeof(T) % kCacheLineSize];
+};
+
+// Store min(*a, value) into *a, return the previous value. Only writes when
+// value is smaller, so a value that rarely changes stays in the cache of
+// every core.
+template <typename T>
+T atomic_fetch_min(std::atomic<T> *a, T value,
+                   std::memory_order order = std::memory_order_relaxed) {
+  T current = a->load(std::memory_order_relaxed);
+  while (value < current &&
+         !a->compare_exchange_weak(current, value, order,
+                                   std::memory_order_relaxed)) {
+  }
+  return current;
+}
+
+// Store max(*a, value) into *a, return the previous value.
+template <typename T>
+T atomic_fetch_max(std::atomic<T> *a, T value,
+                   std::memory_order order = std::memory_order_relaxed) {
+  T current = a->load(std::memory_order_relaxed);
+  while (current < value &&
+         !a->compare_exchange_weak(current, value, order,
+                                   std::memory_order_relaxed)) {
+  }
+  return current;
+}
+
+// An integer or a flag shared by threads where no other memory depends on
+// it, e.g. a statistic: every access is relaxed.
+template <typename T>
+class RelaxedAtomic {
+ public:
+  RelaxedAtomic() : value_(T()) {}
+  RelaxedAtomic(T value) : value_(value) {}  // NOLINT
+
+  T load() const { return value_.load(std::memory_order_relaxed); }
+  void store(T value) { value_.store(value, std::memory_order_relaxed); }
+  T exchange(T value) {
+    return value_.exchange(value, std::memory_order_relaxed);
+  }
+  T fetch_add(T value) {
+    return value_.fetch_add(value, std::memory_order_relaxed);
+  }
+  T fetch_sub(T value) {
+    return value_.fetch_sub(value, std::memory_order_relaxed);
+  }
+
+  operator T() const { return load(); }
+  RelaxedAtomic &operator=(T value) {
+    store(value);
+    return *this;
+  }
+  T operator++() { return fetch_add(1) + 1; }
+  T operator++(int) { return fetch_add(1); }
+  T operator--() { return fetch_sub(1) - 1; }
+  T operator--(int) { return fetch_sub(1); }
+  T operator+=(T value) { return fetch_add(value) + value; }
+  T operator-=(T value) { return fetch_sub(value) - value; }
+
+ private:
+  std::atomic<T> value_;
+};
+
+// A counter that many threads update and few read, like the LongAdder of
+// java: each thread adds to one of kStripes padded cells, so the updates of
+// different cores do not contend on one cache line. Sum() adds up the cells
+// and is not a snapshot while updates go on.
+template <int kStripes = 16>
+class LongAdderT {
+ public:
+  LongAdderT() {
+    for (int i = 0; i < kStripes; i++) {
+      cells_[i]->store(0, std::memory_order_relaxed);
+    }
+  }
+
+  void Add(int64_t value) {
+    cells_[ThreadStripe()]->fetch_add(value, std::memory_order_relaxed);
+  }
+  void Increment() { Add(1); }
+  void Decrement() { Add(-1); }
+
+  int64_t Sum() const {
+    int64_t sum = 0;
+    for (int i = 0; i < kStripes; i++) {
+      sum += cells_[i]->load(std::memory_order_relaxed);
+    }
+    return sum;
+  }
+
+  // the updates racing with it are counted in this sum or in the next one
+  int64_t SumThenReset() {
+    int64_t sum = 0;
+    for (int i = 0; i < kStripes; i++) {
+      sum += cells_[i]->exchange(0, std::memory_order_relaxed);
+    }
+    return sum;
+  }
+
+ private:
+  static int ThreadStripe() {
+    static std::atomic<unsigned int> next_stripe(0);
+    static thread_local int stripe = -1;
+    if (stripe < 0) {
+      stripe = static_cast<int>(
+          next_stripe.fetch_add(1, std::memory_order_relaxed) % kStripes);
+    }
+    return stripe;
+  }
+
+  CachePadded<std::atomic<int64_t> > cells_[kStripes];
+};
+
+typedef LongAdderT<> LongAdder;
+
+}  // namespace ming
+#endif
+
 #endif  // MING_ATOMIC_H_
@@ -0,0 +1,97 @@
+#ifndef MING_BENCH_BENCH_H_
+#define MING_BENCH_BENCH_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+namespace ming {
+namespace bench {
+
+typedef void (*BenchFunction)();
+
+struct Registrar {
+  Registrar(const char *name, BenchFunction function);
+};
+
+// MING_BENCH(name) { ... } defines a benchmark, ming_bench runs those whose
+// name contains one of its arguments, or all of them.
+#define MING_BENCH(name)                                          \
+  static void name();                                             \
+  static ::ming::bench::Registrar name##_registrar(#name, name);  \
+  static void name()
+
+inline uint64_t now_ns() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// keep the compiler from dropping a result nobody reads
+template <typename T>
+inline void do_not_optimize(const T &value) {
+  asm volatile("" : : "r,m"(value) : "memory");
+}
+
+inline void report(const char *label, uint64_t ns, uint64_t ops,
+                   uint64_t bytes) {
+  double ns_per_op = static_cast<double>(ns) / ops;
+  if (bytes > 0) {
+    printf("  %-44s %10.2f ns/op %10.1f MB/s\n", label, ns_per_op,
+           static_cast<double>(bytes) * 1000 / ns);
+  } else {
+    printf("  %-44s %10.2f ns/op %10.2f Mops/s\n", label, ns_per_op,
+           static_cast<double>(ops) * 1000 / ns);
+  }
+}
+
+// Call f(i) for i in [0, iterations) and print the time per call, and the
+// throughput if every call handles bytes_per_op bytes.
+template <typename F>
+void run(const char *label, uint64_t iterations, F f,
+         uint64_t bytes_per_op = 0) {
+  for (uint64_t i = 0; i < iterations / 16 + 1; i++) {
+    f(i);  // warm up
+  }
+  uint64_t start = now_ns();
+  for (uint64_t i = 0; i < iterations; i++) {
+    f(i);
+  }
+  report(label, now_ns() - start + 1, iterations, bytes_per_op * iterations);
+}
+
+// Start f(thread_index) on threads threads at once and return the wall
+// time until the last one is done.
+template <typename F>
+uint64_t run_threads(int threads, F f) {
+  std::atomic<int> ready(0);
+  std::atomic<bool> go(false);
+  std::vector<std::thread> workers;
+  for (int t = 0; t < threads; t++) {
+    workers.push_back(std::thread([&, t]() {
+      ready.fetch_add(1);
+      while (!go.load(std::memory_order_acquire)) {
+        std::this_thread::yield();
+      }
+      f(t);
+    }));
+  }
+  while (ready.load() < threads) {
+    std::this_thread::yield();
+  }
+  uint64_t start = now_ns();
+  go.store(true, std::memory_order_release);
+  for (int t = 0; t < threads; t++) {
+    workers[t].join();
+  }
+  return now_ns() - start + 1;
+}
+
+}  // namespace bench
+}  // namespace ming
+
+#endif  // MING_BENCH_BENCH_H_
@@ -0,0 +1,48 @@
+#include <string.h>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "ming/bench/bench.h"
+
+namespace ming {
+namespace bench {
+
+namespace {
+
+std::vector<std::pair<std::string, BenchFunction> > &benchmarks() {
+  static std::vector<std::pair<std::string, BenchFunction> > list;
+  return list;
+}
+
+}  // namespace
+
+Registrar::Registrar(const char *name, BenchFunction function) {
+  benchmarks().push_back(std::make_pair(std::string(name), function));
+}
+
+}  // namespace bench
+}  // namespace ming
+
+// usage: ming_bench [--list] [name ...]
+int main(int argc, char *argv[]) {
+  using ming::bench::benchmarks;
+  bool list = argc > 1 && strcmp(argv[1], "--list") == 0;
+  for (size_t i = 0; i < benchmarks().size(); i++) {
+    const std::string &name = benchmarks()[i].first;
+    bool selected = argc == 1 || list;
+    for (int j = 1; j < argc && !selected; j++) {
+      selected = name.find(argv[j]) != std::string::npos;
+    }
+    if (!selected) {
+      continue;
+    }
+    printf("%s\n", name.c_str());
+    if (!list) {
+      benchmarks()[i].second();
+      fflush(stdout);
+    }
+  }
+  return 0;
+}
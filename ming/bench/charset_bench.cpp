@@ -0,0 +1,190 @@
+#include <iconv.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "ming/bench/bench.h"
+#include "ming/encoding.h"
+
+namespace {
+
+// the built-in conversions of charset_convert()
+const struct {
+  const char *to;
+  const char *from;
+} kPairs[] = {
+    {"UTF-16LE", "UTF-8"},   {"UTF-16BE", "UTF-8"},
+    {"UTF-8", "UTF-16LE"},   {"UTF-8", "UTF-16BE"},
+    {"ISO-8859-1", "UTF-8"}, {"UTF-8", "ISO-8859-1"},
+};
+
+void append_utf8(std::string *s, unsigned int c) {
+  if (c < 0x80) {
+    *s += (char)c;
+  } else if (c < 0x800) {
+    *s += (char)(0xC0 | (c >> 6));
+    *s += (char)(0x80 | (c & 0x3F));
+  } else if (c < 0x10000) {
+    *s += (char)(0xE0 | (c >> 12));
+    *s += (char)(0x80 | ((c >> 6) & 0x3F));
+    *s += (char)(0x80 | (c & 0x3F));
+  } else {
+    *s += (char)(0xF0 | (c >> 18));
+    *s += (char)(0x80 | ((c >> 12) & 0x3F));
+    *s += (char)(0x80 | ((c >> 6) & 0x3F));
+    *s += (char)(0x80 | (c & 0x3F));
+  }
+}
+
+// half ASCII, the rest of 2, 3 and 4 bytes in UTF-8, or only Latin-1
+std::string random_text(int chars, bool latin1) {
+  std::string s;
+  for (int i = 0; i < chars; i++) {
+    int r = rand() % 8;
+    if (r < 4) {
+      append_utf8(&s, 0x20 + rand() % 0x5F);
+    } else if (r < 6 || latin1) {
+      append_utf8(&s, 0xA0 + rand() % 0x60);
+    } else if (r < 7) {
+      append_utf8(&s, 0x4E00 + rand() % 0x5000);
+    } else {
+      append_utf8(&s, 0x10000 + rand() % 0x10000);
+    }
+  }
+  return s;
+}
+
+bool iconv_all(iconv_t cd, const std::string &in, std::string *out) {
+  out->assign(in.size() * 4 + 16, '\0');
+  char *inbuf = const_cast<char *>(in.data());
+  size_t inleft = in.size();
+  char *outbuf = &(*out)[0];
+  size_t outleft = out->size();
+  iconv(cd, NULL, NULL, NULL, NULL);
+  if (iconv(cd, &inbuf, &inleft, &outbuf, &outleft) == (size_t)-1) {
+    return false;
+  }
+  out->resize(out->size() - outleft);
+  return true;
+}
+
+// CharsetConverter with input chunks of 1 to 7 bytes and output buffers
+// of 1 to 8 bytes, a character has to be written whole or not at all
+bool convert_in_pieces(const char *to, const char *from,
+                       const std::string &in, std::string *out) {
+  ming::encoding::CharsetConverter converter;
+  if (!converter.Open(to, from)) return false;
+  out->clear();
+  char buf[8];
+  size_t pos = 0;
+  while (pos < in.size()) {
+    size_t chunk = std::min(in.size() - pos, (size_t)(1 + rand() % 7));
+    char *inbuf = const_cast<char *>(in.data()) + pos;
+    size_t inleft = chunk;
+    size_t size = 1 + rand() % 8;
+    do {
+      char *outbuf = buf;
+      size_t outleft = size;
+      int n = converter.Convert(&inbuf, &inleft, &outbuf, &outleft);
+      if (n < 0) return false;
+      out->append(buf, n);
+      if (n == 0 && inleft > 0) {
+        // no room for the next character, offer more
+        if (++size > sizeof(buf)) return false;
+      } else {
+        size = 1 + rand() % 8;
+      }
+    } while (inleft > 0);
+    pos += chunk;
+  }
+  // a character still waiting for room
+  for (;;) {
+    char *inbuf = NULL;
+    size_t inleft = 0;
+    char *outbuf = buf;
+    size_t outleft = sizeof(buf);
+    int n = converter.Convert(&inbuf, &inleft, &outbuf, &outleft);
+    if (n <= 0) break;
+    out->append(buf, n);
+  }
+  char *outbuf = buf;
+  size_t outleft = sizeof(buf);
+  return converter.Finish(&outbuf, &outleft);
+}
+
+// The built-in converters against iconv, on random text in random pieces.
+// Return false if they differ.
+bool check_against_iconv(const char *to, const char *from) {
+  iconv_t encode = iconv_open(from, "UTF-8");
+  iconv_t cd = iconv_open(to, from);
+  bool latin1 = strstr(to, "8859") != NULL || strstr(from, "8859") != NULL;
+  bool same = true;
+  for (int i = 0; i < 2000 && same; i++) {
+    std::string text = random_text(rand() % 64, latin1);
+    std::string in, expected, got;
+    iconv_all(encode, text, &in);
+    iconv_all(cd, in, &expected);
+
+    std::string one_shot(expected.size() + 16, '\0');
+    char *inbuf = const_cast<char *>(in.data());
+    size_t inleft = in.size();
+    char *outbuf = &one_shot[0];
+    size_t outleft = one_shot.size();
+    int n = ming::encoding::charset_convert(to, from, &inbuf, &inleft,
+                                            &outbuf, &outleft);
+    same = n >= 0 && one_shot.compare(0, n, expected) == 0 &&
+           (size_t)n == expected.size();
+    same = same && convert_in_pieces(to, from, in, &got) && got == expected;
+  }
+  iconv_close(encode);
+  iconv_close(cd);
+  return same;
+}
+
+}  // namespace
+
+MING_BENCH(charset) {
+  srand(1);
+  char label[64];
+  for (size_t i = 0; i < sizeof(kPairs) / sizeof(kPairs[0]); i++) {
+    const char *to = kPairs[i].to;
+    const char *from = kPairs[i].from;
+    if (!check_against_iconv(to, from)) {
+      printf("  %s -> %s differs from iconv\n", from, to);
+      continue;
+    }
+
+    // 64KB of text in the input charset
+    bool latin1 = strstr(to, "8859") != NULL || strstr(from, "8859") != NULL;
+    iconv_t encode = iconv_open(from, "UTF-8");
+    iconv_t cd = iconv_open(to, from);
+    std::string in, expected;
+    iconv_all(encode, random_text(32 * 1024, latin1), &in);
+    iconv_all(cd, in, &expected);
+    std::vector<char> out(expected.size());
+
+    snprintf(label, sizeof(label), "charset_convert %s -> %s", from, to);
+    ming::bench::run(label, 2000, [&](uint64_t) {
+      char *inbuf = const_cast<char *>(in.data());
+      size_t inleft = in.size();
+      char *outbuf = &out[0];
+      size_t outleft = out.size();
+      ming::encoding::charset_convert(to, from, &inbuf, &inleft, &outbuf,
+                                      &outleft);
+    }, in.size());
+    snprintf(label, sizeof(label), "iconv %s -> %s", from, to);
+    ming::bench::run(label, 2000, [&](uint64_t) {
+      char *inbuf = const_cast<char *>(in.data());
+      size_t inleft = in.size();
+      char *outbuf = &out[0];
+      size_t outleft = out.size();
+      iconv(cd, &inbuf, &inleft, &outbuf, &outleft);
+    }, in.size());
+    iconv_close(encode);
+    iconv_close(cd);
+  }
+}
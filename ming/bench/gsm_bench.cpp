@@ -0,0 +1,253 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "ming/bench/bench.h"
+#include "ming/encoding.h"
+
+namespace {
+
+// The per-character GSM -> UTF-8 loop that the UTF-8 tables replaced: a
+// linear search of the extension table and the UTF-8 encoding on every
+// character. Its tables are read back from gsm_to_utf8() itself.
+struct PerChar {
+  struct Escape {
+    int gsmesc;
+    int unichar;
+  };
+  int unicode[128];
+  Escape escapes[129];  // ends with gsmesc -1
+
+  PerChar() {
+    int n = 0;
+    for (int c = 0; c < 128; c++) {
+      unicode[c] = Decode(c, -1);
+    }
+    for (int c = 0; c < 128; c++) {
+      // an escape that is not in the table converts as 27 alone
+      int u = c == 27 ? -1 : Decode(27, c);
+      if (u >= 0 && u != unicode[27]) {
+        escapes[n].gsmesc = c;
+        escapes[n].unichar = u;
+        n++;
+      }
+    }
+    escapes[n].gsmesc = -1;
+  }
+
+  // the code point of septet a, or of the pair a b
+  static int Decode(int a, int b) {
+    char in[2] = {(char)a, (char)b};
+    int in_len = b < 0 ? 1 : 2;
+    char out[8];
+    int out_len = sizeof(out);
+    ming::encoding::gsm_to_utf8(out, &out_len, in, &in_len);
+    const unsigned char *p = (const unsigned char *)out;
+    if (p[0] < 0x80) return p[0];
+    if (p[0] < 0xE0) return ((p[0] & 0x1F) << 6) | (p[1] & 0x3F);
+    return ((p[0] & 0x0F) << 12) | ((p[1] & 0x3F) << 6) | (p[2] & 0x3F);
+  }
+
+  int Convert(unsigned char *dest, int dest_len, const unsigned char *src,
+              int len) const {
+    unsigned char *out = dest;
+    unsigned char *out_end = dest + dest_len;
+    for (int pos = 0; pos < len; pos++) {
+      int c = src[pos];
+      if (c > 127) continue;
+      if (c == 27 && pos + 1 < len) {
+        int i;
+        c = src[++pos];
+        for (i = 0; escapes[i].gsmesc >= 0; i++) {
+          if (escapes[i].gsmesc == c) break;
+        }
+        if (escapes[i].gsmesc == c) {
+          c = escapes[i].unichar;
+        } else {
+          c = unicode[27];
+          pos--;
+        }
+      } else {
+        c = unicode[c];
+      }
+      if (c < 128) {
+        if (dest >= out_end) break;
+        *dest++ = c;
+      } else if (c < 0x800) {
+        if (dest + 1 >= out_end) break;
+        *dest++ = (c >> 6) | 0xC0;
+        *dest++ = (c & 0x3F) | 0x80;
+      } else {
+        if (dest + 2 >= out_end) break;
+        *dest++ = (c >> 12) | 0xE0;
+        *dest++ = ((c >> 6) & 0x3F) | 0x80;
+        *dest++ = (c & 0x3F) | 0x80;
+      }
+    }
+    return dest - out;
+  }
+};
+
+// one septet at a time, the reference for the 64 bit word packing
+int pack_septets(unsigned char *dest, const unsigned char *src, int septets) {
+  unsigned char *out = dest;
+  unsigned int acc = 0;
+  int bits = 0;
+  for (int i = 0; i < septets; i++) {
+    acc |= (src[i] & 0x7F) << bits;
+    bits += 7;
+    if (bits >= 8) {
+      *out++ = acc & 0xFF;
+      acc >>= 8;
+      bits -= 8;
+    }
+  }
+  if (bits > 0) {
+    *out++ = bits == 1 ? (acc | (0x0D << 1)) : acc;
+  }
+  return out - dest;
+}
+
+int unpack_septets(unsigned char *dest, const unsigned char *src,
+                   int septets) {
+  unsigned int acc = 0;
+  int bits = 0;
+  for (int i = 0; i < septets; i++) {
+    if (bits < 7) {
+      acc |= *src++ << bits;
+      bits += 8;
+    }
+    dest[i] = acc & 0x7F;
+    acc >>= 7;
+    bits -= 7;
+  }
+  return septets;
+}
+
+// 160 characters of a typical SMS, with a few from the extension table
+const char kSms[] =
+    "Your code is 482913. It expires in 10 minutes; do not share it with "
+    "anyone {support: +44 20 7946 0958} Balance: 12.50 EUR [ref #A7]. Reply "
+    "STOP to opt out~";
+// a message in the accented letters, Greek capitals and extension table of
+// GSM 03.38
+const char kAccentedSms[] =
+    "Grüße aus Köln! Señor Muñoz, été à Åre: ΔΦΓΛΩ ΠΨΣΘΞ {€5} [ÆØæøß] "
+    "ÄÖÑÜ§¿äöñüà ÉéèùìòÇ \\ |^~ ¡£¥¤ Grüße aus Köln! Señor Muñoz, été";
+
+// the septets of a run of 64KB of the message sms
+std::vector<char> gsm_text(const char *sms, std::string *utf8) {
+  while (utf8->size() < 64 * 1024) {
+    *utf8 += sms;
+  }
+  std::vector<char> septets(utf8->size() * 2);
+  int in_len = utf8->size();
+  int len = septets.size();
+  ming::encoding::utf8_to_gsm(&septets[0], &len, utf8->data(), &in_len);
+  septets.resize(len);
+  return septets;
+}
+
+void gsm_codec(const char *name, const char *sms) {
+  std::string utf8;
+  std::vector<char> septets = gsm_text(sms, &utf8);
+
+  PerChar per_char;
+  std::vector<char> out(septets.size() * 3), check(out.size());
+  int out_len = out.size();
+  int in_len = septets.size();
+  int n = ming::encoding::gsm_to_utf8(&out[0], &out_len, &septets[0], &in_len);
+  int m = per_char.Convert((unsigned char *)&check[0], check.size(),
+                           (const unsigned char *)&septets[0], septets.size());
+  if (n != m || memcmp(&out[0], &check[0], n) != 0 ||
+      std::string(&out[0], n) != utf8) {
+    printf("  %s: per character conversion differs\n", name);
+    return;
+  }
+
+  const struct {
+    const char *name;
+    int septets;
+  } kSizes[] = {{"one SMS", ming::encoding::kSmsSingleSeptets},
+                {"64KB", (int)septets.size()}};
+  char label[64];
+  for (size_t k = 0; k < sizeof(kSizes) / sizeof(kSizes[0]); k++) {
+    int size = kSizes[k].septets;
+    uint64_t iterations = (64ULL << 20) / size;
+
+    snprintf(label, sizeof(label), "%s gsm_to_utf8 %s", name, kSizes[k].name);
+    ming::bench::run(label, iterations, [&](uint64_t) {
+      int dest_len = out.size();
+      int src_len = size;
+      ming::encoding::gsm_to_utf8(&out[0], &dest_len, &septets[0], &src_len);
+    }, size);
+    snprintf(label, sizeof(label), "%s per character %s", name,
+             kSizes[k].name);
+    ming::bench::run(label, iterations, [&](uint64_t) {
+      per_char.Convert((unsigned char *)&out[0], out.size(),
+                       (const unsigned char *)&septets[0], size);
+      ming::bench::do_not_optimize(out[0]);
+    }, size);
+  }
+}
+
+}  // namespace
+
+MING_BENCH(gsm) {
+  gsm_codec("ASCII", kSms);
+  gsm_codec("accented", kAccentedSms);
+
+  std::string utf8;
+  std::vector<char> septets = gsm_text(kSms, &utf8);
+  std::vector<char> out(septets.size() * 3), packed(out.size());
+  const struct {
+    const char *name;
+    int septets;
+  } kSizes[] = {{"one SMS", ming::encoding::kSmsSingleSeptets},
+                {"64KB", (int)septets.size()}};
+  char label[64];
+  for (size_t k = 0; k < sizeof(kSizes) / sizeof(kSizes[0]); k++) {
+    int size = kSizes[k].septets;
+    uint64_t iterations = (64ULL << 20) / size;
+
+    snprintf(label, sizeof(label), "utf8_to_gsm %s", kSizes[k].name);
+    ming::bench::run(label, iterations, [&](uint64_t) {
+      int dest_len = out.size();
+      int src_len = size;
+      ming::encoding::utf8_to_gsm(&out[0], &dest_len, utf8.data(), &src_len);
+    }, size);
+
+    snprintf(label, sizeof(label), "gsm7_pack %s", kSizes[k].name);
+    ming::bench::run(label, iterations, [&](uint64_t) {
+      ming::encoding::gsm7_pack(&out[0], &septets[0], size);
+    }, size);
+    snprintf(label, sizeof(label), "septet at a time pack %s", kSizes[k].name);
+    ming::bench::run(label, iterations, [&](uint64_t) {
+      pack_septets((unsigned char *)&out[0],
+                   (const unsigned char *)&septets[0], size);
+      ming::bench::do_not_optimize(out[0]);
+    }, size);
+
+    int bytes = ming::encoding::gsm7_pack(&packed[0], &septets[0], size);
+    snprintf(label, sizeof(label), "gsm7_unpack %s", kSizes[k].name);
+    ming::bench::run(label, iterations, [&](uint64_t) {
+      ming::encoding::gsm7_unpack(&out[0], &packed[0], size);
+    }, bytes);
+    snprintf(label, sizeof(label), "septet at a time unpack %s",
+             kSizes[k].name);
+    ming::bench::run(label, iterations, [&](uint64_t) {
+      unpack_septets((unsigned char *)&out[0],
+                     (const unsigned char *)&packed[0], size);
+      ming::bench::do_not_optimize(out[0]);
+    }, bytes);
+  }
+
+  int ends[512];
+  ming::encoding::SmsCoding coding;
+  ming::bench::run("sms_split 64KB", 1000, [&](uint64_t) {
+    ming::encoding::sms_split(utf8.data(), utf8.size(), &coding, ends, 512);
+  }, utf8.size());
+}
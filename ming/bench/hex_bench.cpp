@@ -0,0 +1,70 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <vector>
+
+#include "ming/bench/bench.h"
+#include "ming/encoding.h"
+
+namespace {
+
+// a byte at a time, the reference for the table and SIMD code
+int hex_encode_bytewise(char *dest, const char *str, int len) {
+  static const char kDigits[] = "0123456789ABCDEF";
+  for (int i = 0; i < len; i++) {
+    unsigned char c = str[i];
+    dest[i * 2] = kDigits[c >> 4];
+    dest[i * 2 + 1] = kDigits[c & 15];
+  }
+  dest[len * 2] = '\0';
+  return len * 2;
+}
+
+// about 256MB per size, at least 16 calls
+uint64_t iterations(int size) {
+  uint64_t n = (256ULL << 20) / size;
+  return n < 16 ? 16 : n;
+}
+
+}  // namespace
+
+MING_BENCH(hex) {
+  const int kMaxSize = 1 << 20;
+  std::vector<char> raw(kMaxSize), text(kMaxSize * 2 + 1);
+  std::vector<char> copy(text.size()), out(kMaxSize);
+  srand(1);
+  for (int i = 0; i < kMaxSize; i++) {
+    raw[i] = static_cast<char>(rand());
+  }
+  ming::encoding::hex_encode(&text[0], &raw[0], kMaxSize);
+
+  char label[64];
+  for (int size = 16; size <= kMaxSize; size *= 4) {
+    // into a copy, the decoders below read the whole text of raw
+    snprintf(label, sizeof(label), "hex_encode %d bytes", size);
+    ming::bench::run(label, iterations(size), [&](uint64_t) {
+      ming::encoding::hex_encode(&copy[0], &raw[0], size);
+    }, size);
+    snprintf(label, sizeof(label), "byte at a time encode %d bytes", size);
+    ming::bench::run(label, iterations(size), [&](uint64_t) {
+      hex_encode_bytewise(&copy[0], &raw[0], size);
+      ming::bench::do_not_optimize(copy[0]);
+    }, size);
+    snprintf(label, sizeof(label), "hex_decode %d bytes", size);
+    ming::bench::run(label, iterations(size), [&](uint64_t) {
+      int error_offset;
+      ming::encoding::hex_decode(&out[0], &text[0], size * 2, &error_offset);
+    }, size);
+    // in 4KB chunks of text, the pairs are never split
+    snprintf(label, sizeof(label), "HexDecoder 4KB chunks %d bytes", size);
+    ming::bench::run(label, iterations(size), [&](uint64_t) {
+      ming::encoding::HexDecoder decoder;
+      char *p = &out[0];
+      for (int i = 0; i < size * 2; i += 4096) {
+        int n = size * 2 - i < 4096 ? size * 2 - i : 4096;
+        p += decoder.Update(p, &text[i], n);
+      }
+      decoder.Finish();
+    }, size);
+  }
+}
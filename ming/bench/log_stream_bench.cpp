@@ -0,0 +1,93 @@
+#include <stdio.h>
+
+#include <sstream>
+
+#include "ming/bench/bench.h"
+#include "ming/log_stream.h"
+
+namespace {
+
+const uint64_t kIterations = 1000000;
+
+// a mix of short and long numbers, as in a log line
+inline int64_t integer(uint64_t i) {
+  return (i & 1) ? static_cast<int64_t>(i * 2654435761u) : i % 1000;
+}
+
+inline double real(uint64_t i) { return (i % 100000) * 1.37 + 0.001; }
+
+}  // namespace
+
+MING_BENCH(log_stream_integer) {
+  ming::LogStream<> stream;
+  ming::bench::run("LogStream << int64", kIterations, [&](uint64_t i) {
+    stream.reset();
+    stream << integer(i);
+    ming::bench::do_not_optimize(stream.data()[0]);
+  });
+  char buf[32];
+  ming::bench::run("snprintf %lld", kIterations, [&](uint64_t i) {
+    snprintf(buf, sizeof(buf), "%lld", static_cast<long long>(integer(i)));
+    ming::bench::do_not_optimize(buf[0]);
+  });
+  std::ostringstream os;
+  ming::bench::run("std::ostringstream << int64", kIterations, [&](uint64_t i) {
+    os.str(std::string());
+    os << integer(i);
+    ming::bench::do_not_optimize(os.tellp());
+  });
+}
+
+MING_BENCH(log_stream_double) {
+  ming::LogStream<> stream;
+  ming::bench::run("LogStream << double", kIterations, [&](uint64_t i) {
+    stream.reset();
+    stream << real(i);
+    ming::bench::do_not_optimize(stream.data()[0]);
+  });
+  char buf[32];
+  ming::bench::run("snprintf %.17g", kIterations, [&](uint64_t i) {
+    snprintf(buf, sizeof(buf), "%.17g", real(i));
+    ming::bench::do_not_optimize(buf[0]);
+  });
+  std::ostringstream os;
+  ming::bench::run("std::ostringstream << double", kIterations, [&](uint64_t i) {
+    os.str(std::string());
+    os << real(i);
+    ming::bench::do_not_optimize(os.tellp());
+  });
+}
+
+MING_BENCH(log_stream_manipulators) {
+  ming::LogStream<> stream;
+  ming::bench::run("LogStream << hex(v, 16)", kIterations, [&](uint64_t i) {
+    stream.reset();
+    stream << ming::hex(integer(i), 16);
+    ming::bench::do_not_optimize(stream.data()[0]);
+  });
+  ming::bench::run("LogStream << fixed(v, 3)", kIterations, [&](uint64_t i) {
+    stream.reset();
+    stream << ming::fixed(real(i), 3);
+    ming::bench::do_not_optimize(stream.data()[0]);
+  });
+  ming::bench::run("LogStream << pad(v, 10)", kIterations, [&](uint64_t i) {
+    stream.reset();
+    stream << ming::pad(integer(i) % 100000, 10);
+    ming::bench::do_not_optimize(stream.data()[0]);
+  });
+  char buf[32];
+  ming::bench::run("snprintf %016llx", kIterations, [&](uint64_t i) {
+    snprintf(buf, sizeof(buf), "%016llx",
+             static_cast<unsigned long long>(integer(i)));
+    ming::bench::do_not_optimize(buf[0]);
+  });
+  ming::bench::run("snprintf %.3f", kIterations, [&](uint64_t i) {
+    snprintf(buf, sizeof(buf), "%.3f", real(i));
+    ming::bench::do_not_optimize(buf[0]);
+  });
+  ming::bench::run("snprintf %10lld", kIterations, [&](uint64_t i) {
+    snprintf(buf, sizeof(buf), "%10lld",
+             static_cast<long long>(integer(i) % 100000));
+    ming::bench::do_not_optimize(buf[0]);
+  });
+}
@@ -0,0 +1,189 @@
+#include <malloc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+#include "ming/bench/bench.h"
+#include "ming/hazard_pointer.h"
+#include "ming/mpmc_queue.h"
+
+namespace {
+
+const uint64_t kItems = 1000000;
+
+// the baseline, a std::deque under a std::mutex
+template <typename T>
+class MutexQueue {
+ public:
+  void Push(const T &item) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    items_.push_back(item);
+  }
+  bool Pop(T &item) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    if (items_.empty()) {
+      return false;
+    }
+    item = items_.front();
+    items_.pop_front();
+    return true;
+  }
+
+ private:
+  std::mutex mutex_;
+  std::deque<T> items_;
+};
+
+// producers push kItems between them while consumers pop them
+template <typename Queue>
+void transfer(const char *name, int producers, int consumers) {
+  Queue queue;
+  std::atomic<uint64_t> popped(0);
+  uint64_t ns = ming::bench::run_threads(producers + consumers, [&](int t) {
+    if (t < producers) {
+      for (uint64_t i = t; i < kItems; i += producers) {
+        queue.Push(i);
+      }
+      return;
+    }
+    uint64_t item;
+    while (popped.load(std::memory_order_relaxed) < kItems) {
+      if (queue.Pop(item)) {
+        popped.fetch_add(1, std::memory_order_relaxed);
+      }
+    }
+  });
+  char label[64];
+  snprintf(label, sizeof(label), "%s %dP/%dC", name, producers, consumers);
+  ming::bench::report(label, ns, kItems, 0);
+}
+
+// counts the live values, a value destroyed twice or never shows up here
+struct Tracked {
+  static std::atomic<int64_t> live;
+
+  Tracked() : value(0) { live.fetch_add(1, std::memory_order_relaxed); }
+  explicit Tracked(uint64_t v) : value(v) {
+    live.fetch_add(1, std::memory_order_relaxed);
+  }
+  Tracked(const Tracked &other) : value(other.value) {
+    live.fetch_add(1, std::memory_order_relaxed);
+  }
+  Tracked &operator=(const Tracked &other) {
+    value = other.value;
+    return *this;
+  }
+  ~Tracked() { live.fetch_sub(1, std::memory_order_relaxed); }
+
+  uint64_t value;  // producer << 32 | sequence
+};
+std::atomic<int64_t> Tracked::live(0);
+
+long resident_kb() {
+  long pages = 0, resident = 0;
+  FILE *f = fopen("/proc/self/statm", "r");
+  if (f != NULL) {
+    if (fscanf(f, "%ld %ld", &pages, &resident) != 2) {
+      resident = 0;
+    }
+    fclose(f);
+  }
+  return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+// the stress test ends the program with a failure, not only a line of output
+void expect(bool ok, int round, const char *what) {
+  if (!ok) {
+    printf("  FAILED in round %d: %s\n", round, what);
+    fflush(stdout);
+    exit(1);
+  }
+}
+
+}  // namespace
+
+MING_BENCH(mpmc_queue) {
+  const int kThreads[] = {1, 2, 4};
+  for (int i = 0; i < 3; i++) {
+    transfer<ming::MpmcQueue<uint64_t> >("MpmcQueue", kThreads[i],
+                                         kThreads[i]);
+    transfer<MutexQueue<uint64_t> >("mutex + std::deque", kThreads[i],
+                                    kThreads[i]);
+  }
+}
+
+// Every value must be popped exactly once and in the order of its
+// producer, which a node reused under a stale pointer (ABA) would break.
+// Every value must be destroyed, and the memory must not grow from a round
+// to the next, which a node that is never reclaimed would make it do. The
+// program exits with 1 if one of them fails.
+MING_BENCH(mpmc_queue_stress) {
+  const int kProducers = 4;
+  const int kConsumers = 4;
+  const int kRounds = 10;
+  // a round that leaks its nodes adds more than a pointer per item, the
+  // peak length of the queue varies by much less
+  const long kLeakKB = (kRounds - 2) * kItems * sizeof(void *) / 1024;
+  long round1_kb = 0;
+  for (int round = 0; round < kRounds; round++) {
+    std::atomic<uint64_t> popped(0), errors(0), sum(0);
+    {
+      ming::MpmcQueue<Tracked> queue;
+      ming::bench::run_threads(kProducers + kConsumers, [&](int t) {
+        if (t < kProducers) {
+          for (uint64_t i = 0; i < kItems / kProducers; i++) {
+            queue.Push(Tracked((static_cast<uint64_t>(t) << 32) | i));
+          }
+          return;
+        }
+        std::vector<int64_t> last(kProducers, -1);
+        uint64_t local_sum = 0;
+        Tracked item;
+        while (popped.load(std::memory_order_relaxed) < kItems) {
+          if (!queue.Pop(item)) {
+            continue;
+          }
+          popped.fetch_add(1, std::memory_order_relaxed);
+          int producer = static_cast<int>(item.value >> 32);
+          int64_t seq = static_cast<int64_t>(item.value & 0xffffffff);
+          if (producer >= kProducers || seq <= last[producer]) {
+            errors.fetch_add(1, std::memory_order_relaxed);
+          } else {
+            last[producer] = seq;
+          }
+          local_sum += seq;
+        }
+        sum.fetch_add(local_sum);
+      });
+    }
+    ming::hazard_reclaim();
+    // give the freed nodes back to the system, or the resident size only
+    // tells the peak of the queue
+    malloc_trim(0);
+    uint64_t per_producer = kItems / kProducers;
+    uint64_t expected_sum = kProducers * per_producer * (per_producer - 1) / 2;
+    long kb = resident_kb();
+    printf("  round %d: popped %llu, %llu out of order, sum %s, %lld live "
+           "values, %ld KB resident\n",
+           round, static_cast<unsigned long long>(popped.load()),
+           static_cast<unsigned long long>(errors.load()),
+           sum.load() == expected_sum ? "ok" : "WRONG",
+           static_cast<long long>(Tracked::live.load()), kb);
+    expect(errors.load() == 0, round, "values popped out of order");
+    expect(sum.load() == expected_sum, round, "values lost or popped twice");
+    expect(Tracked::live.load() == 0, round, "values not destroyed");
+    // round 0 allocates the arenas of the threads and the hazard records
+    if (round == 1) {
+      round1_kb = kb;
+    }
+    expect(round <= 1 || kb - round1_kb < kLeakKB, round,
+           "resident memory grows, nodes are not reclaimed");
+  }
+  printf("  resident memory grew by %ld KB after round 1\n",
+         resident_kb() - round1_kb);
+}
@@ -0,0 +1,68 @@
+#include <stdio.h>
+
+#include <algorithm>
+#include <thread>
+
+#include "ming/adaptive_mutex.h"
+#include "ming/bench/bench.h"
+#include "ming/mutex.h"
+#include "ming/spin_lock.h"
+
+namespace {
+
+const int kOpsPerThread = 100000;
+
+// a few dependent multiplications, inside and outside the lock
+inline uint64_t work(uint64_t x, int rounds) {
+  for (int i = 0; i < rounds; i++) {
+    x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+  }
+  return x;
+}
+
+template <typename Lock>
+void contend(const char *name, int threads, int inside, int outside) {
+  Lock lock;
+  uint64_t counter = 0;
+  uint64_t state = 1;
+  uint64_t ns = ming::bench::run_threads(threads, [&](int t) {
+    uint64_t x = t + 1;
+    for (int i = 0; i < kOpsPerThread; i++) {
+      x = work(x, outside);
+      typename Lock::ScopedLock guard(lock);
+      state = work(state, inside);
+      counter++;
+    }
+    ming::bench::do_not_optimize(x);
+  });
+  char label[64];
+  snprintf(label, sizeof(label), "%s %d threads%s", name, threads,
+           counter == static_cast<uint64_t>(kOpsPerThread) * threads
+               ? ""
+               : " LOST UPDATES");
+  ming::bench::report(label, ns, counter, 0);
+}
+
+template <typename Lock>
+void sweep(const char *name, int inside, int outside) {
+  int cpus = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+  // up to 4 threads per CPU, where a spinning waiter can burn the timeslice
+  // of a preempted holder
+  for (int threads = 1; threads <= cpus * 4; threads *= 2) {
+    contend<Lock>(name, threads, inside, outside);
+  }
+}
+
+void run_all(int inside, int outside) {
+  sweep<ming::SpinLock>("SpinLock (pthread_spin)", inside, outside);
+  sweep<ming::Mutex>("Mutex (pthread)", inside, outside);
+  sweep<ming::AdaptiveMutex>("AdaptiveMutex", inside, outside);
+  sweep<ming::McsLock>("McsLock", inside, outside);
+}
+
+}  // namespace
+
+// aggregate throughput, the time per critical section of all threads
+MING_BENCH(mutex_short_critical_section) { run_all(4, 16); }
+
+MING_BENCH(mutex_long_critical_section) { run_all(200, 200); }
@@ -0,0 +1,110 @@
+#include <stdio.h>
+
+#include <algorithm>
+#include <thread>
+
+#include "ming/bench/bench.h"
+#include "ming/distributed_rw_lock.h"
+#include "ming/linux/linux_rw_lock.h"
+// folly/RWSpinLock.h needs glog and the folly headers
+#if defined(__has_include)
+#if __has_include(<glog/logging.h>) && __has_include(<folly/Likely.h>)
+#define MING_BENCH_FOLLY_RW_SPIN_LOCK
+#include "ming/folly/RWSpinLock.h"
+#endif
+#endif
+
+namespace {
+
+const int kOpsPerThread = 200000;
+
+// the same four calls for every lock
+struct PthreadRWLock {
+  static const char *name() { return "RWLock (pthread)"; }
+  void read_lock() { lock.ReadLock(); }
+  void read_unlock() { lock.Unlock(); }
+  void write_lock() { lock.WriteLock(); }
+  void write_unlock() { lock.Unlock(); }
+  ming::RWLock lock;
+};
+
+#if defined(MING_BENCH_FOLLY_RW_SPIN_LOCK)
+struct FollyRWSpinLock {
+  static const char *name() { return "folly::RWSpinLock"; }
+  void read_lock() { lock.lock_shared(); }
+  void read_unlock() { lock.unlock_shared(); }
+  void write_lock() { lock.lock(); }
+  void write_unlock() { lock.unlock(); }
+  folly::RWSpinLock lock;
+};
+#endif
+
+struct DistributedLock {
+  static const char *name() { return "DistributedRWLock"; }
+  void read_lock() { lock.ReadLock(); }
+  void read_unlock() { lock.ReadUnlock(); }
+  void write_lock() { lock.WriteLock(); }
+  void write_unlock() { lock.WriteUnlock(); }
+  ming::DistributedRWLock lock;
+};
+
+// the data the lock protects, on its own cache lines
+struct Shared {
+  char pad0[64];
+  uint64_t values[8];
+  char pad1[64];
+};
+
+// one write every writes_per_1000 / 1000 operations
+template <typename Lock>
+void contend(int threads, int writes_per_1000) {
+  Lock *lock = new Lock;
+  Shared *shared = new Shared();
+  uint64_t ns = ming::bench::run_threads(threads, [&](int t) {
+    uint32_t x = t * 2654435761u + 1;
+    uint64_t sum = 0;
+    for (int i = 0; i < kOpsPerThread; i++) {
+      x = x * 1103515245 + 12345;
+      if ((x >> 16) % 1000 < static_cast<uint32_t>(writes_per_1000)) {
+        lock->write_lock();
+        shared->values[i & 7]++;
+        lock->write_unlock();
+      } else {
+        lock->read_lock();
+        sum += shared->values[i & 7];
+        lock->read_unlock();
+      }
+    }
+    ming::bench::do_not_optimize(sum);
+  });
+  char label[64];
+  snprintf(label, sizeof(label), "%s %d threads %.1f%% writes", Lock::name(),
+           threads, writes_per_1000 / 10.0);
+  ming::bench::report(label, ns, static_cast<uint64_t>(kOpsPerThread) * threads,
+                      0);
+  delete shared;
+  delete lock;
+}
+
+template <typename Lock>
+void sweep() {
+  int max_threads =
+      std::max(2, static_cast<int>(std::thread::hardware_concurrency()));
+  const int kWrites[] = {0, 10, 100};
+  for (int w = 0; w < 3; w++) {
+    for (int threads = 1; threads <= max_threads; threads *= 2) {
+      contend<Lock>(threads, kWrites[w]);
+    }
+  }
+}
+
+}  // namespace
+
+// aggregate throughput, the time per operation of all threads together
+MING_BENCH(rw_lock) {
+  sweep<PthreadRWLock>();
+#if defined(MING_BENCH_FOLLY_RW_SPIN_LOCK)
+  sweep<FollyRWSpinLock>();
+#endif
+  sweep<DistributedLock>();
+}
@@ -0,0 +1,114 @@
+#if defined(__linux__)
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <atomic>
+
+#include "ming/bench/bench.h"
+#include "ming/timer_service.h"
+
+namespace {
+
+const int kProducers = 4;
+const uint64_t kTimersPerSecond = 1000000;
+const int kSeconds = 3;
+const int64_t kMaxDelayUs = 50000;
+const int kCancelEvery = 4;  // cancel one timer out of kCancelEvery
+
+// updated by the timer thread only
+struct Stats {
+  std::atomic<uint64_t> fired;
+  std::atomic<uint64_t> early;  // fired before their deadline
+  std::atomic<int64_t> late_ns;  // sum
+  std::atomic<int64_t> max_late_ns;
+};
+
+void on_timer(Stats *stats, uint64_t deadline_ns) {
+  int64_t late = static_cast<int64_t>(ming::bench::now_ns() - deadline_ns);
+  stats->fired.fetch_add(1, std::memory_order_relaxed);
+  if (late < 0) {
+    stats->early.fetch_add(1, std::memory_order_relaxed);
+  }
+  stats->late_ns.fetch_add(late, std::memory_order_relaxed);
+  if (late > stats->max_late_ns.load(std::memory_order_relaxed)) {
+    stats->max_late_ns.store(late, std::memory_order_relaxed);
+  }
+}
+
+}  // namespace
+
+// kProducers threads schedule kTimersPerSecond timers per second between
+// them for kSeconds and cancel some, then every timer that was not
+// cancelled must fire exactly once
+MING_BENCH(timer_service_stress) {
+  ming::TimerService service;
+  if (!service.Start(1000)) {
+    printf("  TimerService::Start failed\n");
+    return;
+  }
+  Stats stats;
+  stats.fired = 0;
+  stats.early = 0;
+  stats.late_ns = 0;
+  stats.max_late_ns = 0;
+  std::atomic<uint64_t> scheduled(0), cancelled(0), failed(0);
+  const uint64_t per_thread = kTimersPerSecond * kSeconds / kProducers;
+
+  uint64_t ns = ming::bench::run_threads(kProducers, [&](int t) {
+    unsigned int seed = t;
+    uint64_t start = ming::bench::now_ns();
+    uint64_t done = 0;
+    while (done < per_thread) {
+      // pace to the target rate, in bursts
+      uint64_t elapsed = ming::bench::now_ns() - start;
+      uint64_t due = elapsed * kTimersPerSecond / kProducers / 1000000000;
+      if (due > per_thread) {
+        due = per_thread;
+      }
+      if (done >= due) {
+        usleep(100);
+        continue;
+      }
+      for (; done < due; done++) {
+        int64_t delay_us = rand_r(&seed) % kMaxDelayUs;
+        uint64_t deadline = ming::bench::now_ns() + delay_us * 1000;
+        ming::TimerService::TimerId id = service.Schedule(
+            delay_us, [&stats, deadline]() { on_timer(&stats, deadline); });
+        if (id == 0) {
+          failed.fetch_add(1, std::memory_order_relaxed);
+          continue;
+        }
+        scheduled.fetch_add(1, std::memory_order_relaxed);
+        if (done % kCancelEvery == 0 && service.Cancel(id)) {
+          cancelled.fetch_add(1, std::memory_order_relaxed);
+        }
+      }
+    }
+  });
+  double rate = static_cast<double>(scheduled.load()) * 1e9 / ns;
+
+  // wait for the last timers, allowing for a slow timer thread
+  uint64_t expected = scheduled.load() - cancelled.load();
+  for (int i = 0; i < 100 && stats.fired.load() < expected; i++) {
+    usleep(kMaxDelayUs);
+  }
+  usleep(kMaxDelayUs);  // and for timers that should not fire at all
+  service.Stop();
+
+  uint64_t fired = stats.fired.load();
+  printf("  scheduled %llu (%.0f/s), cancelled %llu, failed %llu\n",
+         static_cast<unsigned long long>(scheduled.load()), rate,
+         static_cast<unsigned long long>(cancelled.load()),
+         static_cast<unsigned long long>(failed.load()));
+  printf("  fired %llu of %llu%s, %llu early\n",
+         static_cast<unsigned long long>(fired),
+         static_cast<unsigned long long>(expected),
+         fired == expected ? "" : " MISMATCH",
+         static_cast<unsigned long long>(stats.early.load()));
+  printf("  late by %.1f us on average, %.1f us at most\n",
+         fired > 0 ? stats.late_ns.load() / 1000.0 / fired : 0.0,
+         stats.max_late_ns.load() / 1000.0);
+}
+
+#endif  // __linux__
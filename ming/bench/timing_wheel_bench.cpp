@@ -0,0 +1,79 @@
+#include <stdlib.h>
+
+#include <vector>
+
+#include "ming/bench/bench.h"
+#include "ming/timing_wheel.h"
+#if defined(MING_BENCH_FOLLY_TIMEOUT_QUEUE)
+#include "ming/folly/TimeoutQueue.h"
+#endif
+
+namespace {
+
+const int kTimers = 1000000;
+// connection timeouts of up to a minute in milliseconds
+const int64_t kMaxDelay = 60000;
+
+// add kTimers timeouts, erase half of them and run the rest to expiry
+template <typename Queue>
+void add_erase_expire(const char *name) {
+  std::vector<int64_t> delays(kTimers);
+  srand(1);
+  for (int i = 0; i < kTimers; i++) {
+    delays[i] = rand() % kMaxDelay;
+  }
+  Queue queue;
+  std::vector<typename Queue::Id> ids(kTimers);
+  uint64_t fired = 0;
+  char label[64];
+
+  uint64_t start = ming::bench::now_ns();
+  for (int i = 0; i < kTimers; i++) {
+    ids[i] = queue.add(0, delays[i],
+                       [&fired](typename Queue::Id, int64_t) { fired++; });
+  }
+  snprintf(label, sizeof(label), "%s add", name);
+  ming::bench::report(label, ming::bench::now_ns() - start, kTimers, 0);
+
+  start = ming::bench::now_ns();
+  for (int i = 0; i < kTimers; i += 2) {
+    queue.erase(ids[i]);
+  }
+  snprintf(label, sizeof(label), "%s erase", name);
+  ming::bench::report(label, ming::bench::now_ns() - start, kTimers / 2, 0);
+
+  start = ming::bench::now_ns();
+  for (int64_t now = 0; now <= kMaxDelay; now++) {
+    queue.runOnce(now);
+  }
+  snprintf(label, sizeof(label), "%s expire (1 tick per run)", name);
+  ming::bench::report(label, ming::bench::now_ns() - start, fired, 0);
+}
+
+// one far timer pending and a long idle gap between two runs
+template <typename Queue>
+void idle_gap(const char *name) {
+  char label[64];
+  int64_t gap = 1000000;
+  for (int exponent = 6; exponent <= 10; exponent += 2, gap *= 100) {
+    Queue queue;
+    queue.add(0, 1LL << 45, [](typename Queue::Id, int64_t) {});
+    uint64_t start = ming::bench::now_ns();
+    queue.runOnce(gap);
+    snprintf(label, sizeof(label), "%s runOnce(1e%d) idle", name, exponent);
+    ming::bench::report(label, ming::bench::now_ns() - start, 1, 0);
+  }
+}
+
+}  // namespace
+
+MING_BENCH(timing_wheel) {
+  add_erase_expire<ming::TimingWheel>("TimingWheel");
+#if defined(MING_BENCH_FOLLY_TIMEOUT_QUEUE)
+  add_erase_expire<folly::TimeoutQueue>("folly::TimeoutQueue");
+#endif
+  idle_gap<ming::TimingWheel>("TimingWheel");
+#if defined(MING_BENCH_FOLLY_TIMEOUT_QUEUE)
+  idle_gap<folly::TimeoutQueue>("folly::TimeoutQueue");
+#endif
+}
@@ -0,0 +1,199 @@
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "ming/bench/bench.h"
+#include "ming/url_escape.h"
+
+namespace {
+
+const char kHexChar[] = "0123456789ABCDEF";
+
+// The escape() the tables replaced: shouldEscape() on every byte, once to
+// count and once to write.
+int escape_per_byte(int mode, const char *s, int s_len, char *t, int t_len) {
+  int spaces = 0;
+  int hex = 0;
+  for (int i = 0; i < s_len; i++) {
+    if (shouldEscape(s[i], mode)) {
+      if (s[i] == ' ' && mode == kEncodeQueryComponent) {
+        spaces++;
+      } else {
+        hex++;
+      }
+    }
+  }
+  if (spaces == 0 && hex == 0) {
+    memcpy(t, s, s_len);
+    t[s_len] = '\0';
+    return s_len;
+  }
+  int required = s_len + 2 * hex;
+  if (required >= t_len) {
+    return required;
+  }
+  int j = 0;
+  for (int i = 0; i < s_len; i++) {
+    unsigned char c = s[i];
+    if (c == ' ' && mode == kEncodeQueryComponent) {
+      t[j++] = '+';
+    } else if (shouldEscape(c, mode)) {
+      t[j++] = '%';
+      t[j++] = kHexChar[c >> 4];
+      t[j++] = kHexChar[c & 15];
+    } else {
+      t[j++] = c;
+    }
+  }
+  t[j] = '\0';
+  return required;
+}
+
+int unhex(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+// a byte at a time with branches on every digit, the reference for
+// unescape()
+int unescape_per_byte(int mode, const char *s, int s_len, char *t) {
+  int j = 0;
+  for (int i = 0; i < s_len; i++) {
+    if (s[i] == '%') {
+      if (i + 2 >= s_len || unhex(s[i + 1]) < 0 || unhex(s[i + 2]) < 0) {
+        return -1;
+      }
+      t[j++] = (char)(unhex(s[i + 1]) << 4 | unhex(s[i + 2]));
+      i += 2;
+    } else if (s[i] == '+' && mode == kEncodeQueryComponent) {
+      t[j++] = ' ';
+    } else {
+      t[j++] = s[i];
+    }
+  }
+  t[j] = '\0';
+  return j;
+}
+
+int count_pair(void *context, const char *, int, const char *, int) {
+  ++*static_cast<int *>(context);
+  return 0;
+}
+
+// the parts of URLs that get escaped, from an API gateway log
+const char *const kPaths[] = {
+    "/api/v1/users/1234567/photos/IMG 2024-05-01 (1).jpg",
+    "/static/js/app.3f2a9c.min.js",
+    "/wiki/Caf\xC3\xA9_au_lait#History",
+    "/search/results/page/2",
+};
+const char *const kQueryValues[] = {
+    "caf\xC3\xA9 au lait",
+    "price>10&<50",
+    "fr-FR",
+    "2024-05-01T12:30:00+02:00",
+    "https://example.com/callback?state=a b c",
+    "12345",
+};
+
+}  // namespace
+
+MING_BENCH(url_escape) {
+  std::vector<char> out(4096), check(4096);
+  char label[64];
+  const struct {
+    const char *name;
+    int mode;
+    const char *const *inputs;
+    int count;
+  } kCases[] = {
+      {"path", kEncodePath, kPaths, sizeof(kPaths) / sizeof(kPaths[0])},
+      {"query value", kEncodeQueryComponent, kQueryValues,
+       sizeof(kQueryValues) / sizeof(kQueryValues[0])},
+  };
+  for (size_t k = 0; k < sizeof(kCases) / sizeof(kCases[0]); k++) {
+    const char *const *inputs = kCases[k].inputs;
+    int count = kCases[k].count;
+    int mode = kCases[k].mode;
+    uint64_t bytes = 0;
+    for (int i = 0; i < count; i++) {
+      int len = strlen(inputs[i]);
+      bytes += len;
+      int n = escape(mode, inputs[i], len, &out[0], out.size());
+      int m = escape_per_byte(mode, inputs[i], len, &check[0], check.size());
+      if (n != m || memcmp(&out[0], &check[0], n) != 0) {
+        printf("  %s: escape differs on %s\n", kCases[k].name, inputs[i]);
+        return;
+      }
+    }
+
+    snprintf(label, sizeof(label), "escape %s", kCases[k].name);
+    ming::bench::run(label, 1000000, [&](uint64_t) {
+      for (int i = 0; i < count; i++) {
+        escape(mode, inputs[i], strlen(inputs[i]), &out[0], out.size());
+      }
+    }, bytes);
+    snprintf(label, sizeof(label), "per byte shouldEscape %s",
+             kCases[k].name);
+    ming::bench::run(label, 1000000, [&](uint64_t) {
+      for (int i = 0; i < count; i++) {
+        escape_per_byte(mode, inputs[i], strlen(inputs[i]), &out[0],
+                        out.size());
+      }
+      ming::bench::do_not_optimize(out[0]);
+    }, bytes);
+  }
+
+  // a whole query string, escaped as a client sends it
+  std::string query;
+  for (int i = 0; i < 6; i++) {
+    char escaped[256];
+    int n = query_escape(kQueryValues[i], strlen(kQueryValues[i]), escaped,
+                         sizeof(escaped));
+    query += i == 0 ? "" : "&";
+    query += "k" + std::to_string(i) + "=";
+    query.append(escaped, n);
+  }
+  // and the paths, where the escapes are few
+  std::string path;
+  for (size_t i = 0; i < sizeof(kPaths) / sizeof(kPaths[0]); i++) {
+    char escaped[256];
+    path.append(escaped, escape(kEncodePath, kPaths[i], strlen(kPaths[i]),
+                                escaped, sizeof(escaped)));
+  }
+  const struct {
+    const char *name;
+    int mode;
+    const std::string &s;
+  } kEscaped[] = {{"query", kEncodeQueryComponent, query},
+                  {"path", kEncodePath, path}};
+  for (size_t k = 0; k < sizeof(kEscaped) / sizeof(kEscaped[0]); k++) {
+    int mode = kEscaped[k].mode;
+    const std::string &s = kEscaped[k].s;
+    int n = unescape(mode, s.data(), s.size(), &out[0], out.size());
+    int m = unescape_per_byte(mode, s.data(), s.size(), &check[0]);
+    if (n != m || memcmp(&out[0], &check[0], n) != 0) {
+      printf("  unescape differs on %s\n", s.c_str());
+      return;
+    }
+    snprintf(label, sizeof(label), "unescape %s", kEscaped[k].name);
+    ming::bench::run(label, 1000000, [&](uint64_t) {
+      unescape(mode, s.data(), s.size(), &out[0], out.size());
+    }, s.size());
+    snprintf(label, sizeof(label), "per byte unescape %s", kEscaped[k].name);
+    ming::bench::run(label, 1000000, [&](uint64_t) {
+      unescape_per_byte(mode, s.data(), s.size(), &out[0]);
+      ming::bench::do_not_optimize(out[0]);
+    }, s.size());
+  }
+
+  ming::bench::run("query_split", 1000000, [&](uint64_t) {
+    int pairs = 0;
+    query_split(query.data(), query.size(), count_pair, &pairs);
+    ming::bench::do_not_optimize(pairs);
+  }, query.size());
+}
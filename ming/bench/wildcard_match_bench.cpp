@@ -0,0 +1,127 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <string>
+#include <vector>
+
+#include "ming/bench/bench.h"
+#include "ming/wildcard_match.h"
+
+namespace {
+
+// The wildcard_match() before it dropped the recursion: every '*' tries
+// both choices, exponential in the number of '*'s on a mismatch.
+int recursive_match(const char *s, const char *pattern) {
+  while (*pattern) {
+    if (*pattern == '*') {
+      if (recursive_match(s, pattern + 1)) return 1;
+      if (*s && recursive_match(s + 1, pattern)) return 1;
+      return 0;
+    } else if (*pattern == '?') {
+      if (!*s) return 0;
+      ++s;
+      ++pattern;
+    } else {
+      if (*s++ != *pattern++) return 0;
+    }
+  }
+  return !*s && !*pattern;
+}
+
+// the host names of a DNS filter list and the patterns it is checked with
+std::vector<std::string> host_names(int n) {
+  const char *const kLabels[] = {"www", "api", "cdn", "mail", "static",
+                                 "img",  "eu",  "us",  "edge", "login"};
+  const char *const kDomains[] = {"example.com", "example.net", "google.com",
+                                  "akamaiedge.net", "cloudfront.net"};
+  std::vector<std::string> hosts;
+  for (int i = 0; i < n; i++) {
+    std::string host;
+    for (int labels = 1 + rand() % 3; labels > 0; labels--) {
+      host += kLabels[rand() % 10];
+      if (rand() % 4 == 0) host += std::to_string(rand() % 100);
+      host += '.';
+    }
+    host += kDomains[rand() % 5];
+    hosts.push_back(host);
+  }
+  return hosts;
+}
+
+const char *const kPatterns[] = {
+    "*.example.com", "api??.example.net", "*.cdn.*.net", "www.google.com",
+    "*edge*",
+};
+
+}  // namespace
+
+MING_BENCH(wildcard_match) {
+  srand(1);
+  std::vector<std::string> hosts = host_names(1000);
+  const int kPatternCount = sizeof(kPatterns) / sizeof(kPatterns[0]);
+  std::vector<ming::CompiledWildcard> compiled;
+  for (int p = 0; p < kPatternCount; p++) {
+    compiled.push_back(ming::CompiledWildcard(kPatterns[p]));
+    for (size_t i = 0; i < hosts.size(); i++) {
+      const char *s = hosts[i].c_str();
+      int expected = recursive_match(s, kPatterns[p]);
+      if (wildcard_match(s, kPatterns[p]) != expected ||
+          compiled[p].Match(s, hosts[i].size()) != (expected != 0)) {
+        printf("  %s differs on %s\n", kPatterns[p], s);
+        return;
+      }
+    }
+  }
+
+  uint64_t bytes = 0;
+  for (size_t i = 0; i < hosts.size(); i++) {
+    bytes += hosts[i].size() * kPatternCount;
+  }
+  int matched = 0;
+  ming::bench::run("recursive, 1000 hosts x 5 patterns", 1000, [&](uint64_t) {
+    for (size_t i = 0; i < hosts.size(); i++) {
+      for (int p = 0; p < kPatternCount; p++) {
+        matched += recursive_match(hosts[i].c_str(), kPatterns[p]);
+      }
+    }
+  }, bytes);
+  ming::bench::run("wildcard_match", 1000, [&](uint64_t) {
+    for (size_t i = 0; i < hosts.size(); i++) {
+      for (int p = 0; p < kPatternCount; p++) {
+        matched += wildcard_match(hosts[i].c_str(), kPatterns[p]);
+      }
+    }
+  }, bytes);
+  ming::bench::run("CompiledWildcard", 1000, [&](uint64_t) {
+    for (size_t i = 0; i < hosts.size(); i++) {
+      for (int p = 0; p < kPatternCount; p++) {
+        matched += compiled[p].Match(hosts[i].data(), hosts[i].size());
+      }
+    }
+  }, bytes);
+  ming::bench::do_not_optimize(matched);
+
+  // a run of 'a's never matches "*a*a*a*b", the recursion tries every way
+  // of placing the 'a's; it only gets the short run
+  const char *kBad = "*a*a*a*b";
+  ming::CompiledWildcard bad(kBad);
+  char label[64];
+  for (int n = 32; n <= 4096; n *= 8) {
+    std::string s(n, 'a');
+    if (n <= 32) {
+      snprintf(label, sizeof(label), "recursive %s on %d a's", kBad, n);
+      ming::bench::run(label, 10, [&](uint64_t) {
+        matched += recursive_match(s.c_str(), kBad);
+      });
+    }
+    snprintf(label, sizeof(label), "wildcard_match %s on %d a's", kBad, n);
+    ming::bench::run(label, 1000, [&](uint64_t) {
+      matched += wildcard_match(s.c_str(), kBad);
+    });
+    snprintf(label, sizeof(label), "CompiledWildcard %s on %d a's", kBad, n);
+    ming::bench::run(label, 1000, [&](uint64_t) {
+      matched += bad.Match(s.data(), s.size());
+    });
+  }
+  ming::bench::do_not_optimize(matched);
+}
@@ -0,0 +1,98 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <string>
+
+#include "ming/bench/bench.h"
+#include "ming/xml_escape.h"
+
+namespace {
+
+// a document of size bytes with markup in its text every 64 bytes or so
+std::string xml_text(int size) {
+  const char *const kWords[] = {"price", "<b>", "&", "caf\xC3\xA9", "\"q\"",
+                                "it's", "x > y", "\xE4\xB8\xAD\xE6\x96\x87"};
+  std::string s;
+  while ((int)s.size() < size) {
+    s.append(60, 'a');
+    s += kWords[rand() % 8];
+  }
+  s.resize(size);
+  return s;
+}
+
+std::string to_string(ming::EscapeBuffer &ob) {
+  return std::string(ob.data(), ob.length());
+}
+
+// escape_xml() and back on a document, whole and through the streaming
+// escapers in chunks of chunk bytes
+bool round_trip(const std::string &doc, int chunk) {
+  ming::small_buffer escaped, unescaped, streamed;
+  const unsigned char *src = (const unsigned char *)doc.data();
+  if (!ming::escape_xml(escaped, src, doc.size()) ||
+      !ming::unescape_xml(unescaped, escaped.data(), escaped.size()) ||
+      to_string(unescaped) != doc) {
+    return false;
+  }
+  ming::XmlBufferSink sink(&streamed);
+  ming::XmlEscaper escaper(&sink);
+  for (size_t pos = 0; pos < doc.size(); pos += chunk) {
+    escaper.Update(src + pos, doc.size() - pos < (size_t)chunk
+                                  ? doc.size() - pos
+                                  : chunk);
+  }
+  escaper.Finish();
+  return to_string(streamed) == to_string(escaped);
+}
+
+}  // namespace
+
+MING_BENCH(xml_escape) {
+  srand(1);
+  // larger than kChainBufferMaxSize, a small_buffer takes it all
+  std::string large(300 * 1024, 'a');
+  large[0] = '<';
+  ming::small_buffer ob;
+  if (!ming::escape_xml(ob, (const unsigned char *)large.data(),
+                        large.size()) ||
+      ob.overflow() || ob.size() != large.size() + 3) {
+    printf("  a %d byte document is cut to %u bytes\n", (int)large.size(),
+           ob.size());
+    return;
+  }
+  // and one bounded below it says so
+  ming::small_buffer bounded(64 * 1024);
+  if (ming::escape_xml(bounded, (const unsigned char *)large.data(),
+                       large.size()) ||
+      !bounded.overflow()) {
+    printf("  escape_xml did not report the overflow of its buffer\n");
+    return;
+  }
+  if (!round_trip(xml_text(1024 * 1024 + 7), 4093)) {
+    printf("  escape and unescape of 1MB differ\n");
+    return;
+  }
+
+  char label[64];
+  for (int size = 1024; size <= 1024 * 1024; size *= 32) {
+    std::string doc = xml_text(size);
+    uint64_t iterations = (256ULL << 20) / size;
+    snprintf(label, sizeof(label), "escape_xml %d bytes", size);
+    ming::bench::run(label, iterations, [&](uint64_t) {
+      ming::small_buffer out;
+      ming::escape_xml(out, (const unsigned char *)doc.data(), doc.size());
+      ming::bench::do_not_optimize(out);
+    }, size);
+
+    ming::small_buffer escaped;
+    ming::escape_xml(escaped, (const unsigned char *)doc.data(), doc.size());
+    std::string text = to_string(escaped);
+    snprintf(label, sizeof(label), "unescape_xml %d bytes", size);
+    ming::bench::run(label, iterations, [&](uint64_t) {
+      ming::small_buffer out;
+      ming::unescape_xml(out, text.data(), text.size());
+      ming::bench::do_not_optimize(out);
+    }, text.size());
+  }
+}
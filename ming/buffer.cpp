@@ -0,0 +1,89 @@
+#include "ming/buffer.h"
+
+#include <vector>
+
+#include "ming/spin_lock.h"
+
+namespace ming {
+
+namespace {
+
+const int kThreadCachedBlocks = 64;
+const int kGlobalCachedBlocks = 1024;
+
+struct GlobalBlockPool {
+  SpinLock lock;
+  std::vector<BufferBlock*> blocks;
+};
+
+GlobalBlockPool& global_pool() {
+  static GlobalBlockPool* pool = new GlobalBlockPool;  // never destroyed
+  return *pool;
+}
+
+// Blocks freed by a thread are reused by the same thread first. The cache
+// is handed over to the global pool when the thread exits.
+struct ThreadBlockCache {
+  ThreadBlockCache() : head(0), count(0) {}
+  ~ThreadBlockCache() {
+    while (head != 0) {
+      BufferBlock* b = head;
+      head = b->next;
+      GlobalBlockPool& pool = global_pool();
+      SpinLock::ScopedLock guard(pool.lock);
+      if (static_cast<int>(pool.blocks.size()) < kGlobalCachedBlocks) {
+        pool.blocks.push_back(b);
+      } else {
+        delete b;
+      }
+    }
+  }
+  BufferBlock* head;
+  int count;
+};
+thread_local ThreadBlockCache t_blocks;
+
+}  // namespace
+
+BufferBlock* buffer_block_alloc() {
+  ThreadBlockCache& cache = t_blocks;
+  if (cache.head != 0) {
+    BufferBlock* b = cache.head;
+    cache.head = b->next;
+    cache.count--;
+    return b;
+  }
+
+  GlobalBlockPool& pool = global_pool();
+  {
+    SpinLock::ScopedLock guard(pool.lock);
+    if (!pool.blocks.empty()) {
+      BufferBlock* b = pool.blocks.back();
+      pool.blocks.pop_back();
+      return b;
+    }
+  }
+  return new BufferBlock;
+}
+
+void buffer_block_free(BufferBlock* block) {
+  ThreadBlockCache& cache = t_blocks;
+  if (cache.count < kThreadCachedBlocks) {
+    block->next = cache.head;
+    cache.head = block;
+    cache.count++;
+    return;
+  }
+
+  GlobalBlockPool& pool = global_pool();
+  {
+    SpinLock::ScopedLock guard(pool.lock);
+    if (static_cast<int>(pool.blocks.size()) < kGlobalCachedBlocks) {
+      pool.blocks.push_back(block);
+      return;
+    }
+  }
+  delete block;
+}
+
+}  // namespace ming
@@ -1,7 +1,230 @@
 #ifndef MING_BUFFER_H_
 #define MING_BUFFER_H_
+
+#include <stddef.h>
+#include <string.h>
+#include <string>
+
+#if defined(_MSC_VER)
+struct iovec {
+  void* iov_base;
+  size_t iov_len;
+};
+#else
+#include <sys/uio.h>
+#endif
+
+#include "ming/likely.h"
+#include "ming/noncopyable.h"
+
 namespace ming {
 
-} // namespace ming
+//-----------------------------------------------------------------------------
+// Fixed size blocks recycled through a per-thread free list (the overflow
+// goes to a small global free list), so a ChainBuffer that spills does not
+// hit malloc in the steady state.
+//-----------------------------------------------------------------------------
+const int kBufferBlockSize = 4096 - 2 * sizeof(void*);
+
+struct BufferBlock {
+  BufferBlock* next;
+  int size;  // bytes used in data
+  char data[kBufferBlockSize];
+};
+
+BufferBlock* buffer_block_alloc();
+void buffer_block_free(BufferBlock* block);
+
+//-----------------------------------------------------------------------------
+// ChainBuffer keeps the first INLINE_SIZE bytes in an inline array and
+// spills the rest into a chain of pooled BufferBlocks. Data is never moved
+// once written; export it with to_iovec() for writev()/scatter-gather IO.
+// data()/c_str() have to linearize a chained buffer into a heap copy, so
+// use them for short messages only.
+//
+// It has the same interface as FixedBuffer and can be used as the buffer
+// of a LogStream. overflow() is set when the total size would exceed
+// max_size or a single reserve() is larger than a block.
+//-----------------------------------------------------------------------------
+const int kChainBufferMaxSize = 256 * 1024;
+
+template <int INLINE_SIZE>
+class ChainBuffer : private noncopyable {
+ public:
+  explicit ChainBuffer(int max_size = kChainBufferMaxSize)
+      : overflow_(false),
+        max_size_(max_size),
+        sealed_(0),
+        inline_len_(0),
+        cur_(inline_),
+        begin_(inline_),
+        end_(inline_ + INLINE_SIZE),
+        head_(0),
+        tail_(0) {}
+  ~ChainBuffer() { release(); }
+
+  void append(const char* buf, int len) {
+    if (LIKELY(avail() > len)) {
+      memcpy(cur_, buf, len);
+      cur_ += len;
+      return;
+    }
+    if (len > max_size_ - length()) {
+      overflow_ = true;
+      return;
+    }
+    while (len > 0) {
+      // keep one byte of inline_ for the '\0' of c_str()
+      int n = static_cast<int>(end_ - cur_) - (chained() ? 0 : 1);
+      if (n <= 0) {
+        if (!spill()) {
+          return;
+        }
+        continue;
+      }
+      if (n > len) {
+        n = len;
+      }
+      memcpy(cur_, buf, n);
+      cur_ += n;
+      buf += n;
+      len -= n;
+    }
+  }
+
+  // return len contiguous bytes, call commit() with the bytes used
+  char* reserve(int len) {
+    if (LIKELY(avail() > len)) {
+      return cur_;
+    }
+    if (len >= kBufferBlockSize || len > max_size_ - length()) {
+      overflow_ = true;
+      return 0;
+    }
+    // the tail of the current region is left unused
+    if (!spill()) {
+      return 0;
+    }
+    return cur_;
+  }
+  void commit(int len) { cur_ += len; }
+
+  int length() const { return sealed_ + static_cast<int>(cur_ - begin_); }
+  int avail() const { return static_cast<int>(end_ - cur_); }
+  bool chained() const { return head_ != 0; }
+  bool overflow() { return overflow_; }
+
+  const char* data() const {
+    if (!chained()) {
+      return inline_;
+    }
+    linearize();
+    return linear_.data();
+  }
+  const char* c_str() const {
+    if (!chained()) {
+      *cur_ = '\0';  // avail() > len always leaves room for the '\0'
+      return inline_;
+    }
+    linearize();
+    return linear_.c_str();
+  }
+
+  // number of iovec entries needed by to_iovec()
+  int iovec_count() const {
+    int n = (chained() ? inline_len_ : length()) > 0 ? 1 : 0;
+    for (BufferBlock* b = head_; b != 0; b = b->next) {
+      n++;
+    }
+    return n;
+  }
+
+  // fill up to max entries, return the number of entries filled
+  int to_iovec(struct iovec* iov, int max) const {
+    int n = 0;
+    int len = chained() ? inline_len_ : length();
+    if (len > 0 && n < max) {
+      iov[n].iov_base = const_cast<char*>(inline_);
+      iov[n].iov_len = len;
+      n++;
+    }
+    for (BufferBlock* b = head_; b != 0 && n < max; b = b->next) {
+      iov[n].iov_base = b->data;
+      iov[n].iov_len = (b == tail_) ? static_cast<int>(cur_ - b->data) : b->size;
+      n++;
+    }
+    return n;
+  }
+
+  void reset() {
+    release();
+    overflow_ = false;
+    sealed_ = 0;
+    inline_len_ = 0;
+    cur_ = begin_ = inline_;
+    end_ = inline_ + INLINE_SIZE;
+    linear_.clear();
+  }
+
+ private:
+  // seal the current region and continue in a new block
+  bool spill() {
+    BufferBlock* b = buffer_block_alloc();
+    if (b == 0) {
+      overflow_ = true;
+      return false;
+    }
+    int used = static_cast<int>(cur_ - begin_);
+    if (tail_ == 0) {
+      inline_len_ = used;
+      head_ = b;
+    } else {
+      tail_->size = used;
+      tail_->next = b;
+    }
+    b->next = 0;
+    b->size = 0;
+    tail_ = b;
+    sealed_ += used;
+    cur_ = begin_ = b->data;
+    end_ = b->data + kBufferBlockSize;
+    return true;
+  }
+
+  void release() {
+    BufferBlock* b = head_;
+    while (b != 0) {
+      BufferBlock* next = b->next;
+      buffer_block_free(b);
+      b = next;
+    }
+    head_ = tail_ = 0;
+  }
+
+  void linearize() const {
+    linear_.clear();
+    linear_.reserve(length());
+    linear_.append(inline_, inline_len_);
+    for (BufferBlock* b = head_; b != 0; b = b->next) {
+      linear_.append(b->data,
+                     (b == tail_) ? static_cast<int>(cur_ - b->data) : b->size);
+    }
+  }
+
+ private:
+  bool overflow_;
+  int max_size_;
+  int sealed_;       // bytes in the regions before the current one
+  int inline_len_;   // bytes used in inline_ once chained
+  char* cur_;
+  char* begin_;      // current region
+  char* end_;
+  BufferBlock* head_;
+  BufferBlock* tail_;
+  mutable std::string linear_;
+  char inline_[INLINE_SIZE];
+};
+
+}  // namespace ming
 
 #endif  // MING_BUFFER_H_
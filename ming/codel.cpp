@@ -9,6 +9,7 @@
  */
 
 #include <ming/codel.h>
+#include <ming/atomic.h>
 
 #include <algorithm>
 #include <math.h>
@@ -33,30 +34,27 @@ bool Codel::overloaded(std::chrono::nanoseconds delay) {
 
   // Avoid another thread updating the value at the same time we are using it
   // to calculate the overloaded state
-  auto minDelay = codelMinDelay_;
+  auto minDelay = nanoseconds(codelMinDelay_.load(std::memory_order_relaxed));
 
-  if (now  > codelIntervalTime_ &&
+  if (now  > codelIntervalTime_.load(std::memory_order_relaxed) &&
       // testing before exchanging is more cacheline-friendly
       (!codelResetDelay_.load(std::memory_order_acquire)
-       && !codelResetDelay_.exchange(true))) {
-    codelIntervalTime_ = now + getInterval();
-
-    if (minDelay > getTargetDelay()) {
-      overloaded_ = true;
-    } else {
-      overloaded_ = false;
-    }
+       && !codelResetDelay_.exchange(true, std::memory_order_acq_rel))) {
+    codelIntervalTime_.store(now + getInterval(), std::memory_order_relaxed);
+
+    overloaded_.store(minDelay > getTargetDelay(), std::memory_order_relaxed);
   }
   // Care must be taken that only a single thread resets codelMinDelay_,
   // and that it happens after the interval reset above
   if (codelResetDelay_.load(std::memory_order_acquire) &&
-      codelResetDelay_.exchange(false)) {
-    codelMinDelay_ = delay;
+      codelResetDelay_.exchange(false, std::memory_order_acq_rel)) {
+    codelMinDelay_.store(delay.count(), std::memory_order_relaxed);
     // More than one request must come in during an interval before codel
     // starts dropping requests
     return false;
-  } else if(delay < codelMinDelay_) {
-    codelMinDelay_ = delay;
+  } else {
+    // a CAS only when the delay is the new minimum
+    atomic_fetch_min<int64_t>(&codelMinDelay_, delay.count());
   }
 
   // Here is where we apply different logic than codel proper. Instead of
@@ -64,7 +62,8 @@ bool Codel::overloaded(std::chrono::nanoseconds delay) {
   // queueing delay > 2*target_delay while in the overloaded regime. This
   // empirically works better for our services than the codel approach of
   // increasingly often dropping packets.
-  if (overloaded_ && delay > getSloughTimeout()) {
+  if (overloaded_.load(std::memory_order_relaxed) &&
+      delay > getSloughTimeout()) {
     ret = true;
   }
 
@@ -79,7 +78,7 @@ int Codel::getLoad() {
 }
 
 nanoseconds Codel::getMinDelay() {
-  return codelMinDelay_;
+  return nanoseconds(codelMinDelay_.load(std::memory_order_relaxed));
 }
 
 milliseconds Codel::getInterval() {
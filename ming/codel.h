@@ -75,14 +75,17 @@ class Codel {
   std::chrono::milliseconds getSloughTimeout();
 
  private:
-  std::chrono::nanoseconds codelMinDelay_;
-  std::chrono::time_point<std::chrono::steady_clock> codelIntervalTime_;
+  // in nanoseconds. All the state is read and written with relaxed atomics,
+  // overloaded() is on the hot path of every request
+  std::atomic<int64_t> codelMinDelay_;
+  std::atomic<std::chrono::time_point<std::chrono::steady_clock> >
+      codelIntervalTime_;
 
   // flag to make overloaded() thread-safe, since we only want
   // to reset the delay once per time period
   std::atomic<bool> codelResetDelay_;
 
-  bool overloaded_;
+  std::atomic<bool> overloaded_;
 
   // Facebook default values( codel_interval_ = 100, codel_target_delay_ = 5)
   int32_t codel_interval_; // Codel default interval time in ms.
@@ -76,12 +76,16 @@ inline int32_t jump_consistent_hash(uint64_t key, int32_t num_buckets) {
 
 // A larger virtualNodeReplicaFactor(100-200) provides a very even distribution
 // of keys on each node,, but use more memory and the searching is slower.
+//
+// The ring is not thread-safe. For a ring read by many threads and updated
+// rarely, publish it through a RcuPtr (ming/epoch.h): the readers call
+// GetNode() inside an EpochGuard, the writer copies the current ring, adds
+// or removes nodes on the copy and Update()s the pointer.
 template <class T>
-std::string NodeToString(const T &t) {
+inline std::string NodeToString(const T &t) {
   return std::to_string(t);
 }
-template <>
-std::string NodeToString(const std::string &str) {
+inline std::string NodeToString(const std::string &str) {
   return str;
 }
 template <typename NodeType> //  NodeType should implement != < and NodeToString
@@ -90,6 +94,15 @@ class ConsistentHashRing {
   ConsistentHashRing() : virtualNodeReplicaFactor_(256) {}
   ConsistentHashRing(uint32_t virtualNodeReplicaFactor)
       : virtualNodeReplicaFactor_(virtualNodeReplicaFactor) {}
+  ConsistentHashRing(const ConsistentHashRing &other) { CopyFrom(other); }
+  ConsistentHashRing &operator=(const ConsistentHashRing &other) {
+    if (this != &other) {
+      Clear();
+      CopyFrom(other);
+    }
+    return *this;
+  }
+  ~ConsistentHashRing() { Clear(); }
   void AddNode(const NodeType node) {
     typename std::vector<NodeType *>::iterator it;
     it = std::lower_bound(nodes_.begin(), nodes_.end(), &node, NodePointerLess);
@@ -116,7 +129,7 @@ class ConsistentHashRing {
       std::string vname;
       for (unsigned int i = 0; i < virtualNodeReplicaFactor_; i++) {
         VirtualNode vnode;
-        vname = node;
+        vname = NodeToString(node);
         vname += std::to_string(i);
         murmurhash3_x86_32(vname.c_str(), vname.length(), 0, &vnode.hash);
         typename std::vector<VirtualNode>::iterator low;
@@ -124,9 +137,10 @@ class ConsistentHashRing {
                                VirtualNodeLess);
         while (low != ring_.end() && low->hash == vnode.hash) {
           if (*(low->node) == node) {
-            ring_.erase(low);
+            low = ring_.erase(low);
+          } else {
+            ++low;
           }
-          ++low;
         }
       }
       NodeType *release_node = *it;
@@ -148,10 +162,33 @@ class ConsistentHashRing {
   }
   const std::vector<NodeType *> &GetNodeList() { return nodes_; }
   bool IsNodeActive(const NodeType node) {
-    return std::binary_search(nodes_.begin(), nodes_.end(), node);
+    return std::binary_search(nodes_.begin(), nodes_.end(), &node,
+                              NodePointerLess);
   }
 
  private:
+  // a deep copy, the virtual nodes point to the copied nodes
+  void CopyFrom(const ConsistentHashRing &other) {
+    virtualNodeReplicaFactor_ = other.virtualNodeReplicaFactor_;
+    nodes_.reserve(other.nodes_.size());
+    for (size_t i = 0; i < other.nodes_.size(); i++) {
+      nodes_.push_back(new NodeType(*other.nodes_[i]));
+    }
+    ring_ = other.ring_;
+    for (size_t i = 0; i < ring_.size(); i++) {
+      typename std::vector<NodeType *>::const_iterator it =
+          std::lower_bound(other.nodes_.begin(), other.nodes_.end(),
+                           ring_[i].node, NodePointerLess);
+      ring_[i].node = nodes_[it - other.nodes_.begin()];
+    }
+  }
+  void Clear() {
+    for (size_t i = 0; i < nodes_.size(); i++) {
+      delete nodes_[i];
+    }
+    nodes_.clear();
+    ring_.clear();
+  }
   struct VirtualNode {
     uint32_t hash;
     NodeType *node;
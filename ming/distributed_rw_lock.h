@@ -0,0 +1,141 @@
+#ifndef MING_DISTRIBUTED_RW_LOCK_H_
+#define MING_DISTRIBUTED_RW_LOCK_H_
+
+#include <stdint.h>
+
+#include <atomic>
+
+#include "ming/likely.h"
+#include "ming/noncopyable.h"
+#include "ming/ring_buffer.h"  // ming::sched_yield
+
+namespace ming {
+
+// A "big reader" lock for read-mostly data.
+//
+// RWLock and RWSpinLock keep all the readers on one shared word, whose cache
+// line bounces between the cores that take the read lock. Here every thread
+// counts itself in one of kStripes reader slots, each on its own cache line,
+// so readers on different cores do not write to the same line. A writer sets
+// the writer flag, which turns new readers away, then waits for every slot
+// to drain. Read locking is a fetch_add and a load in the common case; write
+// locking costs a scan of all the slots, so use it where writes are rare.
+//
+// Threads get their slot round-robin on the first use, it does not change
+// afterwards, so ReadUnlock() must be called by the thread that called
+// ReadLock(). Not recursive; writers are preferred over new readers.
+template <int kStripes = 64>
+class DistributedRWLockT : private noncopyable {
+ public:
+  DistributedRWLockT() : writer_(false) {
+    for (int i = 0; i < kStripes; i++) {
+      slots_[i].readers.store(0, std::memory_order_relaxed);
+    }
+  }
+
+  void ReadLock() {
+    std::atomic<int32_t>& readers = slots_[ThreadStripe()].readers;
+    for (;;) {
+      // seq_cst pairs with the writer: either the writer sees this reader in
+      // its scan, or this reader sees the writer flag
+      readers.fetch_add(1, std::memory_order_seq_cst);
+      if (LIKELY(!writer_.load(std::memory_order_seq_cst))) {
+        return;
+      }
+      readers.fetch_sub(1, std::memory_order_release);
+      for (int k = 0; writer_.load(std::memory_order_relaxed); k++) {
+        sched_yield(k);
+      }
+    }
+  }
+
+  bool TryReadLock() {
+    std::atomic<int32_t>& readers = slots_[ThreadStripe()].readers;
+    readers.fetch_add(1, std::memory_order_seq_cst);
+    if (LIKELY(!writer_.load(std::memory_order_seq_cst))) {
+      return true;
+    }
+    readers.fetch_sub(1, std::memory_order_release);
+    return false;
+  }
+
+  void ReadUnlock() {
+    slots_[ThreadStripe()].readers.fetch_sub(1, std::memory_order_release);
+  }
+
+  void WriteLock() {
+    for (int k = 0; writer_.exchange(true, std::memory_order_seq_cst); k++) {
+      sched_yield(k);
+    }
+    for (int i = 0; i < kStripes; i++) {
+      for (int k = 0; slots_[i].readers.load(std::memory_order_acquire) != 0;
+           k++) {
+        sched_yield(k);
+      }
+    }
+  }
+
+  bool TryWriteLock() {
+    if (writer_.exchange(true, std::memory_order_seq_cst)) {
+      return false;
+    }
+    for (int i = 0; i < kStripes; i++) {
+      if (slots_[i].readers.load(std::memory_order_acquire) != 0) {
+        writer_.store(false, std::memory_order_release);
+        return false;
+      }
+    }
+    return true;
+  }
+
+  void WriteUnlock() { writer_.store(false, std::memory_order_release); }
+
+  class ReadScopedLock {
+   public:
+    explicit ReadScopedLock(DistributedRWLockT& lock) : lock_(lock) {
+      lock_.ReadLock();
+    }
+    ~ReadScopedLock() { lock_.ReadUnlock(); }
+
+   private:
+    DistributedRWLockT& lock_;
+  };
+
+  class WriteScopedLock {
+   public:
+    explicit WriteScopedLock(DistributedRWLockT& lock) : lock_(lock) {
+      lock_.WriteLock();
+    }
+    ~WriteScopedLock() { lock_.WriteUnlock(); }
+
+   private:
+    DistributedRWLockT& lock_;
+  };
+
+ private:
+  // a cache line each, without alignas so that new works before c++17
+  struct Slot {
+    std::atomic<int32_t> readers;
+    char pad[64 - sizeof(std::atomic<int32_t>)];
+  };
+
+  static int ThreadStripe() {
+    static std::atomic<uint32_t> next_stripe(0);
+    static thread_local int stripe = -1;
+    if (UNLIKELY(stripe < 0)) {
+      stripe = static_cast<int>(
+          next_stripe.fetch_add(1, std::memory_order_relaxed) % kStripes);
+    }
+    return stripe;
+  }
+
+  Slot slots_[kStripes];
+  std::atomic<bool> writer_;
+  char pad_[64 - sizeof(std::atomic<bool>)];
+};
+
+typedef DistributedRWLockT<> DistributedRWLock;
+
+}  // namespace ming
+
+#endif  // MING_DISTRIBUTED_RW_LOCK_H_
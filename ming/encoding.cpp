@@ -12,6 +12,21 @@ typedef unsigned int uint32_t;
 #endif
 
 #include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#elif defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64)
+#define MING_ASCII_SSE2 1
+#endif
 
 namespace ming {
 namespace encoding {
@@ -202,7 +217,7 @@ static const unsigned char hexEncodeMap2[256] = {
     '0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'A', 'B', 'C', 'D', 'E',
     'F'};
 
-int hex_encode(char *dest, const char *str, int len) {
+static int hex_encode_generic(char *dest, const char *str, int len) {
 #ifdef WORDS_BIGENDIAN
   unsigned char *src_ = (unsigned char *)src;
   for (int i = 0; i < len; i++) {
@@ -259,7 +274,9 @@ int hex_encode(char *dest, const char *str, int len) {
 #endif
 }
 
-int hex_decode(char *dest, const char *str, int len) {
+// len must be even
+static int hex_decode_generic(char *dest, const char *str, int len,
+                              int *error_offset) {
   int i;
 
   uint32_t val1, val2;
@@ -268,10 +285,6 @@ int hex_decode(char *dest, const char *str, int len) {
 
   const int buckets = len >> 2;     // i.e. len / 4
   const int leftover = len & 0x03;  // i.e. len % 4
-  if (leftover & 0x01) {            // i.e if leftover is odd,
-    // leftover==1 || leftover == 3
-    return -1;
-  }
 
   // read 4 bytes, output 2.
   // Note on PPC G4, GCC 4.0, it's quite a bit faster to
@@ -285,20 +298,271 @@ int hex_decode(char *dest, const char *str, int len) {
     t3 = *s++;
     val1 = hexDecodeMap1[t0] | hexDecodeMap2[t1];
     val2 = hexDecodeMap1[t2] | hexDecodeMap2[t3];
-    if (val1 > 0xff || val2 > 0xff) return -1;
+    if (val1 > 0xff || val2 > 0xff) {
+      s -= 4;
+      break;
+    }
     *p++ = (uint8_t)val1;
     *p++ = (uint8_t)val2;
   }
 
-  if (leftover == 2) {
-    val1 = hexDecodeMap1[s[0]] | hexDecodeMap2[s[1]];
-    if (val1 > 0xff) return -1;
-    *p++ = (uint8_t)val1;
+  if (i < buckets || leftover == 2) {
+    // the rest, or the bucket with a bad digit, a pair at a time
+    for (; s < (uint8_t *)str + len; s += 2) {
+      if (hexDecodeMap1[s[0]] > 0xff || hexDecodeMap2[s[1]] > 0xff) {
+        *error_offset =
+            (int)(s - (uint8_t *)str) + (hexDecodeMap1[s[0]] > 0xff ? 0 : 1);
+        return -1;
+      }
+      *p++ = (uint8_t)(hexDecodeMap1[s[0]] | hexDecodeMap2[s[1]]);
+    }
   }
 
   return (int)(p - (uint8_t *)dest);
 }
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define MING_HEX_SIMD 1
+
+// The SIMD kernels convert whole blocks and return the number of input bytes
+// done; the generic code handles the tail. Encoding looks the nibbles up in
+// "0123456789ABCDEF" with pshufb. Decoding maps '0'-'9' and 'a'-'f' / 'A'-'F'
+// (after or-ing 0x20) to 0-15, flags any other byte, and packs the nibble
+// pairs with pmaddubsw (hi * 16 + lo). A block with a bad digit is left to
+// the generic code, which finds its offset.
+
+__attribute__((target("ssse3"))) static int hex_encode_ssse3(
+    char *dest, const char *str, int len) {
+  const __m128i lut = _mm_setr_epi8('0', '1', '2', '3', '4', '5', '6', '7',
+                                    '8', '9', 'A', 'B', 'C', 'D', 'E', 'F');
+  const __m128i mask = _mm_set1_epi8(0x0f);
+  int i = 0;
+  for (; i + 16 <= len; i += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(str + i));
+    __m128i hi = _mm_shuffle_epi8(lut, _mm_and_si128(_mm_srli_epi16(v, 4), mask));
+    __m128i lo = _mm_shuffle_epi8(lut, _mm_and_si128(v, mask));
+    _mm_storeu_si128((__m128i *)(dest + i * 2), _mm_unpacklo_epi8(hi, lo));
+    _mm_storeu_si128((__m128i *)(dest + i * 2 + 16), _mm_unpackhi_epi8(hi, lo));
+  }
+  return i;
+}
+
+__attribute__((target("avx2"))) static int hex_encode_avx2(char *dest,
+                                                           const char *str,
+                                                           int len) {
+  const __m256i lut = _mm256_setr_epi8(
+      '0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'A', 'B', 'C', 'D', 'E',
+      'F', '0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'A', 'B', 'C', 'D',
+      'E', 'F');
+  const __m256i mask = _mm256_set1_epi8(0x0f);
+  int i = 0;
+  for (; i + 32 <= len; i += 32) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)(str + i));
+    __m256i hi = _mm256_shuffle_epi8(
+        lut, _mm256_and_si256(_mm256_srli_epi16(v, 4), mask));
+    __m256i lo = _mm256_shuffle_epi8(lut, _mm256_and_si256(v, mask));
+    // the unpacks work within the 128-bit lanes
+    __m256i a = _mm256_unpacklo_epi8(hi, lo);
+    __m256i b = _mm256_unpackhi_epi8(hi, lo);
+    _mm256_storeu_si256((__m256i *)(dest + i * 2),
+                        _mm256_permute2x128_si256(a, b, 0x20));
+    _mm256_storeu_si256((__m256i *)(dest + i * 2 + 32),
+                        _mm256_permute2x128_si256(a, b, 0x31));
+  }
+  _mm256_zeroupper();
+  return i + hex_encode_ssse3(dest + i * 2, str + i, len - i);
+}
+
+// 16 hex digits to their values, *bad gets a bit per invalid digit
+__attribute__((target("ssse3"))) static inline __m128i hex_digits_ssse3(
+    __m128i c, int *bad) {
+  const __m128i digit = _mm_sub_epi8(c, _mm_set1_epi8('0'));
+  const __m128i alpha =
+      _mm_sub_epi8(_mm_or_si128(c, _mm_set1_epi8(0x20)), _mm_set1_epi8('a'));
+  // unsigned x <= n is min(x, n) == x
+  const __m128i is_digit =
+      _mm_cmpeq_epi8(_mm_min_epu8(digit, _mm_set1_epi8(9)), digit);
+  const __m128i is_alpha =
+      _mm_cmpeq_epi8(_mm_min_epu8(alpha, _mm_set1_epi8(5)), alpha);
+  *bad = ~_mm_movemask_epi8(_mm_or_si128(is_digit, is_alpha)) & 0xffff;
+  return _mm_or_si128(
+      _mm_and_si128(is_digit, digit),
+      _mm_and_si128(is_alpha, _mm_add_epi8(alpha, _mm_set1_epi8(10))));
+}
+
+__attribute__((target("ssse3"))) static int hex_decode_ssse3(char *dest,
+                                                             const char *str,
+                                                             int len) {
+  const __m128i weights = _mm_set1_epi16(0x0110);  // bytes 16, 1
+  int i = 0;
+  for (; i + 32 <= len; i += 32) {
+    int bad0, bad1;
+    __m128i v0 = hex_digits_ssse3(
+        _mm_loadu_si128((const __m128i *)(str + i)), &bad0);
+    __m128i v1 = hex_digits_ssse3(
+        _mm_loadu_si128((const __m128i *)(str + i + 16)), &bad1);
+    if ((bad0 | bad1) != 0) {
+      break;
+    }
+    __m128i w0 = _mm_maddubs_epi16(v0, weights);
+    __m128i w1 = _mm_maddubs_epi16(v1, weights);
+    _mm_storeu_si128((__m128i *)(dest + i / 2), _mm_packus_epi16(w0, w1));
+  }
+  return i;
+}
+
+__attribute__((target("avx2"))) static inline __m256i hex_digits_avx2(
+    __m256i c, unsigned int *bad) {
+  const __m256i digit = _mm256_sub_epi8(c, _mm256_set1_epi8('0'));
+  const __m256i alpha = _mm256_sub_epi8(
+      _mm256_or_si256(c, _mm256_set1_epi8(0x20)), _mm256_set1_epi8('a'));
+  const __m256i is_digit =
+      _mm256_cmpeq_epi8(_mm256_min_epu8(digit, _mm256_set1_epi8(9)), digit);
+  const __m256i is_alpha =
+      _mm256_cmpeq_epi8(_mm256_min_epu8(alpha, _mm256_set1_epi8(5)), alpha);
+  *bad = ~(unsigned int)_mm256_movemask_epi8(
+      _mm256_or_si256(is_digit, is_alpha));
+  return _mm256_or_si256(
+      _mm256_and_si256(is_digit, digit),
+      _mm256_and_si256(is_alpha, _mm256_add_epi8(alpha, _mm256_set1_epi8(10))));
+}
+
+__attribute__((target("avx2"))) static int hex_decode_avx2(char *dest,
+                                                           const char *str,
+                                                           int len) {
+  const __m256i weights = _mm256_set1_epi16(0x0110);
+  int i = 0;
+  for (; i + 64 <= len; i += 64) {
+    unsigned int bad0, bad1;
+    __m256i v0 = hex_digits_avx2(
+        _mm256_loadu_si256((const __m256i *)(str + i)), &bad0);
+    __m256i v1 = hex_digits_avx2(
+        _mm256_loadu_si256((const __m256i *)(str + i + 32)), &bad1);
+    if ((bad0 | bad1) != 0) {
+      break;
+    }
+    __m256i packed = _mm256_packus_epi16(_mm256_maddubs_epi16(v0, weights),
+                                         _mm256_maddubs_epi16(v1, weights));
+    // packus interleaves the 128-bit lanes of its operands
+    _mm256_storeu_si256((__m256i *)(dest + i / 2),
+                        _mm256_permute4x64_epi64(packed, 0xd8));
+  }
+  // the SSSE3 code is not VEX encoded, it would pay for the dirty upper
+  // halves of the ymm registers on every call
+  _mm256_zeroupper();
+  return i + hex_decode_ssse3(dest + i / 2, str + i, len - i);
+}
+
+typedef int (*hex_kernel)(char *dest, const char *str, int len);
+
+struct HexKernels {
+  hex_kernel encode;
+  hex_kernel decode;
+};
+
+static HexKernels select_hex_kernels() {
+  HexKernels kernels = {NULL, NULL};
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    kernels.encode = hex_encode_avx2;
+    kernels.decode = hex_decode_avx2;
+  } else if (__builtin_cpu_supports("ssse3")) {
+    kernels.encode = hex_encode_ssse3;
+    kernels.decode = hex_decode_ssse3;
+  }
+  return kernels;
+}
+
+static const HexKernels &hex_kernels() {
+  static const HexKernels kernels = select_hex_kernels();
+  return kernels;
+}
+#endif  // SIMD
+
+int hex_encode(char *dest, const char *str, int len) {
+  int done = 0;
+#ifdef MING_HEX_SIMD
+  if (hex_kernels().encode != NULL && len >= 16) {
+    done = hex_kernels().encode(dest, str, len);
+  }
+#endif
+  hex_encode_generic(dest + done * 2, str + done, len - done);
+  return len * 2;
+}
+
+int hex_decode(char *dest, const char *str, int len, int *error_offset) {
+  int done = 0;
+  *error_offset = -1;
+#ifdef MING_HEX_SIMD
+  if (hex_kernels().decode != NULL && len >= 32) {
+    done = hex_kernels().decode(dest, str, len & ~1);
+  }
+#endif
+  int n = hex_decode_generic(dest + done / 2, str + done, (len & ~1) - done,
+                             error_offset);
+  if (n < 0) {
+    *error_offset += done;
+    return -1;
+  }
+  if (len & 0x01) {  // a digit without its pair
+    *error_offset = len;
+    return -1;
+  }
+  return done / 2 + n;
+}
+
+int hex_decode(char *dest, const char *str, int len) {
+  int error_offset;
+  return hex_decode(dest, str, len, &error_offset);
+}
+
+int HexDecoder::Update(char *dest, const char *str, int len) {
+  if (error_offset_ >= 0) {
+    return -1;
+  }
+  char *p = dest;
+  if (pending_ >= 0 && len > 0) {
+    char pair[2] = {(char)pending_, str[0]};
+    int error_offset;
+    if (hex_decode(p, pair, 2, &error_offset) < 0) {
+      error_offset_ = offset_ - 1 + error_offset;
+      return -1;
+    }
+    p++;
+    str++;
+    len--;
+    offset_++;
+    pending_ = -1;
+  }
+  int even = len & ~1;
+  int error_offset;
+  int n = hex_decode(p, str, even, &error_offset);
+  if (n < 0) {
+    error_offset_ = offset_ + error_offset;
+    return -1;
+  }
+  p += n;
+  offset_ += even;
+  if (len & 0x01) {
+    pending_ = (unsigned char)str[even];
+    offset_++;
+  }
+  return (int)(p - dest);
+}
+
+bool HexDecoder::Finish() {
+  if (error_offset_ < 0 && pending_ >= 0) {
+    error_offset_ = offset_;  // where the missing digit would be
+  }
+  return error_offset_ < 0;
+}
+
+void HexDecoder::Reset() {
+  pending_ = -1;
+  offset_ = 0;
+  error_offset_ = -1;
+}
+
 // for c string end with '\0'
 int latin1_to_utf8(char *dest, char const *src) {
   if (src == NULL || dest == NULL) return -1;
@@ -712,6 +976,77 @@ static const int gsm_to_unicode[128] = {
     0xF1,  0xFC,  0xE0 /* 120 - 127 */
 };
 
+// The UTF-8 of every GSM character, so that the conversion is a table lookup
+// and one fixed size copy per character.
+struct GsmUtf8 {
+  unsigned char len;  // 0 if not in the extension table
+  unsigned char bytes[4];
+};
+
+struct GsmUtf8Tables {
+  GsmUtf8 base[128];
+  GsmUtf8 escaped[128];  // after the escape character 27
+};
+
+static void unicode_to_utf8_entry(int c, GsmUtf8 *entry) {
+  memset(entry, 0, sizeof(*entry));
+  unsigned char *p = entry->bytes;
+  if (c < 0x80) {
+    *p++ = c;
+  } else if (c < 0x800) {
+    *p++ = (c >> 6) | 0xC0;
+    *p++ = (c & 0x3F) | 0x80;
+  } else {
+    /* There are no 4 bytes encoded characters in GSM charset */
+    *p++ = (c >> 12) | 0xE0;
+    *p++ = ((c >> 6) & 0x3F) | 0x80;
+    *p++ = (c & 0x3F) | 0x80;
+  }
+  entry->len = p - entry->bytes;
+}
+
+static GsmUtf8Tables make_gsm_utf8_tables() {
+  GsmUtf8Tables tables;
+  memset(&tables, 0, sizeof(tables));
+  for (int c = 0; c < 128; c++) {
+    unicode_to_utf8_entry(gsm_to_unicode[c], &tables.base[c]);
+  }
+  for (int i = 0; gsm_esctouni[i].gsmesc >= 0; i++) {
+    unicode_to_utf8_entry(gsm_esctouni[i].unichar,
+                          &tables.escaped[gsm_esctouni[i].gsmesc]);
+  }
+  return tables;
+}
+
+static const GsmUtf8Tables &gsm_utf8_tables() {
+  static const GsmUtf8Tables tables = make_gsm_utf8_tables();
+  return tables;
+}
+
+#ifdef MING_ASCII_SSE2
+// The septets that are the same character in ASCII, ' ' to 'z' but for '$',
+// '@' and '[' to '`', are most of an SMS. Return how many of the 16 septets
+// in v are such a run, 16 if all of them.
+static inline int gsm_ascii_run(__m128i v) {
+  // signed compares, a byte above 127 is below ' '
+  __m128i other = _mm_or_si128(_mm_cmplt_epi8(v, _mm_set1_epi8(0x20)),
+                               _mm_cmpgt_epi8(v, _mm_set1_epi8(0x7A)));
+  other = _mm_or_si128(other, _mm_cmpeq_epi8(v, _mm_set1_epi8(0x24)));
+  other = _mm_or_si128(other, _mm_cmpeq_epi8(v, _mm_set1_epi8(0x40)));
+  other = _mm_or_si128(
+      other, _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(0x5A)),
+                           _mm_cmplt_epi8(v, _mm_set1_epi8(0x61))));
+  unsigned int mask = _mm_movemask_epi8(other) | 0x10000;
+#if defined(_MSC_VER)
+  unsigned long index;
+  _BitScanForward(&index, mask);
+  return static_cast<int>(index);
+#else
+  return __builtin_ctz(mask);
+#endif
+}
+#endif
+
 /**
  * Convert octet string in GSM format to UTF-8.
  * Every GSM character can be represented with unicode, hence nothing will
@@ -727,64 +1062,55 @@ int charset_gsm_to_utf8(unsigned char *dest, int *dest_len,
   if (src == NULL || dest == NULL || dest_len == NULL || src_len == NULL)
     return -1;
 
+  const GsmUtf8Tables &tables = gsm_utf8_tables();
   out = dest;
   out_end = dest + *dest_len;
   len = *src_len;
 
-  for (pos = 0; pos < len; pos++) {
-    int c, i;
-
-    c = src[pos];
-    if (c > 127) {
-      // warning(0, "Could not convert GSM (0x%02x) to Unicode.", c);
-      continue;
+  pos = 0;
+  while (pos < len) {
+    long stop = len;
+#ifdef MING_ASCII_SSE2
+    // copy 16 septets and keep the ones before the first that is not ASCII
+    while (len - pos >= 16 && out_end - dest >= 16) {
+      __m128i v = _mm_loadu_si128((const __m128i *)(src + pos));
+      _mm_storeu_si128((__m128i *)dest, v);
+      int run = gsm_ascii_run(v);
+      dest += run;
+      pos += run;
+      if (run < 16) break;
     }
-
-    if (c == 27 && pos + 1 < len) {
-      c = src[++pos];
-      for (i = 0; gsm_esctouni[i].gsmesc >= 0; i++) {
-        if (gsm_esctouni[i].gsmesc == c) break;
-      }
-      if (gsm_esctouni[i].gsmesc == c) {
-        /* found a value for escaped char */
-        c = gsm_esctouni[i].unichar;
-      } else {
-        /* nothing found, look esc in our table */
-        c = gsm_to_unicode[27];
-        pos--;
+    // and the next 16 one at a time, text that is not ASCII stays in this
+    // loop
+    stop = std::min(len, pos + 16);
+#endif
+    for (; pos < stop; pos++) {
+      int c = src[pos];
+      if (c > 127) {
+        // warning(0, "Could not convert GSM (0x%02x) to Unicode.", c);
+        continue;
       }
-    } else if (c < 128) {
-      c = gsm_to_unicode[c];
-    }
 
-    /* unicode to utf-8 */
-    if (c < 128) {
-      /* 0-127 are ASCII chars that need no conversion */
-      if (dest >= out_end) {
-        break;
+      const GsmUtf8 *entry = &tables.base[c];
+      int escaped = 0;
+      if (c == 27 && pos + 1 < len && src[pos + 1] < 128 &&
+          tables.escaped[src[pos + 1]].len != 0) {
+        entry = &tables.escaped[src[pos + 1]];
+        escaped = 1;
       }
-      *dest++ = c;
-    } else {
-      /* test if it can be converterd into a two byte char */
-      if (c < 0x0800) {
-        if (dest + 1 >= out_end) {
-          break;
-        }
-        *dest++ = (unsigned char)((c >> 6) | 0xC0) & 0xFF; /* add 110xxxxx */
-        *dest++ = (unsigned char)(c & 0x3F) | 0x80;        /* add 10xxxxxx */
+      /* an escape without a valid character after it is a NRP */
+
+      if (out_end - dest >= 4) {
+        memcpy(dest, entry->bytes, 4);
+      } else if (out_end - dest >= entry->len) {
+        memcpy(dest, entry->bytes, entry->len);
       } else {
-        if (dest + 2 >= out_end) {
-          break;
-        }
-        /* else we encode with 3 bytes. This only happens in case of euro symbol
-         */
-        *dest++ = (unsigned char)((c >> 12) | 0xE0) & 0xFF; /* add 1110xxxx */
-        *dest++ =
-            (unsigned char)(((c >> 6) & 0x3F) | 0x80) & 0xFF; /* add 10xxxxxx */
-        *dest++ = (unsigned char)((c & 0x3F) | 0x80) & 0xFF;  /* add 10xxxxxx */
+        break;
       }
-      /* There are no 4 bytes encoded characters in GSM charset */
+      dest += entry->len;
+      pos += escaped;
     }
+    if (pos < stop) break;  // dest is full
   }
 
   *dest_len = dest - out;
@@ -793,6 +1119,45 @@ int charset_gsm_to_utf8(unsigned char *dest, int *dest_len,
   return *dest_len;
 }
 
+/**
+ * Map a unicode character to GSM 03.38, negative if it has to be escaped,
+ * NRP if it cannot be represented. Some Latin-1 characters are mapped to
+ * their look-alikes.
+ */
+static int unicode_to_gsm(unsigned int c) {
+  /* test Latin code page 1 char */
+  if (c <= 255) {
+    return latin1_to_gsm[c];
+  }
+  /* Its not a Latin1 char, test for allowed GSM chars */
+  switch (c) {
+    case 0x394:
+      return 0x10; /* GREEK CAPITAL LETTER DELTA */
+    case 0x3A6:
+      return 0x12; /* GREEK CAPITAL LETTER PHI */
+    case 0x393:
+      return 0x13; /* GREEK CAPITAL LETTER GAMMA */
+    case 0x39B:
+      return 0x14; /* GREEK CAPITAL LETTER LAMBDA */
+    case 0x3A9:
+      return 0x15; /* GREEK CAPITAL LETTER OMEGA */
+    case 0x3A0:
+      return 0x16; /* GREEK CAPITAL LETTER PI */
+    case 0x3A8:
+      return 0x17; /* GREEK CAPITAL LETTER PSI */
+    case 0x3A3:
+      return 0x18; /* GREEK CAPITAL LETTER SIGMA */
+    case 0x398:
+      return 0x19; /* GREEK CAPITAL LETTER THETA */
+    case 0x39E:
+      return 0x1A; /* GREEK CAPITAL LETTER XI */
+    case 0x20AC:
+      return -'e'; /* EURO SIGN, escaped */
+    default:
+      return NRP; /* character cannot be represented in GSM 03.38 */
+  }
+}
+
 /**
  * Convert octet string in UTF-8 format to GSM 03.38.
  * Because not all UTF-8 charater can be converted to GSM 03.38 non
@@ -852,60 +1217,14 @@ int charset_utf8_to_gsm(unsigned char *dest, int *dest_len,
       }
     }
 
-    /* test Latin code page 1 char */
-    if (val1 <= 255) {
-      val1 = latin1_to_gsm[val1];
-      /* needs to be escaped ? */
-      if (val1 < 0) {
-        if (dest >= out_end) {
-          break;
-        }
-        *dest++ = (unsigned char)27;
-        val1 *= -1;
-      }
-    } else {
-      /* Its not a Latin1 char, test for allowed GSM chars */
-      switch (val1) {
-        case 0x394:
-          val1 = 0x10; /* GREEK CAPITAL LETTER DELTA */
-          break;
-        case 0x3A6:
-          val1 = 0x12; /* GREEK CAPITAL LETTER PHI */
-          break;
-        case 0x393:
-          val1 = 0x13; /* GREEK CAPITAL LETTER GAMMA */
-          break;
-        case 0x39B:
-          val1 = 0x14; /* GREEK CAPITAL LETTER LAMBDA */
-          break;
-        case 0x3A9:
-          val1 = 0x15; /* GREEK CAPITAL LETTER OMEGA */
-          break;
-        case 0x3A0:
-          val1 = 0x16; /* GREEK CAPITAL LETTER PI */
-          break;
-        case 0x3A8:
-          val1 = 0x17; /* GREEK CAPITAL LETTER PSI */
-          break;
-        case 0x3A3:
-          val1 = 0x18; /* GREEK CAPITAL LETTER SIGMA */
-          break;
-        case 0x398:
-          val1 = 0x19; /* GREEK CAPITAL LETTER THETA */
-          break;
-        case 0x39E:
-          val1 = 0x1A; /* GREEK CAPITAL LETTER XI */
-          break;
-        case 0x20AC:
-          val1 = 'e'; /* EURO SIGN */
-          if (dest >= out_end) {
-            break;
-          }
-          *dest++ = (unsigned char)27;
-          break;
-        default:
-          val1 = NRP; /* character cannot be represented in GSM 03.38 */
+    val1 = unicode_to_gsm(val1);
+    /* needs to be escaped ? */
+    if (val1 < 0) {
+      if (dest + 1 >= out_end) {
+        break;
       }
+      *dest++ = (unsigned char)27;
+      val1 *= -1;
     }
 
     if (dest >= out_end) {
@@ -954,6 +1273,198 @@ const static int xmlLittleEndian = 1;
 // if (*ptr == 0x12) xmlLittleEndian = 0;
 // else if (*ptr == 0x34) xmlLittleEndian = 1;
 
+//-----------------------------------------------------------------------
+// ASCII fast paths and strict UTF-8 decoding
+//
+// Most of the text on the SMS and HTTP paths is ASCII. The helpers below
+// convert the ASCII runs 32 bytes per iteration with SSE2 and stop at the
+// first non-ASCII byte, where the per-character loops take over. The UTF-8
+// decoders reject what RFC 3629 forbids: stray continuation bytes, overlong
+// forms, surrogates and code points above U+10FFFF.
+//-----------------------------------------------------------------------
+
+enum { kAsciiBlock = 32 };
+
+// the length of the ASCII prefix of in[0, n)
+static size_t ascii_length(const unsigned char *in, size_t n) {
+  size_t i = 0;
+#ifdef MING_ASCII_SSE2
+  for (; i + kAsciiBlock <= n; i += kAsciiBlock) {
+    __m128i a = _mm_loadu_si128((const __m128i *)(in + i));
+    __m128i b = _mm_loadu_si128((const __m128i *)(in + i + 16));
+    if (_mm_movemask_epi8(_mm_or_si128(a, b)) != 0) {
+      break;
+    }
+  }
+#endif
+  while (i < n && in[i] < 0x80) {
+    i++;
+  }
+  return i;
+}
+
+// copy the ASCII prefix of in[0, n) to out, return its length
+static size_t ascii_copy(unsigned char *out, const unsigned char *in,
+                         size_t n) {
+  size_t i = 0;
+#ifdef MING_ASCII_SSE2
+  for (; i + kAsciiBlock <= n; i += kAsciiBlock) {
+    __m128i a = _mm_loadu_si128((const __m128i *)(in + i));
+    __m128i b = _mm_loadu_si128((const __m128i *)(in + i + 16));
+    if (_mm_movemask_epi8(_mm_or_si128(a, b)) != 0) {
+      break;
+    }
+    _mm_storeu_si128((__m128i *)(out + i), a);
+    _mm_storeu_si128((__m128i *)(out + i + 16), b);
+  }
+#endif
+  for (; i < n && in[i] < 0x80; i++) {
+    out[i] = in[i];
+  }
+  return i;
+}
+
+// widen the ASCII prefix of in[0, n) to UTF-16 code units, return its length
+static size_t ascii_to_utf16(unsigned char *out, const unsigned char *in,
+                             size_t n, bool big_endian) {
+  size_t i = 0;
+#ifdef MING_ASCII_SSE2
+  const __m128i zero = _mm_setzero_si128();
+  for (; i + kAsciiBlock <= n; i += kAsciiBlock) {
+    __m128i a = _mm_loadu_si128((const __m128i *)(in + i));
+    __m128i b = _mm_loadu_si128((const __m128i *)(in + i + 16));
+    if (_mm_movemask_epi8(_mm_or_si128(a, b)) != 0) {
+      break;
+    }
+    __m128i *o = (__m128i *)(out + i * 2);
+    if (big_endian) {
+      _mm_storeu_si128(o, _mm_unpacklo_epi8(zero, a));
+      _mm_storeu_si128(o + 1, _mm_unpackhi_epi8(zero, a));
+      _mm_storeu_si128(o + 2, _mm_unpacklo_epi8(zero, b));
+      _mm_storeu_si128(o + 3, _mm_unpackhi_epi8(zero, b));
+    } else {
+      _mm_storeu_si128(o, _mm_unpacklo_epi8(a, zero));
+      _mm_storeu_si128(o + 1, _mm_unpackhi_epi8(a, zero));
+      _mm_storeu_si128(o + 2, _mm_unpacklo_epi8(b, zero));
+      _mm_storeu_si128(o + 3, _mm_unpackhi_epi8(b, zero));
+    }
+  }
+#endif
+  for (; i < n && in[i] < 0x80; i++) {
+    out[i * 2 + (big_endian ? 0 : 1)] = 0;
+    out[i * 2 + (big_endian ? 1 : 0)] = in[i];
+  }
+  return i;
+}
+
+// narrow the prefix of the n UTF-16 code units at in that are below 0x80,
+// return its length
+static size_t utf16_ascii_to_utf8(unsigned char *out, const unsigned char *in,
+                                  size_t n, bool big_endian) {
+  size_t i = 0;
+#ifdef MING_ASCII_SSE2
+  // the bits that must be 0, as loaded in little endian
+  const __m128i mask = _mm_set1_epi16(big_endian ? 0x80ff : 0xff80);
+  for (; i + kAsciiBlock / 2 <= n; i += kAsciiBlock / 2) {
+    __m128i a = _mm_loadu_si128((const __m128i *)(in + i * 2));
+    __m128i b = _mm_loadu_si128((const __m128i *)(in + i * 2 + 16));
+    __m128i bad = _mm_and_si128(_mm_or_si128(a, b), mask);
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(bad, _mm_setzero_si128())) !=
+        0xffff) {
+      break;
+    }
+    if (big_endian) {
+      a = _mm_srli_epi16(a, 8);
+      b = _mm_srli_epi16(b, 8);
+    }
+    _mm_storeu_si128((__m128i *)(out + i), _mm_packus_epi16(a, b));
+  }
+#endif
+  for (; i < n; i++) {
+    unsigned char hi = in[i * 2 + (big_endian ? 0 : 1)];
+    unsigned char lo = in[i * 2 + (big_endian ? 1 : 0)];
+    if (hi != 0 || lo >= 0x80) {
+      break;
+    }
+    out[i] = lo;
+  }
+  return i;
+}
+
+// Decode the UTF-8 sequence at in into *c and return its length, 0 if
+// inend cuts it short, -1 if it is invalid.
+static int utf8_decode(const unsigned char *in, const unsigned char *inend,
+                       unsigned int *c) {
+  unsigned int d = in[0];
+  int trailing;
+  unsigned int min;
+  if (d < 0x80) {
+    *c = d;
+    return 1;
+  } else if (d < 0xC2) {
+    // a continuation byte, or the overlong 2 byte forms of ASCII
+    return -1;
+  } else if (d < 0xE0) {
+    d &= 0x1F;
+    trailing = 1;
+    min = 0x80;
+  } else if (d < 0xF0) {
+    d &= 0x0F;
+    trailing = 2;
+    min = 0x800;
+  } else if (d < 0xF5) {
+    d &= 0x07;
+    trailing = 3;
+    min = 0x10000;
+  } else {
+    return -1;
+  }
+  for (int i = 1; i <= trailing; i++) {
+    if (in + i >= inend) {
+      return 0;
+    }
+    if ((in[i] & 0xC0) != 0x80) {
+      return -1;
+    }
+    d = (d << 6) | (in[i] & 0x3F);
+  }
+  if (d < min || d > 0x10FFFF || (d >= 0xD800 && d <= 0xDFFF)) {
+    return -1;
+  }
+  *c = d;
+  return trailing + 1;
+}
+
+static inline void put_utf16(unsigned char *out, unsigned int c,
+                             bool big_endian) {
+  out[big_endian ? 0 : 1] = (unsigned char)(c >> 8);
+  out[big_endian ? 1 : 0] = (unsigned char)c;
+}
+
+bool utf8_validate(const char *str, int len, int *error_offset) {
+  const unsigned char *in = (const unsigned char *)str;
+  const unsigned char *inend = in + len;
+  while (in < inend) {
+    if (*in < 0x80) {
+      in += ascii_length(in, inend - in);
+      continue;
+    }
+    unsigned int c;
+    int n = utf8_decode(in, inend, &c);
+    if (n <= 0) {
+      if (error_offset != NULL) {
+        *error_offset = (int)(in - (const unsigned char *)str);
+      }
+      return false;
+    }
+    in += n;
+  }
+  if (error_offset != NULL) {
+    *error_offset = -1;
+  }
+  return true;
+}
+
 /**
  * isolat1ToUTF8:
  * @out:  a pointer to an array of bytes to store the result
@@ -990,9 +1501,9 @@ int isolat1ToUTF8(unsigned char *out, int *outlen, const unsigned char *in,
       ++in;
     }
     if ((instop - in) > (outend - out)) instop = in + (outend - out);
-    while ((in < instop) && (*in < 0x80)) {
-      *out++ = *in++;
-    }
+    size_t ascii = ascii_copy(out, in, instop - in);
+    in += ascii;
+    out += ascii;
   }
   if ((in < inend) && (out < outend) && (*in < 0x80)) {
     *out++ = *in++;
@@ -1025,8 +1536,7 @@ int UTF8Toisolat1(unsigned char *out, int *outlen, const unsigned char *in,
   const unsigned char *outstart = out;
   const unsigned char *instart = in;
   const unsigned char *inend;
-  unsigned int c, d;
-  int trailing;
+  unsigned int c;
 
   if ((out == NULL) || (outlen == NULL) || (inlen == NULL)) return (-1);
   if (in == NULL) {
@@ -1040,56 +1550,26 @@ int UTF8Toisolat1(unsigned char *out, int *outlen, const unsigned char *in,
   inend = in + (*inlen);
   outend = out + (*outlen);
   while (in < inend) {
-    d = *in++;
-    if (d < 0x80) {
-      c = d;
-      trailing = 0;
-    } else if (d < 0xC0) {
-      /* trailing byte in leading position */
-      *outlen = out - outstart;
-      *inlen = processed - instart;
-      return (-2);
-    } else if (d < 0xE0) {
-      c = d & 0x1F;
-      trailing = 1;
-    } else if (d < 0xF0) {
-      c = d & 0x0F;
-      trailing = 2;
-    } else if (d < 0xF8) {
-      c = d & 0x07;
-      trailing = 3;
-    } else {
-      /* no chance for this in IsoLat1 */
-      *outlen = out - outstart;
-      *inlen = processed - instart;
-      return (-2);
-    }
-
-    if (inend - in < trailing) {
-      break;
-    }
-
-    for (; trailing; trailing--) {
-      if (in >= inend) break;
-      if (((d = *in++) & 0xC0) != 0x80) {
-        *outlen = out - outstart;
-        *inlen = processed - instart;
-        return (-2);
-      }
-      c <<= 6;
-      c |= d & 0x3F;
+    if (*in < 0x80) {
+      size_t n = std::min(inend - in, outend - out);
+      size_t ascii = ascii_copy(out, in, n);
+      if (ascii == 0) break;  // out is full
+      in += ascii;
+      out += ascii;
+      processed = in;
+      continue;
     }
-
-    /* assertion: c is a single UTF-4 value */
-    if (c <= 0xFF) {
-      if (out >= outend) break;
-      *out++ = c;
-    } else {
-      /* no chance for this in IsoLat1 */
+    int n = utf8_decode(in, inend, &c);
+    if (n == 0) break;  // truncated, the rest comes with the next block
+    if (n < 0 || c > 0xFF) {
+      /* invalid, or no chance for this in IsoLat1 */
       *outlen = out - outstart;
       *inlen = processed - instart;
       return (-2);
     }
+    if (out >= outend) break;
+    *out++ = c;
+    in += n;
     processed = in;
   }
   *outlen = out - outstart;
@@ -1128,7 +1608,16 @@ int UTF16LEToUTF8(unsigned char *out, int *outlen, const unsigned char *inb,
   if ((*inlenb % 2) == 1) (*inlenb)--;
   inlen = *inlenb / 2;
   inend = in + inlen;
-  while ((in < inend) && (out - outstart + 5 < *outlen)) {
+  while (in < inend) {
+    size_t ascii = utf16_ascii_to_utf8(
+        out, (const unsigned char *)in, std::min(inend - in, outend - out),
+        false);
+    if (ascii != 0) {
+      in += ascii;
+      out += ascii;
+      processed = (const unsigned char *)in;
+      continue;
+    }
     if (xmlLittleEndian) {
       c = *in++;
     } else {
@@ -1168,7 +1657,9 @@ int UTF16LEToUTF8(unsigned char *out, int *outlen, const unsigned char *inb,
     }
 
     /* assertion: c is a single UTF-4 value */
-    if (out >= outend) break;
+    /* the whole character fits, or it is left for the next call */
+    if (outend - out < (c < 0x80 ? 1 : c < 0x800 ? 2 : c < 0x10000 ? 3 : 4))
+      break;
     if (c < 0x80) {
       *out++ = c;
       bits = -6;
@@ -1184,7 +1675,6 @@ int UTF16LEToUTF8(unsigned char *out, int *outlen, const unsigned char *inb,
     }
 
     for (; bits >= 0; bits -= 6) {
-      if (out >= outend) break;
       *out++ = ((c >> bits) & 0x3F) | 0x80;
     }
     processed = (const unsigned char *)in;
@@ -1194,116 +1684,80 @@ int UTF16LEToUTF8(unsigned char *out, int *outlen, const unsigned char *inb,
   return (*outlen);
 }
 
-/**
- * UTF8ToUTF16LE:
- * @outb:  a pointer to an array of bytes to store the result
- * @outlen:  the length of @outb
- * @in:  a pointer to an array of UTF-8 chars
- * @inlen:  the length of @in
- *
- * Take a block of UTF-8 chars in and try to convert it to an UTF-16LE
- * block of chars out.
- *
- * Returns the number of bytes written, or -1 if lack of space, or -2
- *     if the transcoding failed.
- */
-int UTF8ToUTF16LE(unsigned char *outb, int *outlen, const unsigned char *in,
-                  int *inlen) {
-  unsigned short *out = (unsigned short *)outb;
+// UTF8ToUTF16LE and UTF8ToUTF16BE
+static int utf8_to_utf16(unsigned char *outb, int *outlen,
+                         const unsigned char *in, int *inlen,
+                         bool big_endian) {
+  unsigned char *out = outb;
   const unsigned char *processed = in;
   const unsigned char *const instart = in;
-  unsigned short *outstart = out;
-  unsigned short *outend;
+  unsigned char *outend;
   const unsigned char *inend;
-  unsigned int c, d;
-  int trailing;
-  unsigned char *tmp;
-  unsigned short tmp1, tmp2;
+  unsigned int c;
 
-  /* UTF16LE encoding has no BOM */
-  if ((out == NULL) || (outlen == NULL) || (inlen == NULL)) return (-1);
+  /* UTF-16LE and UTF-16BE have no BOM */
+  if ((outb == NULL) || (outlen == NULL) || (inlen == NULL)) return (-1);
   if (in == NULL) {
     *outlen = 0;
     *inlen = 0;
     return (0);
   }
   inend = in + *inlen;
-  outend = out + (*outlen / 2);
+  outend = out + (*outlen & ~1);
   while (in < inend) {
-    d = *in++;
-    if (d < 0x80) {
-      c = d;
-      trailing = 0;
-    } else if (d < 0xC0) {
-      /* trailing byte in leading position */
-      *outlen = (out - outstart) * 2;
-      *inlen = processed - instart;
-      return (-2);
-    } else if (d < 0xE0) {
-      c = d & 0x1F;
-      trailing = 1;
-    } else if (d < 0xF0) {
-      c = d & 0x0F;
-      trailing = 2;
-    } else if (d < 0xF8) {
-      c = d & 0x07;
-      trailing = 3;
-    } else {
-      /* no chance for this in UTF-16 */
-      *outlen = (out - outstart) * 2;
+    if (*in < 0x80) {
+      size_t n = std::min(inend - in, (outend - out) / 2);
+      size_t ascii = ascii_to_utf16(out, in, n, big_endian);
+      if (ascii == 0) break;  // out is full
+      in += ascii;
+      out += ascii * 2;
+      processed = in;
+      continue;
+    }
+    int n = utf8_decode(in, inend, &c);
+    if (n == 0) break;  // truncated, the rest comes with the next block
+    if (n < 0) {
+      *outlen = out - outb;
       *inlen = processed - instart;
       return (-2);
     }
-
-    if (inend - in < trailing) {
-      break;
-    }
-
-    for (; trailing; trailing--) {
-      if ((in >= inend) || (((d = *in++) & 0xC0) != 0x80)) break;
-      c <<= 6;
-      c |= d & 0x3F;
-    }
-
-    /* assertion: c is a single UTF-4 value */
     if (c < 0x10000) {
-      if (out >= outend) break;
-      if (xmlLittleEndian) {
-        *out++ = c;
-      } else {
-        tmp = (unsigned char *)out;
-        *tmp = c;
-        *(tmp + 1) = c >> 8;
-        out++;
-      }
-    } else if (c < 0x110000) {
-      if (out + 1 >= outend) break;
+      if (outend - out < 2) break;
+      put_utf16(out, c, big_endian);
+      out += 2;
+    } else {
+      if (outend - out < 4) break;
       c -= 0x10000;
-      if (xmlLittleEndian) {
-        *out++ = 0xD800 | (c >> 10);
-        *out++ = 0xDC00 | (c & 0x03FF);
-      } else {
-        tmp1 = 0xD800 | (c >> 10);
-        tmp = (unsigned char *)out;
-        *tmp = (unsigned char)tmp1;
-        *(tmp + 1) = tmp1 >> 8;
-        out++;
-
-        tmp2 = 0xDC00 | (c & 0x03FF);
-        tmp = (unsigned char *)out;
-        *tmp = (unsigned char)tmp2;
-        *(tmp + 1) = tmp2 >> 8;
-        out++;
-      }
-    } else
-      break;
+      put_utf16(out, 0xD800 | (c >> 10), big_endian);
+      put_utf16(out + 2, 0xDC00 | (c & 0x03FF), big_endian);
+      out += 4;
+    }
+    in += n;
     processed = in;
   }
-  *outlen = (out - outstart) * 2;
+  *outlen = out - outb;
   *inlen = processed - instart;
   return (*outlen);
 }
 
+/**
+ * UTF8ToUTF16LE:
+ * @outb:  a pointer to an array of bytes to store the result
+ * @outlen:  the length of @outb
+ * @in:  a pointer to an array of UTF-8 chars
+ * @inlen:  the length of @in
+ *
+ * Take a block of UTF-8 chars in and try to convert it to an UTF-16LE
+ * block of chars out.
+ *
+ * Returns the number of bytes written, or -1 if lack of space, or -2
+ *     if the transcoding failed.
+ */
+int UTF8ToUTF16LE(unsigned char *outb, int *outlen, const unsigned char *in,
+                  int *inlen) {
+  return utf8_to_utf16(outb, outlen, in, inlen, false);
+}
+
 /**
  * UTF8ToUTF16BE:
  * @outb:  a pointer to an array of bytes to store the result
@@ -1319,99 +1773,7 @@ int UTF8ToUTF16LE(unsigned char *outb, int *outlen, const unsigned char *in,
  */
 int UTF8ToUTF16BE(unsigned char *outb, int *outlen, const unsigned char *in,
                   int *inlen) {
-  unsigned short *out = (unsigned short *)outb;
-  const unsigned char *processed = in;
-  const unsigned char *const instart = in;
-  unsigned short *outstart = out;
-  unsigned short *outend;
-  const unsigned char *inend;
-  unsigned int c, d;
-  int trailing;
-  unsigned char *tmp;
-  unsigned short tmp1, tmp2;
-
-  /* UTF-16BE has no BOM */
-  if ((outb == NULL) || (outlen == NULL) || (inlen == NULL)) return (-1);
-  if (in == NULL) {
-    *outlen = 0;
-    *inlen = 0;
-    return (0);
-  }
-  inend = in + *inlen;
-  outend = out + (*outlen / 2);
-  while (in < inend) {
-    d = *in++;
-    if (d < 0x80) {
-      c = d;
-      trailing = 0;
-    } else if (d < 0xC0) {
-      /* trailing byte in leading position */
-      *outlen = out - outstart;
-      *inlen = processed - instart;
-      return (-2);
-    } else if (d < 0xE0) {
-      c = d & 0x1F;
-      trailing = 1;
-    } else if (d < 0xF0) {
-      c = d & 0x0F;
-      trailing = 2;
-    } else if (d < 0xF8) {
-      c = d & 0x07;
-      trailing = 3;
-    } else {
-      /* no chance for this in UTF-16 */
-      *outlen = out - outstart;
-      *inlen = processed - instart;
-      return (-2);
-    }
-
-    if (inend - in < trailing) {
-      break;
-    }
-
-    for (; trailing; trailing--) {
-      if ((in >= inend) || (((d = *in++) & 0xC0) != 0x80)) break;
-      c <<= 6;
-      c |= d & 0x3F;
-    }
-
-    /* assertion: c is a single UTF-4 value */
-    if (c < 0x10000) {
-      if (out >= outend) break;
-      if (xmlLittleEndian) {
-        tmp = (unsigned char *)out;
-        *tmp = c >> 8;
-        *(tmp + 1) = c;
-        out++;
-      } else {
-        *out++ = c;
-      }
-    } else if (c < 0x110000) {
-      if (out + 1 >= outend) break;
-      c -= 0x10000;
-      if (xmlLittleEndian) {
-        tmp1 = 0xD800 | (c >> 10);
-        tmp = (unsigned char *)out;
-        *tmp = tmp1 >> 8;
-        *(tmp + 1) = (unsigned char)tmp1;
-        out++;
-
-        tmp2 = 0xDC00 | (c & 0x03FF);
-        tmp = (unsigned char *)out;
-        *tmp = tmp2 >> 8;
-        *(tmp + 1) = (unsigned char)tmp2;
-        out++;
-      } else {
-        *out++ = 0xD800 | (c >> 10);
-        *out++ = 0xDC00 | (c & 0x03FF);
-      }
-    } else
-      break;
-    processed = in;
-  }
-  *outlen = (out - outstart) * 2;
-  *inlen = processed - instart;
-  return (*outlen);
+  return utf8_to_utf16(outb, outlen, in, inlen, true);
 }
 
 /**
@@ -1446,6 +1808,15 @@ int UTF16BEToUTF8(unsigned char *out, int *outlen, const unsigned char *inb,
   inlen = *inlenb / 2;
   inend = in + inlen;
   while (in < inend) {
+    size_t ascii = utf16_ascii_to_utf8(
+        out, (const unsigned char *)in, std::min(inend - in, outend - out),
+        true);
+    if (ascii != 0) {
+      in += ascii;
+      out += ascii;
+      processed = (const unsigned char *)in;
+      continue;
+    }
     if (xmlLittleEndian) {
       tmp = (unsigned char *)in;
       c = *tmp++;
@@ -1491,7 +1862,9 @@ int UTF16BEToUTF8(unsigned char *out, int *outlen, const unsigned char *inb,
     }
 
     /* assertion: c is a single UTF-4 value */
-    if (out >= outend) break;
+    /* the whole character fits, or it is left for the next call */
+    if (outend - out < (c < 0x80 ? 1 : c < 0x800 ? 2 : c < 0x10000 ? 3 : 4))
+      break;
     if (c < 0x80) {
       *out++ = c;
       bits = -6;
@@ -1507,7 +1880,6 @@ int UTF16BEToUTF8(unsigned char *out, int *outlen, const unsigned char *inb,
     }
 
     for (; bits >= 0; bits -= 6) {
-      if (out >= outend) break;
       *out++ = ((c >> bits) & 0x3F) | 0x80;
     }
     processed = (const unsigned char *)in;
@@ -1517,20 +1889,420 @@ int UTF16BEToUTF8(unsigned char *out, int *outlen, const unsigned char *inb,
   return (*outlen);
 }
 
+//-----------------------------------------------------------------------
+// GSM 7-bit packing and SMS segmentation
+//-----------------------------------------------------------------------
+
+// 8 septets are 7 octets, the blocks are moved through a 64 bit word.
+// GCC does not merge the byte loops into one load or store, memcpy does.
+static inline uint64_t load_le(const unsigned char *p, int n) {
+  uint64_t v = 0;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  if (n == 8) {
+    memcpy(&v, p, 8);
+    return v;
+  }
+#endif
+  for (int i = 0; i < n; i++) {
+    v |= (uint64_t)p[i] << (i * 8);
+  }
+  return v;
+}
+
+static inline void store_le(unsigned char *p, uint64_t v, int n) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  if (n == 8) {
+    memcpy(p, &v, 8);
+    return;
+  }
+#endif
+  for (int i = 0; i < n; i++) {
+    p[i] = (unsigned char)(v >> (i * 8));
+  }
+}
+
+int gsm7_pack(char *dest, const char *src, int septets, int fill_bits) {
+  unsigned char *out = (unsigned char *)dest;
+  const unsigned char *in = (const unsigned char *)src;
+  uint64_t acc = 0;
+  int bits = fill_bits;  // in acc, not written yet
+  int i = 0;
+  for (; i + 8 <= septets; i += 8) {
+    // squeeze the 8 bytes into 56 bits, doubling the lane width each step
+    uint64_t v = load_le(in + i, 8) & 0x7F7F7F7F7F7F7F7FULL;
+    v = (v & 0x007F007F007F007FULL) | ((v & 0x7F007F007F007F00ULL) >> 1);
+    v = (v & 0x00003FFF00003FFFULL) | ((v & 0x3FFF00003FFF0000ULL) >> 2);
+    v = (v & 0x000000000FFFFFFFULL) | ((v & 0x0FFFFFFF00000000ULL) >> 4);
+    acc |= v << bits;
+    // a whole word while the output goes on, the 8th byte is written again
+    store_le(out, acc, i + 8 < septets ? 8 : 7);
+    out += 7;
+    acc >>= 56;
+  }
+  for (; i < septets; i++) {
+    acc |= (uint64_t)(in[i] & 0x7F) << bits;
+    bits += 7;
+    if (bits >= 8) {
+      *out++ = (unsigned char)acc;
+      acc >>= 8;
+      bits -= 8;
+    }
+  }
+  if (bits > 0) {
+    // 7 spare bits would read as an '@', 3GPP TS 23.038 fills them with CR
+    if (bits == 1) {
+      acc |= 0x0D << 1;
+    }
+    *out++ = (unsigned char)acc;
+  }
+  return out - (unsigned char *)dest;
+}
+
+int gsm7_unpack(char *dest, const char *src, int septets, int fill_bits) {
+  unsigned char *out = (unsigned char *)dest;
+  const unsigned char *in = (const unsigned char *)src;
+  const unsigned char *end = in + (fill_bits + septets * 7 + 7) / 8;
+  uint64_t acc = 0;
+  int bits = 0;  // in acc, not read yet
+  int i = 0;
+  if (septets > 0 && fill_bits > 0) {
+    acc = *in++ >> fill_bits;
+    bits = 8 - fill_bits;
+  }
+  for (; i + 8 <= septets; i += 8) {
+    uint64_t octets = end - in >= 8 ? load_le(in, 8) : load_le(in, 7);
+    acc |= (octets & 0x00FFFFFFFFFFFFFFULL) << bits;
+    in += 7;
+    // spread the 56 bits over 8 bytes, halving the lane width each step
+    uint64_t v = acc & 0x00FFFFFFFFFFFFFFULL;
+    v = (v & 0x000000000FFFFFFFULL) | ((v & 0x00FFFFFFF0000000ULL) << 4);
+    v = (v & 0x00003FFF00003FFFULL) | ((v & 0x0FFFC0000FFFC000ULL) << 2);
+    v = (v & 0x007F007F007F007FULL) | ((v & 0x3F803F803F803F80ULL) << 1);
+    store_le(out, v, 8);
+    out += 8;
+    acc >>= 56;
+  }
+  for (; i < septets; i++) {
+    if (bits < 7) {
+      acc |= (uint64_t)*in++ << bits;
+      bits += 8;
+    }
+    *out++ = acc & 0x7F;
+    acc >>= 7;
+    bits -= 7;
+  }
+  return septets;
+}
+
+// the septets of unicode c in GSM 7-bit, 0 if it is not in the GSM alphabet.
+// Unlike charset_utf8_to_gsm() the look-alikes do not count, the message is
+// sent in UCS-2 rather than altered.
+static int gsm_septets(unsigned int c) {
+  int g = unicode_to_gsm(c);
+  if (g >= 0) {
+    return (g < 128 && g != 27 && (unsigned int)gsm_to_unicode[g] == c) ? 1
+                                                                         : 0;
+  }
+  for (int i = 0; gsm_esctouni[i].gsmesc >= 0; i++) {
+    if (gsm_esctouni[i].gsmesc == -g) {
+      return (unsigned int)gsm_esctouni[i].unichar == c ? 2 : 0;
+    }
+  }
+  return 0;
+}
+
+int sms_split(const char *src, int len, SmsCoding *coding, int *ends,
+              int max_segments) {
+  const unsigned char *start = (const unsigned char *)src;
+  const unsigned char *inend = start + len;
+  unsigned int c;
+
+  // the coding, and the length of the whole message in its units
+  SmsCoding chosen = kSmsGsm7;
+  int septets = 0;
+  int units = 0;  // UTF-16
+  for (const unsigned char *in = start; in < inend;) {
+    if (*in < 0x80) {
+      // the ASCII characters that are not in the GSM alphabet are rare
+      c = *in++;
+      int n = gsm_septets(c);
+      septets += n;
+      units++;
+      if (n == 0) chosen = kSmsUcs2;
+      continue;
+    }
+    int n = utf8_decode(in, inend, &c);
+    if (n <= 0) return -1;
+    in += n;
+    units += c >= 0x10000 ? 2 : 1;
+    int s = gsm_septets(c);
+    septets += s;
+    if (s == 0) chosen = kSmsUcs2;
+  }
+  *coding = chosen;
+
+  int single = chosen == kSmsGsm7 ? kSmsSingleSeptets : kSmsSingleUcs2;
+  int concat = chosen == kSmsGsm7 ? kSmsConcatSeptets : kSmsConcatUcs2;
+  if ((chosen == kSmsGsm7 ? septets : units) <= single) {
+    if (max_segments < 1) return -1;
+    ends[0] = len;
+    return 1;
+  }
+
+  // a character, an escape pair or a surrogate pair, is never split
+  int segments = 0;
+  int used = 0;
+  for (const unsigned char *in = start; in < inend;) {
+    int n = utf8_decode(in, inend, &c);
+    int size = chosen == kSmsGsm7 ? gsm_septets(c) : (c >= 0x10000 ? 2 : 1);
+    if (used + size > concat) {
+      if (segments == max_segments) return -1;
+      ends[segments++] = in - start;
+      used = 0;
+    }
+    used += size;
+    in += n;
+  }
+  if (segments == max_segments) return -1;
+  ends[segments++] = len;
+  return segments;
+}
+
+int sms_concat_udh(char *dest, int ref, int total, int seq) {
+  dest[0] = 5;  // UDHL
+  dest[1] = 0;  // IEI, concatenated short messages, 8-bit reference
+  dest[2] = 3;  // IEDL
+  dest[3] = (char)ref;
+  dest[4] = (char)total;
+  dest[5] = (char)seq;
+  return 6;
+}
+
+//-----------------------------------------------------------------------
+// charset_convert and CharsetConverter
+//
+// The conversions that have a function above skip iconv, the others keep
+// their iconv descriptors: CharsetConverter for its lifetime, and
+// charset_convert() in a small per-thread cache, since iconv_open() loads
+// and parses the gconv modules on every call.
+//-----------------------------------------------------------------------
+
+enum Charset {
+  kCharsetOther,
+  kCharsetUtf8,
+  kCharsetLatin1,
+  kCharsetUtf16BE,
+  kCharsetUtf16LE,
+  kCharsetGsm
+};
+
+// "UTF-8", "utf8" and "UTF_8" are the same to iconv
+static Charset charset_from_name(const char *name) {
+  char normalized[16];
+  size_t n = 0;
+  for (; *name != '\0'; name++) {
+    char c = *name;
+    if (c >= 'a' && c <= 'z') {
+      c -= 'a' - 'A';
+    } else if (!(c >= 'A' && c <= 'Z') && !(c >= '0' && c <= '9')) {
+      continue;
+    }
+    if (n + 1 == sizeof(normalized)) return kCharsetOther;
+    normalized[n++] = c;
+  }
+  normalized[n] = '\0';
+  static const struct {
+    const char *name;
+    Charset charset;
+  } names[] = {{"UTF8", kCharsetUtf8},       {"ISO88591", kCharsetLatin1},
+               {"LATIN1", kCharsetLatin1},   {"UTF16BE", kCharsetUtf16BE},
+               {"UTF16LE", kCharsetUtf16LE}, {"GSM", kCharsetGsm},
+               {"GSM0338", kCharsetGsm},     {"GSM7", kCharsetGsm}};
+  for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+    if (strcmp(normalized, names[i].name) == 0) return names[i].charset;
+  }
+  return kCharsetOther;
+}
+
+typedef int (*builtin_converter)(unsigned char *out, int *outlen,
+                                 const unsigned char *in, int *inlen);
+
+struct BuiltinConversion {
+  Charset to;
+  Charset from;
+  builtin_converter convert;
+};
+
+static const BuiltinConversion builtin_conversions[] = {
+    {kCharsetLatin1, kCharsetUtf8, UTF8Toisolat1},
+    {kCharsetUtf8, kCharsetLatin1, isolat1ToUTF8},
+    {kCharsetUtf16BE, kCharsetUtf8, UTF8ToUTF16BE},
+    {kCharsetUtf8, kCharsetUtf16BE, UTF16BEToUTF8},
+    {kCharsetUtf16LE, kCharsetUtf8, UTF8ToUTF16LE},
+    {kCharsetUtf8, kCharsetUtf16LE, UTF16LEToUTF8},
+    {kCharsetGsm, kCharsetUtf8, charset_utf8_to_gsm},
+    {kCharsetUtf8, kCharsetGsm, charset_gsm_to_utf8},
+};
+
+static const BuiltinConversion *find_builtin(const char *to_charset,
+                                             const char *from_charset) {
+  Charset to = charset_from_name(to_charset);
+  Charset from = charset_from_name(from_charset);
+  for (size_t i = 0;
+       i < sizeof(builtin_conversions) / sizeof(builtin_conversions[0]); i++) {
+    if (builtin_conversions[i].to == to &&
+        builtin_conversions[i].from == from) {
+      return &builtin_conversions[i];
+    }
+  }
+  return NULL;
+}
+
+// the length of in without a character cut off at the end
+static size_t complete_prefix(Charset charset, const unsigned char *in,
+                              size_t len) {
+  switch (charset) {
+    case kCharsetUtf8:
+      for (size_t i = 1; i <= 3 && i <= len; i++) {
+        unsigned char c = in[len - i];
+        if ((c & 0xC0) != 0x80) {
+          size_t need = c >= 0xF0 ? 4 : c >= 0xE0 ? 3 : c >= 0xC0 ? 2 : 1;
+          return need > i ? len - i : len;
+        }
+      }
+      return len;
+    case kCharsetUtf16BE:
+    case kCharsetUtf16LE:
+      len &= ~(size_t)1;
+      if (len >= 2) {
+        unsigned char hi = in[len - (charset == kCharsetUtf16BE ? 2 : 1)];
+        if ((hi & 0xFC) == 0xD8) len -= 2;  // a high surrogate
+      }
+      return len;
+    case kCharsetGsm:
+      return (len > 0 && in[len - 1] == 27) ? len - 1 : len;
+    default:
+      return len;
+  }
+}
+
+enum StepStatus {
+  kStepDone,
+  kStepIncomplete,  // a character is cut off at the end of the input
+  kStepOutputFull,
+  kStepInvalid
+};
+
+static StepStatus builtin_step(const BuiltinConversion *conversion,
+                               char **inbuf, size_t *inbytesleft,
+                               char **outbuf, size_t *outbytesleft) {
+  // the functions take int lengths
+  const size_t kMaxChunk = 1 << 30;
+  while (*inbytesleft > 0) {
+    size_t len = std::min(*inbytesleft, kMaxChunk);
+    bool last = len == *inbytesleft;
+    const unsigned char *in = (const unsigned char *)*inbuf;
+    size_t complete = complete_prefix(conversion->from, in, len);
+    int inlen = (int)complete;
+    int outlen = (int)std::min(*outbytesleft, kMaxChunk);
+    int ret = conversion->convert((unsigned char *)*outbuf, &outlen, in,
+                                  &inlen);
+    *inbuf += inlen;
+    *inbytesleft -= inlen;
+    *outbuf += outlen;
+    *outbytesleft -= outlen;
+    if (ret < 0) return kStepInvalid;
+    if ((size_t)inlen < complete) return kStepOutputFull;
+    if (last && complete < len) return kStepIncomplete;
+  }
+  return kStepDone;
+}
+
+static StepStatus iconv_step(iconv_t cd, char **inbuf, size_t *inbytesleft,
+                             char **outbuf, size_t *outbytesleft) {
+  if (iconv(cd, inbuf, inbytesleft, outbuf, outbytesleft) != (size_t)-1) {
+    return kStepDone;
+  }
+  switch (errno) {
+    case E2BIG:
+      return kStepOutputFull;
+    case EINVAL:
+      return kStepIncomplete;
+    default:
+      return kStepInvalid;
+  }
+}
+
+// the descriptors charset_convert() used last in this thread
+class IconvCache {
+ public:
+  ~IconvCache() {
+    for (size_t i = 0; i < entries_.size(); i++) {
+      iconv_close(entries_[i].cd);
+    }
+  }
+
+  iconv_t Get(const char *to_charset, const char *from_charset) {
+    for (size_t i = 0; i < entries_.size(); i++) {
+      if (entries_[i].to == to_charset && entries_[i].from == from_charset) {
+        // most recently used first
+        std::rotate(entries_.begin(), entries_.begin() + i,
+                    entries_.begin() + i + 1);
+        return entries_[0].cd;
+      }
+    }
+    iconv_t cd = iconv_open(to_charset, from_charset);
+    if (cd == (iconv_t)-1) {
+      return cd;
+    }
+    if (entries_.size() == kMaxEntries) {
+      iconv_close(entries_.back().cd);
+      entries_.pop_back();
+    }
+    Entry entry = {to_charset, from_charset, cd};
+    entries_.insert(entries_.begin(), entry);
+    return cd;
+  }
+
+ private:
+  enum { kMaxEntries = 8 };
+
+  struct Entry {
+    std::string to;
+    std::string from;
+    iconv_t cd;
+  };
+
+  std::vector<Entry> entries_;
+};
+
+static thread_local IconvCache t_iconv_cache;
 
 int charset_convert(const char *to_charset, const char *from_charset,
-                       char **inbuf, size_t *inbytesleft, char **outbuf,
-                       size_t *outbytesleft) {
+                    char **inbuf, size_t *inbytesleft, char **outbuf,
+                    size_t *outbytesleft) {
   size_t buf_len = *outbytesleft;
-  iconv_t cd = iconv_open(to_charset, from_charset);
-  if (cd == (iconv_t)-1) {
-    // LOG_ERROR("charset is not supported. Failed to convert charset from "
-    //           << from_charset << " to " << to_charset);
-    return -1;
+  StepStatus status;
+  const BuiltinConversion *builtin = find_builtin(to_charset, from_charset);
+  if (builtin != NULL) {
+    status = builtin_step(builtin, inbuf, inbytesleft, outbuf, outbytesleft);
+  } else {
+    iconv_t cd = t_iconv_cache.Get(to_charset, from_charset);
+    if (cd == (iconv_t)-1) {
+      // LOG_ERROR("charset is not supported. Failed to convert charset from "
+      //           << from_charset << " to " << to_charset);
+      return -1;
+    }
+    iconv(cd, NULL, NULL, NULL, NULL);  // the state left by the last call
+    status = iconv_step(cd, inbuf, inbytesleft, outbuf, outbytesleft);
+    if (status == kStepDone) {
+      // the shift sequence back to the initial state, if any
+      if (iconv(cd, NULL, NULL, outbuf, outbytesleft) == (size_t)-1) {
+        status = kStepOutputFull;
+      }
+    }
   }
-  size_t num_nonreversible_or_error = iconv(cd, inbuf, inbytesleft, outbuf, outbytesleft);
-  iconv_close(cd);
-  if (num_nonreversible_or_error < 0 || *inbytesleft != 0) {
+  if (status != kStepDone || *inbytesleft != 0) {
     // LOG_ERROR("Failed to convert charset from "
     //               << from_charset << " to " << to_charset << ". inbytesleft="
     //               << *inbytesleft << ", outbytesleft=" << *outbytesleft
@@ -1541,5 +2313,96 @@ int charset_convert(const char *to_charset, const char *from_charset,
   return (int)(buf_len - *outbytesleft);
 }
 
+CharsetConverter::CharsetConverter()
+    : builtin_(NULL), cd_(NULL), pending_len_(0) {}
+
+CharsetConverter::~CharsetConverter() { Close(); }
+
+bool CharsetConverter::Open(const char *to_charset, const char *from_charset) {
+  Close();
+  builtin_ = find_builtin(to_charset, from_charset);
+  if (builtin_ != NULL) {
+    return true;
+  }
+  iconv_t cd = iconv_open(to_charset, from_charset);
+  if (cd == (iconv_t)-1) {
+    return false;
+  }
+  cd_ = cd;
+  return true;
+}
+
+void CharsetConverter::Close() {
+  if (cd_ != NULL) {
+    iconv_close((iconv_t)cd_);
+    cd_ = NULL;
+  }
+  builtin_ = NULL;
+  pending_len_ = 0;
+}
+
+void CharsetConverter::Reset() {
+  if (cd_ != NULL) {
+    iconv((iconv_t)cd_, NULL, NULL, NULL, NULL);
+  }
+  pending_len_ = 0;
+}
+
+int CharsetConverter::Step(char **inbuf, size_t *inbytesleft, char **outbuf,
+                           size_t *outbytesleft) {
+  if (builtin_ != NULL) {
+    return builtin_step(static_cast<const BuiltinConversion *>(builtin_),
+                        inbuf, inbytesleft, outbuf, outbytesleft);
+  }
+  return iconv_step((iconv_t)cd_, inbuf, inbytesleft, outbuf, outbytesleft);
+}
+
+int CharsetConverter::Convert(char **inbuf, size_t *inbytesleft,
+                              char **outbuf, size_t *outbytesleft) {
+  if (builtin_ == NULL && cd_ == NULL) {
+    return -1;
+  }
+  size_t buf_len = *outbytesleft;
+
+  // first the character cut off at the end of the last input, taking one
+  // byte of the new input at a time until it is complete
+  while (pending_len_ > 0) {
+    char *in = pending_;
+    size_t left = pending_len_;
+    int status = Step(&in, &left, outbuf, outbytesleft);
+    memmove(pending_, in, left);
+    pending_len_ = (int)left;
+    if (status == kStepInvalid) return -1;
+    if (status == kStepOutputFull) return (int)(buf_len - *outbytesleft);
+    if (status == kStepDone) break;
+    if (*inbytesleft == 0) return (int)(buf_len - *outbytesleft);
+    if (pending_len_ == (int)sizeof(pending_)) return -1;
+    pending_[pending_len_++] = *(*inbuf)++;
+    (*inbytesleft)--;
+  }
+
+  int status = Step(inbuf, inbytesleft, outbuf, outbytesleft);
+  if (status == kStepInvalid) return -1;
+  if (status == kStepIncomplete) {
+    if (*inbytesleft > sizeof(pending_)) return -1;
+    memcpy(pending_, *inbuf, *inbytesleft);
+    pending_len_ = (int)*inbytesleft;
+    *inbuf += *inbytesleft;
+    *inbytesleft = 0;
+  }
+  return (int)(buf_len - *outbytesleft);
+}
+
+bool CharsetConverter::Finish(char **outbuf, size_t *outbytesleft) {
+  if (pending_len_ > 0) {
+    return false;
+  }
+  if (cd_ != NULL &&
+      iconv((iconv_t)cd_, NULL, NULL, outbuf, outbytesleft) == (size_t)-1) {
+    return false;
+  }
+  return true;
+}
+
 }  // namespace encoding
 }  // namespace ming
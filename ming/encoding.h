@@ -1,11 +1,54 @@
 #ifndef MING_ENCODING_H_
 #define MING_ENCODING_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ming/noncopyable.h"
+
 namespace ming {
 namespace encoding {
 
+// Upper case hex, dest needs len * 2 + 1 bytes and ends with '\0'. Return
+// len * 2. The output of consecutive chunks can simply be concatenated.
 int hex_encode(char *dest, const char *str, int len);
+// Accept both cases, dest needs len / 2 bytes. Return the number of bytes
+// decoded, or -1 if str has a bad digit or an odd length.
 int hex_decode(char *dest, const char *str, int len);
+// Also set *error_offset to the offset of the first bad digit, or to len if
+// the length is odd (where the missing digit would be), -1 if no error.
+int hex_decode(char *dest, const char *str, int len, int *error_offset);
+
+// Decode hex text that comes in chunks, a pair of digits can be split
+// between two chunks.
+class HexDecoder {
+ public:
+  HexDecoder() : pending_(-1), offset_(0), error_offset_(-1) {}
+
+  // dest needs (len + 1) / 2 bytes. Return the number of bytes decoded, -1
+  // if there is a bad digit.
+  int Update(char *dest, const char *str, int len);
+  // end of the stream, return false if a digit is left without its pair
+  bool Finish();
+  void Reset();
 
+  // the offset of the first bad digit in the stream, or its length if
+  // Finish() found an odd length, -1 if no error. The same as hex_decode()
+  // on the whole stream.
+  int64_t error_offset() const { return error_offset_; }
+
+ private:
+  int pending_;  // the first digit of a pair split by the chunks, -1 if none
+  int64_t offset_;  // in the stream, of the next digit
+  int64_t error_offset_;
+};
+
+// Return true if str is well-formed UTF-8 (RFC 3629: no overlong forms,
+// surrogates or code points above U+10FFFF). Otherwise set *error_offset
+// to the offset of the first bad or truncated sequence, -1 if valid.
+bool utf8_validate(const char *str, int len, int *error_offset = NULL);
+
+// The UTF-8 decoders below reject the same sequences and return -2.
 int latin1_to_utf8(char *dest, char const *src);
 int latin1_to_utf8(char *dest, int *dest_len, const char *src, int *src_len);
 int utf8_to_latin1(char *dest, int *dest_len, const char *src, int *src_len);
@@ -26,9 +69,76 @@ int ucs2le_to_utf8(char *outb, int *outlen, const char *in, int *inlen);
 int gsm_to_utf8(char *dest, int *dest_len, const char *src, int *src_len);
 int utf8_to_gsm(char *dest, int *dest_len, const char *src, int *src_len);
 
+// Pack GSM septets, one per byte in src, into the 7-bit form of the air
+// interface. dest needs (fill_bits + septets * 7 + 7) / 8 bytes; fill_bits
+// are the zero bits that align the text after a user data header to a
+// septet boundary, 1 after the header of sms_concat_udh(). Return the bytes
+// written.
+int gsm7_pack(char *dest, const char *src, int septets, int fill_bits = 0);
+// The reverse, dest needs septets bytes. Return septets.
+int gsm7_unpack(char *dest, const char *src, int septets, int fill_bits = 0);
+
+enum SmsCoding { kSmsGsm7, kSmsUcs2 };
+
+// the text per segment, in septets or UCS-2 characters
+enum {
+  kSmsSingleSeptets = 160,
+  kSmsConcatSeptets = 153,  // after the 6 bytes concatenation header
+  kSmsSingleUcs2 = 70,
+  kSmsConcatUcs2 = 67
+};
+
+// Choose GSM 7-bit for UTF-8 text that is all in the GSM alphabet and its
+// extension table, UCS-2 otherwise, and split the text into SMS segments.
+// Store the offset in src where each segment ends into ends[]. Return the
+// number of segments, -1 if src is not valid UTF-8 or needs more than
+// max_segments.
+int sms_split(const char *src, int len, SmsCoding *coding, int *ends,
+              int max_segments);
+// Write the 6 bytes user data header of segment seq (from 1) of total, the
+// segments of a message share ref. Return 6.
+int sms_concat_udh(char *dest, int ref, int total, int seq);
+
+// Convert all of the input like iconv(3), return the bytes written, or -1
+// if the charsets are not supported or not all of the input is converted.
+// UTF-8 to and from ISO-8859-1, UTF-16BE, UTF-16LE and GSM 03.38 use the
+// functions above, the other charsets use an iconv descriptor cached per
+// thread.
 int charset_convert(const char *to_charset, const char *from_charset,
-                       char **inbuf, size_t *inbytesleft, char **outbuf,
-                       size_t *outbytesleft);
+                    char **inbuf, size_t *inbytesleft, char **outbuf,
+                    size_t *outbytesleft);
+
+// Convert a stream that comes in chunks, a character can be split between
+// two chunks. Opens iconv once, unless the conversion is a built-in one.
+class CharsetConverter : private noncopyable {
+ public:
+  CharsetConverter();
+  ~CharsetConverter();
+
+  // return false if the conversion is not supported
+  bool Open(const char *to_charset, const char *from_charset);
+  void Close();
+  // forget the state of the stream, to start another one
+  void Reset();
+
+  // Convert as much as fits into the output and advance the pointers, a
+  // character cut off at the end of the input is kept for the next call.
+  // Call again with more output space while *inbytesleft is not 0. Return
+  // the bytes written, or -1 on invalid input.
+  int Convert(char **inbuf, size_t *inbytesleft, char **outbuf,
+              size_t *outbytesleft);
+  // end of the stream, return false if a character is left incomplete
+  bool Finish(char **outbuf, size_t *outbytesleft);
+
+ private:
+  int Step(char **inbuf, size_t *inbytesleft, char **outbuf,
+           size_t *outbytesleft);
+
+  const void *builtin_;  // a BuiltinConversion, or NULL
+  void *cd_;             // iconv_t, or NULL
+  char pending_[16];     // a character split between two chunks
+  int pending_len_;
+};
 }  // namespace encoding
 }  // namespace ming
 
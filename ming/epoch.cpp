@@ -0,0 +1,203 @@
+#include "ming/epoch.h"
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#include "ming/likely.h"
+
+namespace ming {
+
+namespace {
+
+struct Retired {
+  void* p;
+  epoch_deleter deleter;
+  uint64_t epoch;
+};
+
+// never freed, the records of the exited threads are reused
+struct EpochRecord {
+  std::atomic<uint64_t> epoch;  // the epoch seen when entered, 0 if outside
+  std::atomic<bool> in_use;
+  int nesting;
+  int retired_since_reclaim;
+  EpochRecord* next;            // in g_records
+  std::deque<Retired> retired;  // in the order of the epochs
+  char pad[64];
+};
+
+std::atomic<uint64_t> g_epoch(1);
+std::atomic<EpochRecord*> g_records(NULL);
+
+std::mutex g_orphans_mutex;
+std::deque<Retired> g_orphans;  // left by the exited threads
+std::atomic<bool> g_has_orphans(false);
+
+EpochRecord* acquire_record() {
+  for (EpochRecord* r = g_records.load(std::memory_order_acquire); r != NULL;
+       r = r->next) {
+    bool expected = false;
+    if (!r->in_use.load(std::memory_order_relaxed) &&
+        r->in_use.compare_exchange_strong(expected, true,
+                                          std::memory_order_acquire)) {
+      return r;
+    }
+  }
+  EpochRecord* r = new EpochRecord;
+  r->epoch.store(0, std::memory_order_relaxed);
+  r->in_use.store(true, std::memory_order_relaxed);
+  r->nesting = 0;
+  r->retired_since_reclaim = 0;
+  r->next = g_records.load(std::memory_order_relaxed);
+  while (!g_records.compare_exchange_weak(r->next, r,
+                                          std::memory_order_release,
+                                          std::memory_order_relaxed)) {
+  }
+  return r;
+}
+
+// advance the global epoch if every thread inside a guard has seen it,
+// return the global epoch
+uint64_t try_advance() {
+  uint64_t epoch = g_epoch.load(std::memory_order_relaxed);
+  // pairs with the fence of epoch_enter(): a reader not seen here sees all
+  // the unlinks done before
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  for (EpochRecord* r = g_records.load(std::memory_order_acquire); r != NULL;
+       r = r->next) {
+    // acquire: the reads of a reader that left happen before the deletes
+    uint64_t e = r->epoch.load(std::memory_order_acquire);
+    if (e != 0 && e != epoch) {
+      return epoch;
+    }
+  }
+  if (g_epoch.compare_exchange_strong(epoch, epoch + 1,
+                                      std::memory_order_release,
+                                      std::memory_order_relaxed)) {
+    return epoch + 1;
+  }
+  return epoch;  // advanced by another thread
+}
+
+inline bool expired(const Retired& item, uint64_t epoch) {
+  return item.epoch + 2 <= epoch;
+}
+
+void reclaim_list(std::deque<Retired>* retired, uint64_t epoch) {
+  while (!retired->empty() && expired(retired->front(), epoch)) {
+    Retired item = retired->front();
+    retired->pop_front();
+    item.deleter(item.p);
+  }
+}
+
+void reclaim_orphans(uint64_t epoch, bool wait) {
+  std::unique_lock<std::mutex> lock(g_orphans_mutex, std::defer_lock);
+  if (wait) {
+    lock.lock();
+  } else if (!lock.try_lock()) {
+    return;
+  }
+  // from several threads, not in order
+  std::deque<Retired>::iterator end = std::stable_partition(
+      g_orphans.begin(), g_orphans.end(),
+      [epoch](const Retired& item) { return !expired(item, epoch); });
+  std::deque<Retired> expired_items(end, g_orphans.end());
+  g_orphans.erase(end, g_orphans.end());
+  g_has_orphans.store(!g_orphans.empty(), std::memory_order_relaxed);
+  lock.unlock();
+  for (size_t i = 0; i < expired_items.size(); i++) {
+    expired_items[i].deleter(expired_items[i].p);
+  }
+}
+
+void reclaim(EpochRecord* r) {
+  r->retired_since_reclaim = 0;
+  uint64_t epoch = try_advance();
+  reclaim_list(&r->retired, epoch);
+  if (g_has_orphans.load(std::memory_order_relaxed)) {
+    reclaim_orphans(epoch, false);
+  }
+}
+
+class ThreadRecord {
+ public:
+  ThreadRecord() : record_(NULL) {}
+
+  ~ThreadRecord() {
+    if (record_ == NULL) {
+      return;
+    }
+    reclaim(record_);
+    if (!record_->retired.empty()) {
+      std::lock_guard<std::mutex> guard(g_orphans_mutex);
+      g_orphans.insert(g_orphans.end(), record_->retired.begin(),
+                       record_->retired.end());
+      g_has_orphans.store(true, std::memory_order_relaxed);
+      record_->retired.clear();
+    }
+    record_->in_use.store(false, std::memory_order_release);
+    record_ = NULL;
+  }
+
+  EpochRecord* get() {
+    if (UNLIKELY(record_ == NULL)) {
+      record_ = acquire_record();
+    }
+    return record_;
+  }
+
+ private:
+  EpochRecord* record_;
+};
+
+thread_local ThreadRecord t_record;
+
+}  // namespace
+
+void epoch_enter() {
+  EpochRecord* r = t_record.get();
+  if (r->nesting++ == 0) {
+    r->epoch.store(g_epoch.load(std::memory_order_relaxed),
+                   std::memory_order_relaxed);
+    // the reads of the shared data must not move before the store
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+  }
+}
+
+void epoch_exit() {
+  EpochRecord* r = t_record.get();
+  if (--r->nesting == 0) {
+    r->epoch.store(0, std::memory_order_release);
+  }
+}
+
+void epoch_retire(void* p, epoch_deleter deleter) {
+  EpochRecord* r = t_record.get();
+  // the unlink of p must be visible before the epoch is read
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  Retired item = {p, deleter, g_epoch.load(std::memory_order_relaxed)};
+  r->retired.push_back(item);
+  if (++r->retired_since_reclaim >= kEpochReclaimBatch) {
+    reclaim(r);
+  }
+}
+
+void epoch_synchronize() {
+  EpochRecord* r = t_record.get();
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  uint64_t target = g_epoch.load(std::memory_order_relaxed) + 2;
+  uint64_t epoch;
+  while ((epoch = try_advance()) < target) {
+    std::this_thread::yield();
+  }
+  r->retired_since_reclaim = 0;
+  reclaim_list(&r->retired, epoch);
+  reclaim_orphans(epoch, true);
+}
+
+}  // namespace ming
@@ -0,0 +1,100 @@
+#ifndef MING_EPOCH_H_
+#define MING_EPOCH_H_
+
+#include <stddef.h>
+
+#include <atomic>
+
+#include "ming/noncopyable.h"
+
+namespace ming {
+
+//-----------------------------------------------------------------------------
+// Epoch-based reclamation for read-mostly shared data.
+//
+// Readers run inside an EpochGuard: entering and leaving is a store of the
+// thread's epoch plus a fence, wait-free and without any shared write.
+// Writers unlink or replace an object, then epoch_retire() it. The global
+// epoch moves forward once every thread inside a guard has seen the current
+// epoch, and an object retired in epoch e is deleted when the global epoch
+// reaches e + 2: no reader can still hold a pointer to it by then.
+//
+// Retired objects wait in a per-thread list, reclaimed every
+// kEpochReclaimBatch retirements by the retiring thread; a thread that exits
+// hands its list over to the others. A reader that stays in a guard for
+// long holds back all the reclamation, keep the guards short and never
+// block inside one.
+//
+//   RcuPtr<HashRing> g_ring;
+//
+//   // reader
+//   EpochGuard guard;
+//   const std::string& server = g_ring.Get()->GetNode(key);
+//
+//   // writer, serialized by the caller
+//   HashRing* ring = new HashRing(*g_ring.Get());
+//   ring->AddNode("10.0.0.8:80");
+//   g_ring.Update(ring);
+//-----------------------------------------------------------------------------
+
+enum { kEpochReclaimBatch = 64 };
+
+typedef void (*epoch_deleter)(void* p);
+
+// guards can nest, only the outermost one counts
+void epoch_enter();
+void epoch_exit();
+
+// delete p with deleter(p) once no reader can see it, call after p is no
+// longer reachable from the shared data. Can be called inside a guard.
+void epoch_retire(void* p, epoch_deleter deleter);
+
+template <typename T>
+void epoch_delete(void* p) {
+  delete static_cast<T*>(p);
+}
+
+template <typename T>
+void epoch_retire(T* p) {
+  epoch_retire(p, &epoch_delete<T>);
+}
+
+// wait until the readers of the objects retired so far are gone and delete
+// the ones retired by this thread and by the exited threads. Must not be
+// called inside a guard. For shutdown and tests, the writers do not need it.
+void epoch_synchronize();
+
+class EpochGuard : private noncopyable {
+ public:
+  EpochGuard() { epoch_enter(); }
+  ~EpochGuard() { epoch_exit(); }
+};
+
+// A pointer to the current version of an object. Readers Get() it inside an
+// EpochGuard, the object stays valid until the guard ends. Update()
+// publishes a new version and retires the old one; concurrent writers must
+// be serialized by the caller, e.g. to copy-modify-update.
+template <typename T>
+class RcuPtr : private noncopyable {
+ public:
+  explicit RcuPtr(T* p = NULL) : ptr_(p) {}
+
+  // no reader may be left
+  ~RcuPtr() { delete ptr_.load(std::memory_order_relaxed); }
+
+  T* Get() const { return ptr_.load(std::memory_order_acquire); }
+
+  void Update(T* p) {
+    T* old = ptr_.exchange(p, std::memory_order_acq_rel);
+    if (old != NULL) {
+      epoch_retire(old);
+    }
+  }
+
+ private:
+  std::atomic<T*> ptr_;
+};
+
+}  // namespace ming
+
+#endif  // MING_EPOCH_H_
@@ -29,7 +29,8 @@ class FlowControl {
 
   // return 0 if a packet was allowed
   int Allow() {
-    unsigned int seconds_since_epoch = ming::seconds_since_epoch();
+    // a relaxed load once the coarse clock ticker is running
+    unsigned int seconds_since_epoch = ming::coarse_seconds_since_epoch();
     // sec
     if (limit_per_sec_ != 0) {  // no limit
       if (seconds_since_epoch > last_sec_) {
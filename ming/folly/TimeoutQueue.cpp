@@ -14,8 +14,10 @@
  * limitations under the License.
  */
 
-#include <folly/TimeoutQueue.h>
+#include "ming/folly/TimeoutQueue.h"
+
 #include <algorithm>
+#include <limits>
 #include <vector>
 
 namespace folly {
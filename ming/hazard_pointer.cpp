@@ -0,0 +1,203 @@
+#include "ming/hazard_pointer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <mutex>
+#include <vector>
+
+#include "ming/likely.h"
+
+namespace ming {
+
+namespace {
+
+inline int lowest_bit(unsigned int v) {
+#if defined(_MSC_VER)
+  unsigned long index;
+  _BitScanForward(&index, v);
+  return static_cast<int>(index);
+#else
+  return __builtin_ctz(v);
+#endif
+}
+
+struct Retired {
+  void* p;
+  hazard_deleter deleter;
+};
+
+// never freed, the records of the exited threads are reused
+struct HazardRecord {
+  std::atomic<void*> slots[kHazardSlotsPerThread];
+  std::atomic<bool> in_use;
+  unsigned int used_slots;  // bitmap, by the owner thread only
+  HazardRecord* next;       // in g_records
+  std::vector<Retired> retired;
+  std::vector<void*> hazards;  // scan buffer
+  char pad[64];
+};
+
+std::atomic<HazardRecord*> g_records(NULL);
+std::atomic<int> g_num_records(0);
+
+std::mutex g_orphans_mutex;
+std::vector<Retired> g_orphans;  // left by the exited threads
+std::atomic<bool> g_has_orphans(false);
+
+HazardRecord* acquire_record() {
+  for (HazardRecord* r = g_records.load(std::memory_order_acquire); r != NULL;
+       r = r->next) {
+    bool expected = false;
+    if (!r->in_use.load(std::memory_order_relaxed) &&
+        r->in_use.compare_exchange_strong(expected, true,
+                                          std::memory_order_acquire)) {
+      return r;
+    }
+  }
+  HazardRecord* r = new HazardRecord;
+  for (int i = 0; i < kHazardSlotsPerThread; i++) {
+    r->slots[i].store(NULL, std::memory_order_relaxed);
+  }
+  r->in_use.store(true, std::memory_order_relaxed);
+  r->used_slots = 0;
+  r->next = g_records.load(std::memory_order_relaxed);
+  while (!g_records.compare_exchange_weak(r->next, r,
+                                          std::memory_order_release,
+                                          std::memory_order_relaxed)) {
+  }
+  g_num_records.fetch_add(1, std::memory_order_relaxed);
+  return r;
+}
+
+// the pointers protected right now, sorted
+void collect_hazards(std::vector<void*>* hazards) {
+  hazards->clear();
+  for (HazardRecord* r = g_records.load(std::memory_order_acquire); r != NULL;
+       r = r->next) {
+    for (int i = 0; i < kHazardSlotsPerThread; i++) {
+      // seq_cst pairs with Protect(), acquire orders the deletes after the
+      // reads of the reader that reset it
+      void* p = r->slots[i].load(std::memory_order_seq_cst);
+      if (p != NULL) {
+        hazards->push_back(p);
+      }
+    }
+  }
+  std::sort(hazards->begin(), hazards->end());
+}
+
+// delete the retired nodes that are not in hazards, keep the others
+void reclaim_list(std::vector<Retired>* retired,
+                  const std::vector<void*>& hazards) {
+  size_t kept = 0;
+  for (size_t i = 0; i < retired->size(); i++) {
+    Retired item = (*retired)[i];
+    if (std::binary_search(hazards.begin(), hazards.end(), item.p)) {
+      (*retired)[kept++] = item;
+    } else {
+      item.deleter(item.p);
+    }
+  }
+  retired->resize(kept);
+}
+
+void reclaim_orphans(const std::vector<void*>& hazards, bool wait) {
+  std::unique_lock<std::mutex> lock(g_orphans_mutex, std::defer_lock);
+  if (wait) {
+    lock.lock();
+  } else if (!lock.try_lock()) {
+    return;
+  }
+  reclaim_list(&g_orphans, hazards);
+  g_has_orphans.store(!g_orphans.empty(), std::memory_order_relaxed);
+}
+
+void scan(HazardRecord* r) {
+  collect_hazards(&r->hazards);
+  reclaim_list(&r->retired, r->hazards);
+  if (g_has_orphans.load(std::memory_order_relaxed)) {
+    reclaim_orphans(r->hazards, false);
+  }
+}
+
+class ThreadRecord {
+ public:
+  ThreadRecord() : record_(NULL) {}
+
+  ~ThreadRecord() {
+    if (record_ == NULL) {
+      return;
+    }
+    scan(record_);
+    if (!record_->retired.empty()) {
+      std::lock_guard<std::mutex> guard(g_orphans_mutex);
+      g_orphans.insert(g_orphans.end(), record_->retired.begin(),
+                       record_->retired.end());
+      g_has_orphans.store(true, std::memory_order_relaxed);
+      record_->retired.clear();
+    }
+    record_->retired.shrink_to_fit();
+    record_->hazards.shrink_to_fit();
+    record_->in_use.store(false, std::memory_order_release);
+    record_ = NULL;
+  }
+
+  HazardRecord* get() {
+    if (UNLIKELY(record_ == NULL)) {
+      record_ = acquire_record();
+    }
+    return record_;
+  }
+
+ private:
+  HazardRecord* record_;
+};
+
+thread_local ThreadRecord t_record;
+
+}  // namespace
+
+namespace hazard_internal {
+
+std::atomic<void*>* acquire_slot() {
+  HazardRecord* r = t_record.get();
+  // more than kHazardSlotsPerThread hazard pointers in a thread is a bug,
+  // a slot past the array would protect nothing
+  if (UNLIKELY((~r->used_slots & ((1U << kHazardSlotsPerThread) - 1)) == 0)) {
+    fprintf(stderr, "more than %d hazard pointers in a thread\n",
+            kHazardSlotsPerThread);
+    abort();
+  }
+  int i = lowest_bit(~r->used_slots);
+  r->used_slots |= 1U << i;
+  return &r->slots[i];
+}
+
+void release_slot(std::atomic<void*>* slot) {
+  HazardRecord* r = t_record.get();
+  r->used_slots &= ~(1U << (slot - r->slots));
+}
+
+}  // namespace hazard_internal
+
+void hazard_retire(void* p, hazard_deleter deleter) {
+  HazardRecord* r = t_record.get();
+  Retired item = {p, deleter};
+  r->retired.push_back(item);
+  size_t threshold = 2 * kHazardSlotsPerThread *
+                     g_num_records.load(std::memory_order_relaxed);
+  if (r->retired.size() >= std::max<size_t>(threshold, kHazardScanThreshold)) {
+    scan(r);
+  }
+}
+
+void hazard_reclaim() {
+  HazardRecord* r = t_record.get();
+  collect_hazards(&r->hazards);
+  reclaim_list(&r->retired, r->hazards);
+  reclaim_orphans(r->hazards, true);
+}
+
+}  // namespace ming
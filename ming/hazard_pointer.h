@@ -0,0 +1,92 @@
+#ifndef MING_HAZARD_POINTER_H_
+#define MING_HAZARD_POINTER_H_
+
+#include <stddef.h>
+
+#include <atomic>
+
+#include "ming/noncopyable.h"
+
+namespace ming {
+
+//-----------------------------------------------------------------------------
+// Hazard pointers, the memory reclamation of lock-free containers.
+//
+// A thread publishes the node it is about to dereference in a hazard
+// pointer; Protect() re-reads the source until the published pointer is
+// still current, so the node cannot have been retired before it became
+// protected. A removed node is hazard_retire()d into a per-thread list. Once
+// the list is longer than twice the number of hazard pointers (at least
+// kHazardScanThreshold) the thread collects all the published pointers and
+// deletes the retired nodes that no one protects, so a scan costs O(1) per
+// retired node. At most a bounded number of nodes wait per thread, unlike
+// epoch based reclamation (ming/epoch.h) a stalled reader only holds back
+// the nodes it protects.
+//
+// Every thread has kHazardSlotsPerThread hazard pointers. A thread that
+// exits hands its retired nodes over to the others.
+//-----------------------------------------------------------------------------
+
+enum { kHazardSlotsPerThread = 8, kHazardScanThreshold = 64 };
+
+typedef void (*hazard_deleter)(void* p);
+
+// delete p with deleter(p) once no hazard pointer protects it, call after p
+// is no longer reachable from the shared data
+void hazard_retire(void* p, hazard_deleter deleter);
+
+template <typename T>
+void hazard_delete(void* p) {
+  delete static_cast<T*>(p);
+}
+
+template <typename T>
+void hazard_retire(T* p) {
+  hazard_retire(p, &hazard_delete<T>);
+}
+
+// delete the nodes retired by this thread and by the exited threads that
+// are not protected. For shutdown and tests.
+void hazard_reclaim();
+
+namespace hazard_internal {
+std::atomic<void*>* acquire_slot();
+void release_slot(std::atomic<void*>* slot);
+}  // namespace hazard_internal
+
+// One of the hazard pointers of the calling thread, released when destroyed.
+class HazardPointer : private noncopyable {
+ public:
+  HazardPointer() : slot_(hazard_internal::acquire_slot()) {}
+
+  ~HazardPointer() {
+    slot_->store(NULL, std::memory_order_release);
+    hazard_internal::release_slot(slot_);
+  }
+
+  // load *src and protect it, the result can be dereferenced until the next
+  // Protect() or Reset() as long as it is only retired after it is removed
+  // from *src
+  template <typename T>
+  T* Protect(const std::atomic<T*>& src) {
+    T* p = src.load(std::memory_order_relaxed);
+    for (;;) {
+      // seq_cst: the store must be visible to the scans before the reload
+      slot_->store(p, std::memory_order_seq_cst);
+      T* current = src.load(std::memory_order_seq_cst);
+      if (current == p) {
+        return p;
+      }
+      p = current;
+    }
+  }
+
+  void Reset() { slot_->store(NULL, std::memory_order_release); }
+
+ private:
+  std::atomic<void*>* slot_;
+};
+
+}  // namespace ming
+
+#endif  // MING_HAZARD_POINTER_H_
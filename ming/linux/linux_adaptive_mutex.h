@@ -0,0 +1,236 @@
+#ifndef MING_LINUX_ADAPTIVE_MUTEX_H_
+#define MING_LINUX_ADAPTIVE_MUTEX_H_
+
+#include <linux/futex.h>
+#include <sched.h>
+#include <stdint.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <atomic>
+
+#include "ming/likely.h"
+#include "ming/noncopyable.h"
+#include "ming/scoped_lock.h"
+
+namespace ming {
+
+namespace adaptive_mutex_internal {
+
+inline void cpu_relax() {
+#if defined(__i386__) || defined(__x86_64__)
+  asm volatile("pause");
+#elif defined(__aarch64__)
+  asm volatile("yield");
+#else
+  asm volatile("" ::: "memory");
+#endif
+}
+
+inline int* futex_word(std::atomic<int>* word) {
+  return reinterpret_cast<int*>(word);
+}
+
+inline void futex_wait(std::atomic<int>* word, int value) {
+  ::syscall(SYS_futex, futex_word(word), FUTEX_WAIT_PRIVATE, value, NULL, NULL,
+            0);
+}
+
+inline void futex_wake(std::atomic<int>* word, int count) {
+  ::syscall(SYS_futex, futex_word(word), FUTEX_WAKE_PRIVATE, count, NULL, NULL,
+            0);
+}
+
+// spin about max_pauses pauses, doubling the pause count after every failed
+// try, return true once ready() holds
+template <typename Predicate>
+inline bool spin_until(int max_pauses, Predicate ready) {
+  enum { kMaxBackoff = 64 };
+  int backoff = 1;
+  for (int spun = 0; spun < max_pauses; spun += backoff) {
+    if (ready()) {
+      return true;
+    }
+    for (int i = 0; i < backoff; i++) {
+      cpu_relax();
+    }
+    if (backoff < kMaxBackoff) {
+      backoff <<= 1;
+    }
+  }
+  return ready();
+}
+
+}  // namespace adaptive_mutex_internal
+
+// A mutex that spins for a bounded time with exponential backoff, then parks
+// the thread on a futex, unlike SpinLock which burns the whole timeslice when
+// the holder is preempted. Short critical sections get the latency of a spin
+// lock, long or oversubscribed ones do not waste the CPU. Not fair.
+class AdaptiveMutex : private noncopyable {
+ public:
+  typedef ming::ScopedLock<AdaptiveMutex> ScopedLock;
+
+  AdaptiveMutex() : state_(kUnlocked) {}
+
+  void Lock() {
+    int expected = kUnlocked;
+    if (LIKELY(state_.compare_exchange_strong(expected, kLocked,
+                                              std::memory_order_acquire,
+                                              std::memory_order_relaxed))) {
+      return;
+    }
+    LockSlow();
+  }
+
+  bool TryLock() {
+    int expected = kUnlocked;
+    return state_.compare_exchange_strong(expected, kLocked,
+                                          std::memory_order_acquire,
+                                          std::memory_order_relaxed);
+  }
+
+  void Unlock() {
+    if (UNLIKELY(state_.exchange(kUnlocked, std::memory_order_release) ==
+                 kContended)) {
+      adaptive_mutex_internal::futex_wake(&state_, 1);
+    }
+  }
+
+ private:
+  // kContended: locked and there may be parked threads
+  enum { kUnlocked = 0, kLocked = 1, kContended = 2 };
+  enum { kSpinPauses = 1024 };
+
+  void LockSlow() {
+    bool acquired = adaptive_mutex_internal::spin_until(kSpinPauses, [this]() {
+      int expected = kUnlocked;
+      return state_.load(std::memory_order_relaxed) == kUnlocked &&
+             state_.compare_exchange_weak(expected, kLocked,
+                                          std::memory_order_acquire,
+                                          std::memory_order_relaxed);
+    });
+    if (acquired) {
+      return;
+    }
+    // taken as kContended from here on, as other threads may be parked too
+    while (state_.exchange(kContended, std::memory_order_acquire) !=
+           kUnlocked) {
+      adaptive_mutex_internal::futex_wait(&state_, kContended);
+    }
+  }
+
+  std::atomic<int> state_;
+};
+
+// A fair MCS queue lock for highly contended critical sections. Each waiter
+// spins on its own queue node, so a release touches the cache line of the
+// next waiter only, and the lock is granted in FIFO order. A waiter parks on
+// a futex after spinning for a while.
+//
+// The queue nodes are per thread, a thread can hold up to kMaxHeld McsLocks
+// at the same time. Unlock() must be called by the thread that locked.
+class McsLock : private noncopyable {
+ public:
+  typedef ming::ScopedLock<McsLock> ScopedLock;
+
+  enum { kMaxHeld = 32 };
+
+  McsLock() : tail_(NULL), owner_(NULL) {}
+
+  void Lock() {
+    Node* node = AllocNode();
+    node->next.store(NULL, std::memory_order_relaxed);
+    node->state.store(kWaiting, std::memory_order_relaxed);
+    Node* prev = tail_.exchange(node, std::memory_order_acq_rel);
+    if (prev != NULL) {
+      bool spin = prev->state.load(std::memory_order_relaxed) != kParked;
+      prev->next.store(node, std::memory_order_release);
+      Wait(node, spin);
+    }
+    owner_ = node;
+  }
+
+  void Unlock() {
+    Node* node = owner_;
+    Node* next = node->next.load(std::memory_order_acquire);
+    if (next == NULL) {
+      Node* expected = node;
+      if (tail_.compare_exchange_strong(expected, NULL,
+                                        std::memory_order_release,
+                                        std::memory_order_relaxed)) {
+        FreeNode(node);
+        return;
+      }
+      // a waiter swapped the tail, wait for it to link itself; it may have
+      // been preempted right in between
+      while (!adaptive_mutex_internal::spin_until(kSpinPauses, [&]() {
+        return (next = node->next.load(std::memory_order_acquire)) != NULL;
+      })) {
+        ::sched_yield();
+      }
+    }
+    if (next->state.exchange(kGranted, std::memory_order_release) == kParked) {
+      adaptive_mutex_internal::futex_wake(&next->state, 1);
+    }
+    FreeNode(node);
+  }
+
+ private:
+  enum { kWaiting = 0, kGranted = 1, kParked = 2 };
+  enum { kSpinPauses = 256 };
+
+  struct alignas(64) Node {
+    std::atomic<Node*> next;
+    std::atomic<int> state;
+  };
+
+  struct NodePool {
+    Node nodes[kMaxHeld];
+    uint32_t used;  // bitmap of nodes
+  };
+
+  static NodePool* ThreadNodePool() {
+    static thread_local NodePool pool;  // zero initialized
+    return &pool;
+  }
+
+  static Node* AllocNode() {
+    NodePool* pool = ThreadNodePool();
+    int i = __builtin_ctz(~pool->used);  // more than kMaxHeld held is a bug
+    pool->used |= 1U << i;
+    return &pool->nodes[i];
+  }
+
+  static void FreeNode(Node* node) {
+    NodePool* pool = ThreadNodePool();
+    pool->used &= ~(1U << (node - pool->nodes));
+  }
+
+  // Spin only while the waiter ahead is not parked, and not for long: the
+  // grant needs the holder and every waiter ahead to run, which may take
+  // whole timeslices when the cpus are oversubscribed.
+  static void Wait(Node* node, bool spin) {
+    if (spin && adaptive_mutex_internal::spin_until(kSpinPauses, [node]() {
+          return node->state.load(std::memory_order_acquire) == kGranted;
+        })) {
+      return;
+    }
+    int expected = kWaiting;
+    if (!node->state.compare_exchange_strong(expected, kParked,
+                                             std::memory_order_acquire,
+                                             std::memory_order_acquire)) {
+      return;  // granted in between
+    }
+    while (node->state.load(std::memory_order_acquire) != kGranted) {
+      adaptive_mutex_internal::futex_wait(&node->state, kParked);
+    }
+  }
+
+  std::atomic<Node*> tail_;
+  Node* owner_;  // written and read by the lock holder only
+};
+
+}  // namespace ming
+
+#endif  // MING_LINUX_ADAPTIVE_MUTEX_H_
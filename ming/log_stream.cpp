@@ -1,38 +1,31 @@
 #include "ming/log_stream.h"
 
-#include <limits>
-#include <stdio.h>
+#include <math.h>
 #include <stdint.h>
-#include <algorithm>
+#include <limits>
+
+#include "ming/likely.h"
+#include "ming/number_to_string.h"
 
 namespace ming {
 
-static const char digits[] = "9876543210123456789";
-static const char* zero = digits + 9;
 static const char digits_hex[] = "0123456789ABCDEF";
 
+// u64toa/i64toa are the branch-LUT converters from number_to_string.cpp,
+// they write the digits forward so no reverse is needed.
 template <typename T>
 int format_int(char buf[], T value) {
-  T i = value;
-  char* p = buf;
-
-  do {
-    int lsd = static_cast<int>(i % 10);
-    i /= 10;
-    *p++ = zero[lsd];
-  } while (i != 0);
-
-  if (value < 0) {
-    *p++ = '-';
+  if (std::numeric_limits<T>::is_signed && value < 0) {
+    // negate in unsigned arithmetic so that INT64_MIN does not overflow
+    buf[0] = '-';
+    return 1 + u64toa(0 - static_cast<uint64_t>(value), buf + 1);
   }
-  *p = '\0';
-  std::reverse(buf, p);
-
-  return p - buf;
+  return u64toa(static_cast<uint64_t>(value), buf);
 }
 
 // Explicit Instantiation
 template int format_int(char buf[], char value);
+template int format_int(char buf[], signed char value);
 template int format_int(char buf[], unsigned char value);
 template int format_int(char buf[], short value);
 template int format_int(char buf[], unsigned short value);
@@ -43,23 +36,114 @@ template int format_int(char buf[], unsigned long value);
 template int format_int(char buf[], long long value);
 template int format_int(char buf[], unsigned long long value);
 
-int format_pointer_hex(char buf[], void* value) {
-  uintptr_t i = reinterpret_cast<uintptr_t>(value);
-  char* p = buf;
-  do {
-    int lsd = i % 16;
-    i /= 16;
-    *p++ = digits_hex[lsd];
-  } while (i != 0);
+int format_hex(char buf[], uint64_t value, int min_digits) {
+  int digits = 1;
+  for (uint64_t i = value >> 4; i != 0; i >>= 4) {
+    digits++;
+  }
+  if (digits < min_digits) {
+    digits = min_digits;
+  }
 
+  char* p = buf + digits;
   *p = '\0';
-  std::reverse(buf, p);
+  do {
+    *--p = digits_hex[value & 0x0f];
+    value >>= 4;
+  } while (p != buf);
+
+  return digits;
+}
 
-  return p - buf;
+int format_pointer_hex(char buf[], const void* value) {
+  return format_hex(buf, reinterpret_cast<uintptr_t>(value), 0);
+}
+
+static int format_non_finite(char buf[], double value) {
+  const char* s;
+  if (isnan(value)) {
+    s = "nan";
+  } else if (value < 0) {
+    s = "-inf";
+  } else {
+    s = "inf";
+  }
+  int len = static_cast<int>(strlen(s));
+  memcpy(buf, s, len + 1);
+  return len;
 }
 
 int format_double(char buf[], double value) {
-  return sprintf(buf, "%.12g", value);
+  if (UNLIKELY(!isfinite(value))) {
+    return format_non_finite(buf, value);
+  }
+  return dtoa(value, buf);
+}
+
+int format_fixed(char buf[], double value, int precision) {
+  static const uint64_t kPow10[] = {1,      10,      100,      1000,
+                                    10000,  100000,  1000000,  10000000,
+                                    100000000, 1000000000};
+  if (precision < 0) {
+    precision = 0;
+  } else if (precision > 9) {
+    precision = 9;
+  }
+
+  if (UNLIKELY(!isfinite(value))) {
+    return format_non_finite(buf, value);
+  }
+
+  // value * 10^precision has to fit in an uint64_t, fall back to the
+  // shortest representation for the huge values
+  double abs_value = fabs(value);
+  if (UNLIKELY(abs_value >= 1.8e19 / kPow10[precision])) {
+    return dtoa(value, buf);
+  }
+
+  char* p = buf;
+  if (signbit(value)) {
+    *p++ = '-';
+  }
+  uint64_t scaled =
+      static_cast<uint64_t>(abs_value * kPow10[precision] + 0.5);
+  p += u64toa(scaled / kPow10[precision], p);
+  if (precision > 0) {
+    *p++ = '.';
+    uint64_t frac = scaled % kPow10[precision];
+    for (int i = precision - 1; i >= 0; i--) {
+      p[i] = static_cast<char>('0' + frac % 10);
+      frac /= 10;
+    }
+    p += precision;
+  }
+  *p = '\0';
+  return static_cast<int>(p - buf);
+}
+
+int format_pad(char buf[], int len, int width, char fill) {
+  bool left_align = width < 0;
+  if (left_align) {
+    width = -width;
+  }
+  if (width > kMaxPadWidth) {
+    width = kMaxPadWidth;
+  }
+  if (len >= width) {
+    return len;
+  }
+
+  int n = width - len;
+  if (left_align) {
+    memset(buf + len, fill, n);
+  } else {
+    // "-42" -> "-0042", the sign stays in front of the zeros
+    int sign = (fill == '0' && buf[0] == '-') ? 1 : 0;
+    memmove(buf + sign + n, buf + sign, len - sign);
+    memset(buf + sign, fill, n);
+  }
+  buf[width] = '\0';
+  return width;
 }
 
 }  // namespace ming
@@ -1,8 +1,12 @@
 #ifndef MING_LOGSTREAM_H_
 #define MING_LOGSTREAM_H_
 
+#include <stdint.h>
 #include <string.h>
 #include <string>
+#include <type_traits>
+
+#include "ming/buffer.h"
 
 namespace ming {
 
@@ -53,17 +57,71 @@ class FixedBuffer {
   char data_[SIZE];
 };
 
+// The format_* functions write at most kMaxNumericSize bytes (including the
+// terminating '\0') and return the length without the '\0'.
 template <typename T>
 int format_int(char buf[], T value);
-int format_pointer_hex(char buf[], void* value);
+int format_pointer_hex(char buf[], const void* value);
+// upper case, at least min_digits digits (zero padded)
+int format_hex(char buf[], uint64_t value, int min_digits);
+// shortest representation that round-trips (Grisu2)
 int format_double(char buf[], double value);
+// fixed notation with 0-9 digits after the decimal point
+int format_fixed(char buf[], double value, int precision);
+// right-align the len bytes at buf to width, the sign of a zero padded
+// number stays in front. A negative width left-aligns.
+int format_pad(char buf[], int len, int width, char fill);
 
 const int kMaxNumericSize = 32;
+const int kMaxPadWidth = 64;
+
+// Stream manipulators. They only carry the value and the format to
+// LogStream::operator<<, nothing goes through printf:
+//
+//   stream << ming::hex(msg_id, 16) << ming::fixed(ratio, 2)
+//          << ming::pad(seq, 6, '0');
+struct HexFormat {
+  uint64_t value;
+  int width;  // minimum digits, zero padded
+};
+inline HexFormat hex(uint64_t value, int width = 0) {
+  HexFormat f = {value, width};
+  return f;
+}
+
+struct FixedFormat {
+  double value;
+  int precision;
+  int width;  // minimum width, space padded
+};
+inline FixedFormat fixed(double value, int precision, int width = 0) {
+  FixedFormat f = {value, precision, width};
+  return f;
+}
+
+template <typename T>
+struct PadFormat {
+  T value;
+  int width;  // negative to left-align
+  char fill;
+};
+template <typename T>
+inline PadFormat<T> pad(T value, int width, char fill = ' ') {
+  PadFormat<T> f = {value, width, fill};
+  return f;
+}
+
 const int kLogStreamDefaultBufferSize = 1024 * 4;
-template <int SIZE = kLogStreamDefaultBufferSize>
+const int kLogStreamInlineSize = 512;
+
+// BufferType is the buffer policy: FixedBuffer<SIZE> keeps everything in
+// SIZE bytes and drops what does not fit, ChainBuffer<SIZE> (ming/buffer.h)
+// keeps SIZE bytes inline and spills the rest into pooled blocks.
+template <int SIZE = kLogStreamDefaultBufferSize,
+          typename BufferType = FixedBuffer<SIZE> >
 class LogStream {
  public:
-  typedef FixedBuffer<SIZE> Buffer;
+  typedef BufferType Buffer;
   LogStream() {}
 
   const char* c_str() const { return buffer_.c_str(); }
@@ -73,6 +131,11 @@ class LogStream {
   void commit(int len) { buffer_.commit(len); }
   void append(const char* data, int len) { buffer_.append(data, len); }
   Buffer& buffer() { return buffer_; }
+  // ChainBuffer only: scatter/gather export without copying
+  int to_iovec(struct iovec* iov, int max) const {
+    return buffer_.to_iovec(iov, max);
+  }
+  int iovec_count() const { return buffer_.iovec_count(); }
   void reset() { buffer_.reset(); }
   bool overflow() { return buffer_.overflow(); }
 
@@ -154,7 +217,7 @@ class LogStream {
   LogStream& operator<<(double v) {
     char* buf = buffer_.reserve(kMaxNumericSize);
     if (buf == 0) {
-      return;
+      return *this;
     }
 
     int len = format_double(buf, v);
@@ -167,6 +230,44 @@ class LogStream {
     return *this;
   }
 
+  LogStream& operator<<(const HexFormat& f) {
+    int width = f.width < kMaxPadWidth ? f.width : kMaxPadWidth;
+    char* buf = buffer_.reserve(kMaxNumericSize + width);
+    if (buf == 0) {
+      return *this;
+    }
+
+    int len = format_hex(buf, f.value, width);
+    buffer_.commit(len);
+    return *this;
+  }
+
+  LogStream& operator<<(const FixedFormat& f) {
+    char* buf = buffer_.reserve(kMaxNumericSize + kMaxPadWidth);
+    if (buf == 0) {
+      return *this;
+    }
+
+    int len = format_fixed(buf, f.value, f.precision);
+    len = format_pad(buf, len, f.width, ' ');
+    buffer_.commit(len);
+    return *this;
+  }
+
+  template <typename T>
+  LogStream& operator<<(const PadFormat<T>& f) {
+    static_assert(std::is_integral<T>::value, "ming::pad takes integers");
+    char* buf = buffer_.reserve(kMaxNumericSize + kMaxPadWidth);
+    if (buf == 0) {
+      return *this;
+    }
+
+    int len = format_int(buf, f.value);
+    len = format_pad(buf, len, f.width, f.fill);
+    buffer_.commit(len);
+    return *this;
+  }
+
  private:
   template <typename T>
   void format_integer(T v) {
@@ -183,6 +284,11 @@ class LogStream {
   Buffer buffer_;
 };
 
+// Small records stay in the inline buffer on the stack, large ones are
+// kept whole in a chain of pooled blocks instead of being truncated.
+typedef LogStream<kLogStreamInlineSize, ChainBuffer<kLogStreamInlineSize> >
+    GrowableLogStream;
+
 #define LOGSTREAM_APPEND_CONST_STRING(stream, const_str) \
   {                                                      \
     const char* warn_if_not_a_const_str = const_str "";  \
@@ -0,0 +1,120 @@
+#ifndef MING_MPMC_QUEUE_H_
+#define MING_MPMC_QUEUE_H_
+
+#include <stddef.h>
+
+#include <atomic>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include "ming/hazard_pointer.h"
+#include "ming/noncopyable.h"
+
+namespace ming {
+
+// An unbounded multiple producers and multiple consumers lock-free queue,
+// the Michael & Scott queue with hazard pointers.
+//
+// Unlike RingBuffer it never fills up: every Push() allocates a node, the
+// popped nodes are retired with hazard_retire() and deleted once no thread
+// protects them, which also rules out the ABA problem of the CAS on head_
+// and tail_. Push() uses one hazard pointer of the thread, Pop() two.
+template <typename T>
+class MpmcQueue : private noncopyable {
+ public:
+  MpmcQueue() {
+    Node* dummy = new Node;
+    head_.store(dummy, std::memory_order_relaxed);
+    tail_.store(dummy, std::memory_order_relaxed);
+  }
+
+  // no other thread may use the queue any more
+  ~MpmcQueue() {
+    Node* node = head_.load(std::memory_order_relaxed);
+    Node* next = node->next.load(std::memory_order_relaxed);
+    delete node;  // the dummy, no value
+    while (next != NULL) {
+      node = next;
+      next = node->next.load(std::memory_order_relaxed);
+      node->value()->~T();
+      delete node;
+    }
+  }
+
+  template <class... Args>
+  void Push(Args&&... args) {
+    Node* node = new Node;
+    new (node->value()) T(std::forward<Args>(args)...);
+    HazardPointer hazard;
+    for (;;) {
+      Node* tail = hazard.Protect(tail_);
+      Node* next = tail->next.load(std::memory_order_acquire);
+      if (tail != tail_.load(std::memory_order_acquire)) {
+        continue;
+      }
+      if (next != NULL) {
+        // help the push that linked next to move the tail
+        tail_.compare_exchange_weak(tail, next);
+        continue;
+      }
+      if (tail->next.compare_exchange_weak(next, node)) {
+        tail_.compare_exchange_strong(tail, node);
+        return;
+      }
+    }
+  }
+
+  bool Pop(T& item) {
+    HazardPointer head_hazard;
+    HazardPointer next_hazard;
+    for (;;) {
+      Node* head = head_hazard.Protect(head_);
+      Node* tail = tail_.load(std::memory_order_acquire);
+      Node* next = next_hazard.Protect(head->next);
+      if (head != head_.load(std::memory_order_acquire)) {
+        continue;
+      }
+      if (next == NULL) {
+        return false;  // queue is empty
+      }
+      if (head == tail) {
+        // the tail lags behind a push in progress
+        tail_.compare_exchange_weak(tail, next);
+        continue;
+      }
+      if (head_.compare_exchange_weak(head, next)) {
+        // next is the new dummy, only the winner of the CAS moves its value
+        item = std::move(*next->value());
+        next->value()->~T();
+        head_hazard.Reset();
+        hazard_retire(head);
+        return true;
+      }
+    }
+  }
+
+  bool Empty() const {
+    HazardPointer hazard;
+    Node* head = hazard.Protect(head_);
+    return head->next.load(std::memory_order_acquire) == NULL;
+  }
+
+ private:
+  struct Node {
+    Node() : next(NULL) {}
+    T* value() { return reinterpret_cast<T*>(&storage); }
+
+    std::atomic<Node*> next;
+    // constructed by Push(), destroyed by Pop(), none in the dummy node
+    typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+  };
+
+  std::atomic<Node*> head_;
+  char pad_[64 - sizeof(std::atomic<Node*>)];
+  std::atomic<Node*> tail_;
+};
+
+}  // namespace ming
+
+#endif  // MING_MPMC_QUEUE_H_
@@ -1,5 +1,5 @@
-#ifndef MING_HASH_H_
-#define MING_HASH_H_
+#ifndef MING_NONCOPYABLE_H_
+#define MING_NONCOPYABLE_H_
 
 namespace ming {
 
@@ -17,4 +17,4 @@ class noncopyable {
 
 using ming::noncopyable;
 
-#endif  // MING_HASH_H_
+#endif  // MING_NONCOPYABLE_H_
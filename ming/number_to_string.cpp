@@ -698,13 +698,15 @@ inline int dtoa_milo(double value, char* buffer) {
     buffer[3] = '\0';
     return 3;
   } else {
+    int sign = 0;
     if (value < 0) {
       *buffer++ = '-';
       value = -value;
+      sign = 1;
     }
     int length, K;
     Grisu2(value, buffer, &length, &K);
-    return Prettify(buffer, length, K);
+    return sign + Prettify(buffer, length, K);
   }
 }
 
@@ -6,6 +6,7 @@
 #if (_MSC_VER >= 1700)
 // c++ 11 RWSpinLock from folly
 #include "ming/folly/RWSpinLock.h"
+#include "ming/distributed_rw_lock.h"
 #endif
 #elif defined(__GNUC__)
 // GNU C++
@@ -13,6 +14,7 @@
 #if (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 7))
 // c++ 11 RWSpinLock from folly
 #include "ming/folly/RWSpinLock.h"
+#include "ming/distributed_rw_lock.h"
 #endif
 #else
 #error "Support Windows and Linux platform Only!"
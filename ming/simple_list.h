@@ -444,4 +444,25 @@ static inline int list_empty(const struct list_head *head) {
   return head->next == head;
 }
 
+/**
+ * list_splice_tail_init - join two lists and reinitialise the emptied list
+ * @list: the new list to add.
+ * @head: the place to add it in the first list.
+ *
+ * Each of the lists is a queue, @list is added before @head.
+ */
+static inline void list_splice_tail_init(struct list_head *list,
+                                         struct list_head *head) {
+  if (!list_empty(list)) {
+    struct list_head *first = list->next;
+    struct list_head *last = list->prev;
+    struct list_head *at = head->prev;
+    first->prev = at;
+    at->next = first;
+    last->next = head;
+    head->prev = last;
+    INIT_LIST_HEAD(list);
+  }
+}
+
 #endif  // SIMPLE_LIST_
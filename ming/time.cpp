@@ -0,0 +1,226 @@
+#include "ming/time.h"
+
+#if defined(MING_CPLUSPLUS_11_CHRONO)
+
+#include <math.h>
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <cpuid.h>
+#endif
+#if defined(__linux__)
+#include <sched.h>
+#endif
+
+namespace ming {
+
+namespace detail {
+TscClock g_tsc_clock = {{false}, 0, 0, 0, 0};
+std::atomic<int64_t> g_wall_offset_ns(0);
+std::atomic<uint64_t> g_coarse_microseconds(0);
+}  // namespace detail
+
+namespace {
+
+const uint32_t kTscShift = 32;
+// two calibration rounds must agree within 100 ppm
+const double kTscMaxSkew = 0.0001;
+const int kCalibrationMilliseconds = 10;
+// the TSCs of two CPUs may differ by less than a thread takes to migrate
+const uint64_t kTscMaxOffsetNs = 1000;
+
+bool cpu_has_invariant_tsc() {
+#if defined(_MSC_VER)
+  int info[4];
+  __cpuid(info, 0x80000000);
+  if (static_cast<unsigned int>(info[0]) < 0x80000007) {
+    return false;
+  }
+  __cpuid(info, 0x80000007);
+  return (info[3] & (1 << 8)) != 0;
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+  unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+  if (__get_cpuid_max(0x80000000, 0) < 0x80000007) {
+    return false;
+  }
+  __get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx);
+  return (edx & (1 << 8)) != 0;
+#else
+  return false;
+#endif
+}
+
+int64_t wall_offset_ns() {
+  using namespace std::chrono;
+  // read the steady clock on both sides to bound the error
+  uint64_t before = monotonic_nanoseconds();
+  int64_t wall =
+      duration_cast<nanoseconds>(system_clock::now().time_since_epoch())
+          .count();
+  uint64_t after = monotonic_nanoseconds();
+  return wall - static_cast<int64_t>(before + (after - before) / 2);
+}
+
+// ticks per nanosecond measured over kCalibrationMilliseconds
+double measure_tsc_rate(uint64_t* tsc_end, uint64_t* ns_end) {
+  uint64_t ns0 = detail::steady_nanoseconds();
+  uint64_t tsc0 = detail::read_tsc();
+  std::this_thread::sleep_for(
+      std::chrono::milliseconds(kCalibrationMilliseconds));
+  uint64_t ns1 = detail::steady_nanoseconds();
+  uint64_t tsc1 = detail::read_tsc();
+  *tsc_end = tsc1;
+  *ns_end = ns1;
+  if (tsc1 <= tsc0 || ns1 <= ns0) {
+    return 0;
+  }
+  return static_cast<double>(tsc1 - tsc0) / static_cast<double>(ns1 - ns0);
+}
+
+#if defined(__linux__)
+// Read the TSC on every CPU this thread may run on and check that it
+// converts to the steady clock time read around it. The sockets of a host
+// can tick at the same rate from different offsets, which the rate
+// calibration does not see.
+bool tsc_synchronized(const detail::TscClock& c) {
+  cpu_set_t allowed;
+  if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+    return false;
+  }
+  bool synchronized = true;
+  for (int cpu = 0; cpu < CPU_SETSIZE && synchronized; cpu++) {
+    if (!CPU_ISSET(cpu, &allowed)) {
+      continue;
+    }
+    cpu_set_t one;
+    CPU_ZERO(&one);
+    CPU_SET(cpu, &one);
+    if (sched_setaffinity(0, sizeof(one), &one) != 0) {
+      synchronized = false;
+      break;
+    }
+    // an interrupt between the reads widens the window, try again
+    synchronized = false;
+    for (int i = 0; i < 3 && !synchronized; i++) {
+      uint64_t before = detail::steady_nanoseconds();
+      uint64_t ns = detail::tsc_to_nanoseconds(c, detail::read_tsc());
+      uint64_t after = detail::steady_nanoseconds();
+      // plus the drift the calibration allows since base_ns
+      uint64_t slack = kTscMaxOffsetNs + static_cast<uint64_t>(
+                           (before - c.base_ns) * kTscMaxSkew);
+      synchronized = ns + slack >= before && ns <= after + slack;
+    }
+  }
+  sched_setaffinity(0, sizeof(allowed), &allowed);
+  return synchronized;
+}
+#else
+bool tsc_synchronized(const detail::TscClock&) { return true; }
+#endif
+
+std::mutex g_ticker_mutex;
+std::condition_variable g_ticker_cond;
+std::thread g_ticker;
+bool g_ticker_running = false;
+
+void ticker_thread(uint32_t resolution_us) {
+  uint64_t last_resync = 0;
+  std::unique_lock<std::mutex> lock(g_ticker_mutex);
+  while (g_ticker_running) {
+    uint64_t now = microseconds_since_epoch();
+    detail::g_coarse_microseconds.store(now, std::memory_order_relaxed);
+    if (now - last_resync >= USEC_PER_SEC) {
+      // follow NTP adjustments of the wall clock
+      detail::g_wall_offset_ns.store(wall_offset_ns(),
+                                     std::memory_order_relaxed);
+      last_resync = now;
+    }
+    g_ticker_cond.wait_for(lock, std::chrono::microseconds(resolution_us));
+  }
+  // readers fall back to the system clock
+  detail::g_coarse_microseconds.store(0, std::memory_order_relaxed);
+}
+
+}  // namespace
+
+namespace detail {
+int64_t init_wall_offset_ns() {
+  int64_t offset = wall_offset_ns();
+  int64_t expected = 0;
+  // tsc_clock_init() or the ticker may have been faster
+  if (!g_wall_offset_ns.compare_exchange_strong(expected, offset,
+                                                std::memory_order_relaxed)) {
+    return expected;
+  }
+  return offset;
+}
+}  // namespace detail
+
+bool tsc_clock_init() {
+  static std::mutex init_mutex;
+  std::lock_guard<std::mutex> guard(init_mutex);
+  if (tsc_clock_enabled()) {
+    return true;
+  }
+
+  bool usable = cpu_has_invariant_tsc();
+  uint64_t tsc = 0, ns = 0;
+  double rate = 0;
+  if (usable) {
+    double rate1 = measure_tsc_rate(&tsc, &ns);
+    double rate2 = measure_tsc_rate(&tsc, &ns);
+    // an unstable TSC (frequency scaling, a VM migrating between hosts)
+    // shows up as a rate mismatch
+    usable = rate1 > 0 && rate2 > 0 &&
+             fabs(rate1 - rate2) / rate2 < kTscMaxSkew;
+    rate = (rate1 + rate2) / 2;
+  }
+
+  detail::TscClock& c = detail::g_tsc_clock;
+  if (usable) {
+    c.base_tsc = tsc;
+    c.base_ns = ns;
+    c.shift = kTscShift;
+    c.mult = static_cast<uint64_t>((1ULL << kTscShift) / rate);
+    usable = tsc_synchronized(c);
+  }
+  if (usable) {
+    c.enabled.store(true, std::memory_order_release);
+  }
+  detail::g_wall_offset_ns.store(wall_offset_ns(), std::memory_order_relaxed);
+  return usable;
+}
+
+bool coarse_clock_start(uint32_t resolution_us) {
+  std::lock_guard<std::mutex> guard(g_ticker_mutex);
+  if (g_ticker_running) {
+    return true;
+  }
+  if (resolution_us == 0) {
+    resolution_us = 1;
+  }
+  detail::g_coarse_microseconds.store(microseconds_since_epoch(),
+                                      std::memory_order_relaxed);
+  g_ticker_running = true;
+  g_ticker = std::thread(ticker_thread, resolution_us);
+  return true;
+}
+
+void coarse_clock_stop() {
+  {
+    std::lock_guard<std::mutex> guard(g_ticker_mutex);
+    if (!g_ticker_running) {
+      return;
+    }
+    g_ticker_running = false;
+  }
+  g_ticker_cond.notify_one();
+  g_ticker.join();
+}
+
+}  // namespace ming
+
+#endif  // MING_CPLUSPLUS_11_CHRONO
@@ -1,7 +1,7 @@
 #ifndef MING_TIME_H_
 #define MING_TIME_H_
 
-#if _MSC_VER < 1600
+#if defined(_MSC_VER) && _MSC_VER < 1600
 typedef unsigned long long uint64_t;
 #else
 #include <stdint.h>
@@ -128,4 +128,133 @@ inline uint32_t seconds_since_epoch(void) {
 
 #endif
 
+//-----------------------------------------------------------------------------
+// Clock subsystem
+//
+// monotonic_nanoseconds() reads the TSC and converts it with a multiply and
+// a shift once tsc_clock_init() has calibrated it against CLOCK_MONOTONIC.
+// TSC is only used if the CPU reports an invariant TSC, two calibration
+// rounds agree and, on Linux, the TSC of every CPU the process may run on
+// reads the same time within a microsecond, less than a thread takes to
+// migrate. Otherwise it falls back to std::chrono::steady_clock. Elsewhere
+// the TSCs of the CPUs are assumed to be synchronized, which multi-socket
+// hosts do not always guarantee.
+//
+// The coarse clock is a timestamp refreshed by a background ticker thread
+// (coarse_clock_start()), so reading it is a single relaxed atomic load.
+// Use it where a few milliseconds of error do not matter, e.g. rate limits
+// and statistics. Before the ticker is started it reads the system clock.
+//-----------------------------------------------------------------------------
+#if defined(MING_CPLUSPLUS_11_CHRONO)
+#include <atomic>
+#include "ming/likely.h"
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace ming {
+
+namespace detail {
+struct TscClock {
+  std::atomic<bool> enabled;
+  uint64_t base_tsc;
+  uint64_t base_ns;  // steady clock nanoseconds at base_tsc
+  uint64_t mult;     // nanoseconds per tick << shift
+  uint32_t shift;
+};
+extern TscClock g_tsc_clock;
+// steady clock nanoseconds + wall_offset = nanoseconds since the epoch, 0
+// until it is first measured
+extern std::atomic<int64_t> g_wall_offset_ns;
+int64_t init_wall_offset_ns();
+extern std::atomic<uint64_t> g_coarse_microseconds;
+
+inline uint64_t steady_nanoseconds() {
+  using namespace std::chrono;
+  return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch())
+      .count();
+}
+
+inline uint64_t tsc_to_nanoseconds(const TscClock &c, uint64_t tsc) {
+  uint64_t delta = tsc - c.base_tsc;
+#if defined(__SIZEOF_INT128__)
+  return c.base_ns +
+         static_cast<uint64_t>(
+             (static_cast<unsigned __int128>(delta) * c.mult) >> c.shift);
+#else
+  // split to avoid overflowing 64 bits
+  uint64_t hi = (delta >> 32) * c.mult;
+  uint64_t lo = (delta & 0xffffffff) * c.mult;
+  return c.base_ns + (hi << (32 - c.shift)) + (lo >> c.shift);
+#endif
+}
+
+inline uint64_t read_tsc() {
+#if defined(_MSC_VER)
+  return __rdtsc();
+#elif defined(__x86_64__) || defined(__i386__)
+  return __builtin_ia32_rdtsc();
+#else
+  return 0;
+#endif
+}
+}  // namespace detail
+
+// Calibrate the TSC clock. It takes about 20 milliseconds, call it once at
+// startup. Return false if TSC is not reliable on this machine.
+bool tsc_clock_init();
+inline bool tsc_clock_enabled() {
+  return detail::g_tsc_clock.enabled.load(std::memory_order_acquire);
+}
+
+/* nanoseconds since an unspecified point, never goes backwards */
+inline uint64_t monotonic_nanoseconds(void) {
+  const detail::TscClock &c = detail::g_tsc_clock;
+  if (LIKELY(c.enabled.load(std::memory_order_acquire))) {
+    return detail::tsc_to_nanoseconds(c, detail::read_tsc());
+  }
+  return detail::steady_nanoseconds();
+}
+
+inline uint64_t monotonic_microseconds(void) {
+  return monotonic_nanoseconds() / NSEC_PER_USEC;
+}
+
+/* convert a monotonic_nanoseconds() value to microseconds since the epoch */
+inline uint64_t monotonic_to_wall_microseconds(uint64_t monotonic_ns) {
+  int64_t offset = detail::g_wall_offset_ns.load(std::memory_order_relaxed);
+  if (UNLIKELY(offset == 0)) {  // neither tsc_clock_init() nor the ticker ran
+    offset = detail::init_wall_offset_ns();
+  }
+  return (monotonic_ns + offset) / NSEC_PER_USEC;
+}
+
+// Start the ticker thread refreshing the coarse clock every resolution_us
+// microseconds. It also resyncs the wall clock offset once per second.
+bool coarse_clock_start(uint32_t resolution_us = 1000);
+void coarse_clock_stop();
+
+inline uint64_t coarse_microseconds_since_epoch(void) {
+  uint64_t now =
+      detail::g_coarse_microseconds.load(std::memory_order_relaxed);
+  if (UNLIKELY(now == 0)) {  // ticker not running
+    return microseconds_since_epoch();
+  }
+  return now;
+}
+
+inline uint64_t coarse_milliseconds_since_epoch(void) {
+  return coarse_microseconds_since_epoch() / USEC_PER_MSEC;
+}
+
+inline uint32_t coarse_seconds_since_epoch(void) {
+  return static_cast<uint32_t>(coarse_microseconds_since_epoch() /
+                               USEC_PER_SEC);
+}
+
+}  // namespace ming
+
+#endif  // MING_CPLUSPLUS_11_CHRONO
+
 #endif  // MING_TIME_H_
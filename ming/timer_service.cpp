@@ -0,0 +1,423 @@
+#include "ming/timer_service.h"
+
+#if defined(__linux__)
+
+#include <poll.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <limits>
+
+namespace ming {
+
+namespace {
+
+enum {
+  kTimerFree = 0,
+  kTimerQueued = 1,     // in an add inbox
+  kTimerArmed = 2,      // in the wheel
+  kTimerFiring = 3,     // callback running
+  kTimerCancelled = 4,  // freed by the timer thread
+  kTimerStateMask = 0xff,
+  kTimerRepeating = 0x100,
+};
+
+inline uint64_t make_state(uint64_t generation, uint64_t flags) {
+  return (generation << 32) | flags;
+}
+
+inline uint64_t generation_of(uint64_t state) { return state >> 32; }
+
+// each producer thread sticks to one inbox shard
+std::atomic<int> g_next_shard(0);
+thread_local int t_shard = -1;
+
+inline int thread_shard() {
+  if (t_shard < 0) {
+    t_shard = g_next_shard.fetch_add(1, std::memory_order_relaxed) %
+              TimerService::kInboxShards;
+  }
+  return t_shard;
+}
+
+}  // namespace
+
+TimerService::TimerService()
+    : resolution_us_(1000),
+      timer_fd_(-1),
+      event_fd_(-1),
+      running_(false),
+      chunks_(new std::atomic<Timer*>[kMaxChunks]),
+      num_chunks_(0) {
+  for (int i = 0; i < kMaxChunks; i++) {
+    chunks_[i].store(NULL, std::memory_order_relaxed);
+  }
+  for (int i = 0; i < kInboxShards; i++) {
+    shards_[i].adds.store(NULL, std::memory_order_relaxed);
+    shards_[i].cancels.store(NULL, std::memory_order_relaxed);
+    shards_[i].free_list = NULL;
+    shards_[i].freed = NULL;
+  }
+}
+
+TimerService::~TimerService() {
+  Stop();
+  for (uint32_t i = 0; i < num_chunks_; i++) {
+    delete[] chunks_[i].load(std::memory_order_relaxed);
+  }
+  delete[] chunks_;
+}
+
+bool TimerService::Start(int64_t resolution_us) {
+  if (running_.load(std::memory_order_relaxed)) {
+    return true;
+  }
+  resolution_us_ = resolution_us > 0 ? resolution_us : 1;
+  timer_fd_ = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  event_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (timer_fd_ < 0 || event_fd_ < 0) {
+    if (timer_fd_ >= 0) {
+      close(timer_fd_);
+    }
+    if (event_fd_ >= 0) {
+      close(event_fd_);
+    }
+    timer_fd_ = event_fd_ = -1;
+    return false;
+  }
+  running_.store(true, std::memory_order_relaxed);
+  thread_ = std::thread(&TimerService::Run, this);
+  return true;
+}
+
+void TimerService::Stop() {
+  if (!running_.exchange(false)) {
+    return;
+  }
+  Wakeup();
+  thread_.join();
+  close(timer_fd_);
+  close(event_fd_);
+  timer_fd_ = event_fd_ = -1;
+}
+
+TimerService::TimerId TimerService::Schedule(int64_t delay_us,
+                                             Callback callback) {
+  return Add(delay_us, false, std::move(callback));
+}
+
+TimerService::TimerId TimerService::ScheduleRepeating(int64_t interval_us,
+                                                      Callback callback) {
+  return Add(interval_us, true, std::move(callback));
+}
+
+TimerService::TimerId TimerService::Add(int64_t delay_us, bool repeating,
+                                        Callback callback) {
+  int shard = thread_shard();
+  Timer* timer = AllocTimer(shard);
+  if (timer == NULL) {
+    return 0;
+  }
+  timer->delay_us = delay_us;
+  timer->callback = std::move(callback);
+  uint64_t generation =
+      generation_of(timer->state.load(std::memory_order_relaxed));
+  timer->state.store(
+      make_state(generation,
+                 kTimerQueued | (repeating ? kTimerRepeating : 0)),
+      std::memory_order_relaxed);
+  // the release of the push publishes the fields above
+  Push(&shards_[shard].adds, timer, false);
+  return (generation << 32) | timer->index;
+}
+
+bool TimerService::Cancel(TimerId id) {
+  Timer* timer = FindTimer(static_cast<uint32_t>(id));
+  if (timer == NULL) {
+    return false;
+  }
+  uint64_t generation = id >> 32;
+  uint64_t state = timer->state.load(std::memory_order_acquire);
+  for (;;) {
+    if (generation_of(state) != generation) {
+      return false;
+    }
+    uint64_t cancelled =
+        make_state(generation,
+                   kTimerCancelled | (state & kTimerRepeating));
+    switch (state & kTimerStateMask) {
+      case kTimerQueued:
+        // the timer thread frees it when it drains the inbox
+        if (timer->state.compare_exchange_weak(state, cancelled,
+                                               std::memory_order_acq_rel)) {
+          return true;
+        }
+        break;
+      case kTimerFiring:
+        if ((state & kTimerRepeating) == 0) {
+          return false;
+        }
+      // fall through
+      case kTimerArmed:
+        if (timer->state.compare_exchange_weak(state, cancelled,
+                                               std::memory_order_acq_rel)) {
+          Push(&shards_[thread_shard()].cancels, timer, true);
+          return true;
+        }
+        break;
+      default:
+        return false;
+    }
+  }
+}
+
+void TimerService::Push(std::atomic<Timer*>* inbox, Timer* timer,
+                        bool cancel) {
+  Timer* head = inbox->load(std::memory_order_relaxed);
+  do {
+    if (cancel) {
+      timer->cancel_next = head;
+    } else {
+      timer->next = head;
+    }
+  } while (!inbox->compare_exchange_weak(head, timer,
+                                         std::memory_order_release,
+                                         std::memory_order_relaxed));
+  // the timer thread drains the whole inbox at once, only the first push
+  // after a drain has to wake it up
+  if (head == NULL) {
+    Wakeup();
+  }
+}
+
+void TimerService::Wakeup() {
+  if (event_fd_ >= 0) {
+    uint64_t one = 1;
+    ssize_t n = write(event_fd_, &one, sizeof(one));
+    (void)n;
+  }
+}
+
+TimerService::Timer* TimerService::AllocTimer(int shard) {
+  Shard& s = shards_[shard];
+  for (;;) {
+    {
+      SpinLock::ScopedLock lock(s.free_lock);
+      Timer* timer = s.free_list;
+      if (timer != NULL) {
+        s.free_list = timer->next;
+        return timer;
+      }
+    }
+    if (!GrowPool(shard)) {
+      return NULL;
+    }
+  }
+}
+
+bool TimerService::GrowPool(int shard) {
+  Timer* chunk;
+  {
+    std::lock_guard<std::mutex> guard(pool_mutex_);
+    if (num_chunks_ >= kMaxChunks) {
+      return false;
+    }
+    chunk = new Timer[kTimersPerChunk];
+    uint32_t base = num_chunks_ * kTimersPerChunk;
+    for (int i = 0; i < kTimersPerChunk; i++) {
+      chunk[i].state.store(make_state(1, kTimerFree),
+                           std::memory_order_relaxed);
+      chunk[i].next = (i + 1 < kTimersPerChunk) ? &chunk[i + 1] : NULL;
+      chunk[i].cancel_next = NULL;
+      chunk[i].index = base + i;
+      chunk[i].shard = shard;
+      chunk[i].delay_us = 0;
+      chunk[i].wheel_id = 0;
+    }
+    // Cancel() may look up any index
+    chunks_[num_chunks_].store(chunk, std::memory_order_release);
+    num_chunks_++;
+  }
+  Shard& s = shards_[shard];
+  SpinLock::ScopedLock lock(s.free_lock);
+  chunk[kTimersPerChunk - 1].next = s.free_list;
+  s.free_list = chunk;
+  return true;
+}
+
+TimerService::Timer* TimerService::FindTimer(uint32_t index) const {
+  Timer* chunk =
+      chunks_[(index / kTimersPerChunk) % kMaxChunks].load(
+          std::memory_order_acquire);
+  if (chunk == NULL) {
+    return NULL;
+  }
+  return &chunk[index % kTimersPerChunk];
+}
+
+// called by the timer thread only
+void TimerService::FreeTimer(Timer* timer) {
+  Callback().swap(timer->callback);
+  uint64_t generation =
+      generation_of(timer->state.load(std::memory_order_relaxed)) + 1;
+  if (generation > 0xffffffffULL) {
+    generation = 1;
+  }
+  timer->state.store(make_state(generation, kTimerFree),
+                     std::memory_order_release);
+  Shard& s = shards_[timer->shard];
+  timer->next = s.freed;
+  s.freed = timer;
+}
+
+// hand the freed timers back to the producers, one lock per shard
+void TimerService::ReleaseFreed() {
+  for (int i = 0; i < kInboxShards; i++) {
+    Shard& s = shards_[i];
+    if (s.freed == NULL) {
+      continue;
+    }
+    Timer* last = s.freed;
+    while (last->next != NULL) {
+      last = last->next;
+    }
+    SpinLock::ScopedLock lock(s.free_lock);
+    last->next = s.free_list;
+    s.free_list = s.freed;
+    s.freed = NULL;
+  }
+}
+
+int64_t TimerService::NowTicks() const {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (static_cast<int64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000) /
+         resolution_us_;
+}
+
+void TimerService::DrainInboxes() {
+  for (int i = 0; i < kInboxShards; i++) {
+    Shard& s = shards_[i];
+    Timer* adds = s.adds.exchange(NULL, std::memory_order_acquire);
+    // read after the exchange, the timers were all scheduled before it
+    int64_t now = adds != NULL ? NowTicks() : 0;
+    // the inbox is a stack, reverse it to keep the scheduling order
+    Timer* fifo = NULL;
+    while (adds != NULL) {
+      Timer* next = adds->next;
+      adds->next = fifo;
+      fifo = adds;
+      adds = next;
+    }
+    while (fifo != NULL) {
+      Timer* timer = fifo;
+      fifo = fifo->next;
+      uint64_t state = timer->state.load(std::memory_order_acquire);
+      if ((state & kTimerStateMask) != kTimerQueued) {
+        FreeTimer(timer);  // cancelled before it got here
+        continue;
+      }
+      int64_t ticks = (timer->delay_us + resolution_us_ - 1) / resolution_us_;
+      // now is rounded down to a tick, count from the next one so that a
+      // timer never fires early
+      int64_t start = ticks > 0 ? now + 1 : now;
+      TimingWheel::Callback fire = [this, timer](TimingWheel::Id, int64_t) {
+        Fire(timer);
+      };
+      if (state & kTimerRepeating) {
+        timer->wheel_id = wheel_.addRepeating(start, ticks > 0 ? ticks : 1,
+                                              std::move(fire));
+      } else {
+        timer->wheel_id = wheel_.add(start, ticks, std::move(fire));
+      }
+      uint64_t armed = (state & ~static_cast<uint64_t>(kTimerStateMask)) |
+                       kTimerArmed;
+      if (!timer->state.compare_exchange_strong(state, armed,
+                                                std::memory_order_acq_rel)) {
+        wheel_.erase(timer->wheel_id);
+        FreeTimer(timer);
+      }
+    }
+
+    Timer* cancels = s.cancels.exchange(NULL, std::memory_order_acquire);
+    while (cancels != NULL) {
+      Timer* timer = cancels;
+      cancels = cancels->cancel_next;
+      // false if a one-time timer fired in the meantime
+      wheel_.erase(timer->wheel_id);
+      FreeTimer(timer);
+    }
+  }
+}
+
+void TimerService::Fire(Timer* timer) {
+  uint64_t state = timer->state.load(std::memory_order_acquire);
+  if ((state & kTimerStateMask) != kTimerArmed) {
+    return;  // cancelled, freed by the cancel request
+  }
+  uint64_t base = state & ~static_cast<uint64_t>(kTimerStateMask);
+  if (!timer->state.compare_exchange_strong(state, base | kTimerFiring,
+                                            std::memory_order_acq_rel)) {
+    return;
+  }
+  timer->callback();
+  if (state & kTimerRepeating) {
+    // fails if the callback or another thread cancelled it
+    uint64_t firing = base | kTimerFiring;
+    timer->state.compare_exchange_strong(firing, base | kTimerArmed,
+                                         std::memory_order_acq_rel);
+  } else {
+    FreeTimer(timer);
+  }
+}
+
+void TimerService::ArmTimer(int64_t next) {
+  struct itimerspec its;
+  memset(&its, 0, sizeof(its));
+  if (next != std::numeric_limits<int64_t>::max()) {
+    int64_t us = next * resolution_us_;
+    its.it_value.tv_sec = us / 1000000;
+    its.it_value.tv_nsec = (us % 1000000) * 1000;
+  }
+  timerfd_settime(timer_fd_, TFD_TIMER_ABSTIME, &its, NULL);
+}
+
+void TimerService::Run() {
+  int64_t armed = std::numeric_limits<int64_t>::max();
+  while (running_.load(std::memory_order_relaxed)) {
+    DrainInboxes();
+    int64_t now = NowTicks();
+    wheel_.runOnce(now);
+    ReleaseFreed();
+
+    int64_t next = wheel_.nextExpiration();
+    if (next <= now) {
+      continue;  // the callbacks added timers already due
+    }
+    if (next != armed) {
+      ArmTimer(next);
+      armed = next;
+    }
+    struct pollfd fds[2] = {{timer_fd_, POLLIN, 0}, {event_fd_, POLLIN, 0}};
+    if (poll(fds, 2, -1) <= 0) {
+      continue;
+    }
+    uint64_t count;
+    if (fds[0].revents & POLLIN) {
+      if (read(timer_fd_, &count, sizeof(count)) > 0) {
+        armed = std::numeric_limits<int64_t>::max();  // expired, disarmed
+      }
+    }
+    if (fds[1].revents & POLLIN) {
+      ssize_t n = read(event_fd_, &count, sizeof(count));
+      (void)n;
+    }
+  }
+}
+
+}  // namespace ming
+
+#endif  // __linux__
@@ -0,0 +1,107 @@
+#ifndef MING_TIMER_SERVICE_H_
+#define MING_TIMER_SERVICE_H_
+
+#include <stdint.h>
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#include "ming/noncopyable.h"
+#include "ming/spin_lock.h"
+#include "ming/timing_wheel.h"
+
+namespace ming {
+
+// Timers that any thread can schedule and cancel, run by a dedicated thread.
+//
+// Schedule() pushes the timer onto one of kInboxShards lock-free MPSC
+// stacks, each producer thread sticks to one shard. The timer thread drains
+// the inboxes into a TimingWheel and sleeps on a timerfd armed for the next
+// expiration, an eventfd wakes it up when an inbox turns non-empty.
+// Cancel() is a CAS on the timer state; a timer already in the wheel is
+// also queued for the timer thread to erase it. Timers are pooled per shard
+// and returned in batches, there is no global lock on these paths.
+//
+// Callbacks run on the timer thread and must be short. Linux only.
+class TimerService : private noncopyable {
+ public:
+  typedef uint64_t TimerId;  // 0 is never a valid id
+  typedef std::function<void()> Callback;
+
+  enum { kInboxShards = 16 };
+
+  TimerService();
+  ~TimerService();
+
+  // resolution_us is the tick of the wheel, delays are rounded up to it
+  bool Start(int64_t resolution_us = 1000);
+  // stop the timer thread, the pending timers do not fire
+  void Stop();
+
+  // Thread-safe. Return 0 if the pool is exhausted.
+  TimerId Schedule(int64_t delay_us, Callback callback);
+  TimerId ScheduleRepeating(int64_t interval_us, Callback callback);
+
+  // Thread-safe. Return false if the timer already fired or was cancelled.
+  // A repeating timer can be cancelled from its own callback.
+  bool Cancel(TimerId id);
+
+ private:
+  enum { kTimersPerChunk = 1024, kMaxChunks = 16384 };
+
+  struct Timer {
+    // generation << 32 | repeating flag | state
+    std::atomic<uint64_t> state;
+    Timer* next;         // in an add inbox or a free list
+    Timer* cancel_next;  // in a cancel inbox
+    uint32_t index;
+    int shard;
+    int64_t delay_us;
+    TimingWheel::Id wheel_id;
+    Callback callback;
+  };
+
+  struct Shard {
+    std::atomic<Timer*> adds;
+    std::atomic<Timer*> cancels;
+    SpinLock free_lock;
+    Timer* free_list;
+    Timer* freed;  // freed by the timer thread, not yet in free_list
+    char pad[64];
+  };
+
+  TimerId Add(int64_t delay_us, bool repeating, Callback callback);
+  void Push(std::atomic<Timer*>* inbox, Timer* timer, bool cancel);
+  void Wakeup();
+
+  Timer* AllocTimer(int shard);
+  bool GrowPool(int shard);
+  Timer* FindTimer(uint32_t index) const;
+  void FreeTimer(Timer* timer);
+  void ReleaseFreed();
+
+  void Run();
+  void DrainInboxes();
+  void Fire(Timer* timer);
+  void ArmTimer(int64_t next);
+  int64_t NowTicks() const;
+
+  int64_t resolution_us_;
+  int timer_fd_;
+  int event_fd_;
+  std::atomic<bool> running_;
+  std::thread thread_;
+  TimingWheel wheel_;  // used by the timer thread only
+
+  std::mutex pool_mutex_;
+  std::atomic<Timer*>* chunks_;
+  uint32_t num_chunks_;
+
+  Shard shards_[kInboxShards];
+};
+
+}  // namespace ming
+
+#endif  // MING_TIMER_SERVICE_H_
@@ -0,0 +1,172 @@
+#include "ming/timestamp.h"
+
+#include <string.h>
+#include <time.h>
+
+#include <chrono>
+
+namespace ming {
+
+namespace {
+
+const int64_t kSecondsPerDay = 86400;
+// DST and zone changes happen on quarter hour boundaries
+const int64_t kOffsetRefreshInterval = 900;
+
+struct TimestampCache {
+  int64_t second;  // the second formatted in prefix, -1 if none
+  int prefix_len;
+  char prefix[24];  // "2017-12-25 12:01:02"
+
+  int64_t offset_from;  // utc_offset is valid in [offset_from, offset_until)
+  int64_t offset_until;
+  int32_t utc_offset;  // seconds east of UTC
+  int zone_len;
+  char zone[8];  // "+0800", "+08:00", "Z"
+};
+
+// one cache per (style, utc) per thread
+thread_local TimestampCache t_cache[3][2] = {};
+
+int32_t local_utc_offset(int64_t seconds) {
+  time_t t = static_cast<time_t>(seconds);
+  struct tm tm_time;
+#if defined(_MSC_VER)
+  localtime_s(&tm_time, &t);
+  return static_cast<int32_t>(_mkgmtime(&tm_time) - t);
+#else
+  localtime_r(&t, &tm_time);
+  return static_cast<int32_t>(tm_time.tm_gmtoff);
+#endif
+}
+
+inline void put2(char* p, int v) {
+  p[0] = static_cast<char>('0' + v / 10);
+  p[1] = static_cast<char>('0' + v % 10);
+}
+
+// http://howardhinnant.github.io/date_algorithms.html#civil_from_days
+void civil_from_days(int64_t z, int* year, int* month, int* day) {
+  z += 719468;
+  const int64_t era = (z >= 0 ? z : z - 146096) / 146097;
+  const int64_t doe = z - era * 146097;
+  const int64_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+  const int64_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+  const int64_t mp = (5 * doy + 2) / 153;
+  const int64_t d = doy - (153 * mp + 2) / 5 + 1;
+  const int64_t m = mp < 10 ? mp + 3 : mp - 9;
+  *year = static_cast<int>(yoe + era * 400 + (m <= 2));
+  *month = static_cast<int>(m);
+  *day = static_cast<int>(d);
+}
+
+void refresh_offset(TimestampCache* cache, int64_t seconds, bool utc,
+                    TimestampStyle style) {
+  int64_t from = seconds - seconds % kOffsetRefreshInterval;
+  if (seconds < 0 && seconds % kOffsetRefreshInterval != 0) {
+    from -= kOffsetRefreshInterval;
+  }
+  cache->offset_from = from;
+  cache->offset_until = from + kOffsetRefreshInterval;
+  cache->utc_offset = utc ? 0 : local_utc_offset(seconds);
+  cache->second = -1;
+
+  char* p = cache->zone;
+  if (style == kTimestampRfc3339 && cache->utc_offset == 0) {
+    *p++ = 'Z';
+  } else if (style != kTimestampDefault) {
+    int32_t offset = cache->utc_offset;
+    *p++ = offset < 0 ? '-' : '+';
+    if (offset < 0) {
+      offset = -offset;
+    }
+    put2(p, offset / 3600);
+    p += 2;
+    if (style == kTimestampRfc3339) {
+      *p++ = ':';
+    }
+    put2(p, offset / 60 % 60);
+    p += 2;
+  }
+  cache->zone_len = static_cast<int>(p - cache->zone);
+}
+
+void format_prefix(TimestampCache* cache, int64_t seconds,
+                   TimestampStyle style) {
+  int64_t local = seconds + cache->utc_offset;
+  int64_t days = local / kSecondsPerDay;
+  int64_t sod = local % kSecondsPerDay;
+  if (sod < 0) {
+    sod += kSecondsPerDay;
+    days--;
+  }
+  int year, month, day;
+  civil_from_days(days, &year, &month, &day);
+
+  char* p = cache->prefix;
+  put2(p, year / 100 % 100);
+  put2(p + 2, year % 100);
+  p[4] = '-';
+  put2(p + 5, month);
+  p[7] = '-';
+  put2(p + 8, day);
+  p[10] = (style == kTimestampDefault) ? ' ' : 'T';
+  put2(p + 11, static_cast<int>(sod / 3600));
+  p[13] = ':';
+  put2(p + 14, static_cast<int>(sod / 60 % 60));
+  p[16] = ':';
+  put2(p + 17, static_cast<int>(sod % 60));
+  cache->prefix_len = 19;
+  cache->second = seconds;
+}
+
+}  // namespace
+
+int TimestampFormatter::Format(char* buf, int64_t seconds,
+                               uint32_t nanoseconds) const {
+  TimestampCache* cache = &t_cache[style_][utc_ ? 1 : 0];
+  if (seconds != cache->second || cache->prefix_len == 0) {
+    if (seconds < cache->offset_from || seconds >= cache->offset_until) {
+      refresh_offset(cache, seconds, utc_, style_);
+    }
+    format_prefix(cache, seconds, style_);
+  }
+
+  char* p = buf;
+  memcpy(p, cache->prefix, cache->prefix_len);
+  p += cache->prefix_len;
+
+  if (precision_ != kTimestampSeconds) {
+    uint32_t frac = nanoseconds;
+    for (int i = precision_; i < 9; i++) {
+      frac /= 10;
+    }
+    *p = '.';
+    for (int i = precision_; i > 0; i--) {
+      p[i] = static_cast<char>('0' + frac % 10);
+      frac /= 10;
+    }
+    p += precision_ + 1;
+  }
+
+  memcpy(p, cache->zone, cache->zone_len);
+  p += cache->zone_len;
+  *p = '\0';
+  return static_cast<int>(p - buf);
+}
+
+int TimestampFormatter::FormatNow(char* buf) const {
+  using namespace std::chrono;
+  nanoseconds ns = duration_cast<nanoseconds>(
+      system_clock::now().time_since_epoch());
+  int64_t count = ns.count();
+  int64_t sec = count / 1000000000;
+  int64_t nsec = count % 1000000000;
+  if (nsec < 0) {
+    nsec += 1000000000;
+    sec--;
+  }
+  return Format(buf, sec, static_cast<uint32_t>(nsec));
+}
+
+}  // namespace ming
@@ -0,0 +1,58 @@
+#ifndef MING_TIMESTAMP_H_
+#define MING_TIMESTAMP_H_
+
+#include <stdint.h>
+
+namespace ming {
+
+enum TimestampStyle {
+  kTimestampDefault,  // "2017-12-25 12:01:02.003"
+  kTimestampIso8601,  // "2017-12-25T12:01:02.003+0800"
+  kTimestampRfc3339,  // "2017-12-25T12:01:02.003+08:00", "...Z" in UTC
+};
+
+// digits after the second
+enum TimestampPrecision {
+  kTimestampSeconds = 0,
+  kTimestampMilliseconds = 3,
+  kTimestampMicroseconds = 6,
+  kTimestampNanoseconds = 9,
+};
+
+const int kMaxTimestampSize = 48;
+
+// Thread-safe strftime alternative for log prefixes.
+//
+// Every thread caches the formatted "YYYY-MM-DD HH:MM:SS" of the last second
+// it formatted, so most calls only append the sub-second digits. When the
+// second changes the date is computed arithmetically from the cached UTC
+// offset; localtime_r() is only called to refresh that offset, at most once
+// per quarter hour per thread (DST changes on quarter hour boundaries).
+//
+// A formatter holds no mutable state and can be shared by all threads.
+class TimestampFormatter {
+ public:
+  explicit TimestampFormatter(
+      TimestampStyle style = kTimestampDefault,
+      TimestampPrecision precision = kTimestampMilliseconds, bool utc = false)
+      : style_(style), precision_(precision), utc_(utc) {}
+
+  // buf must have kMaxTimestampSize bytes. The result is '\0' terminated,
+  // return the length without the '\0'.
+  int Format(char* buf, int64_t seconds, uint32_t nanoseconds) const;
+  int FormatMicroseconds(char* buf, uint64_t microseconds_since_epoch) const {
+    return Format(buf, static_cast<int64_t>(microseconds_since_epoch / 1000000),
+                  static_cast<uint32_t>(microseconds_since_epoch % 1000000) *
+                      1000);
+  }
+  int FormatNow(char* buf) const;
+
+ private:
+  TimestampStyle style_;
+  TimestampPrecision precision_;
+  bool utc_;
+};
+
+}  // namespace ming
+
+#endif  // MING_TIMESTAMP_H_
@@ -0,0 +1,376 @@
+#include "ming/timing_wheel.h"
+
+#include <string.h>
+
+#include <limits>
+
+namespace ming {
+
+namespace {
+
+const uint32_t kMaxGeneration = 0x7fffffff;  // ids stay positive
+
+inline int lowest_bit(uint64_t v) {
+#if defined(_MSC_VER)
+  unsigned long index;
+  _BitScanForward64(&index, v);
+  return static_cast<int>(index);
+#else
+  return __builtin_ctzll(v);
+#endif
+}
+
+}  // namespace
+
+TimingWheel::TimingWheel()
+    : current_(0),
+      size_(0),
+      pending_(0),
+      next_expiration_(std::numeric_limits<int64_t>::max()),
+      next_expiration_valid_(true) {
+  for (int i = 0; i < kNumSlots; i++) {
+    INIT_LIST_HEAD(&slots_[i]);
+  }
+  memset(bitmap_, 0, sizeof(bitmap_));
+  INIT_LIST_HEAD(&due_);
+  INIT_LIST_HEAD(&free_);
+}
+
+TimingWheel::~TimingWheel() {
+  for (size_t i = 0; i < chunks_.size(); i++) {
+    delete[] chunks_[i];
+  }
+}
+
+TimingWheel::Id TimingWheel::add(int64_t now, int64_t delay,
+                                 Callback callback) {
+  return insert(now, delay, -1, std::move(callback));
+}
+
+TimingWheel::Id TimingWheel::addRepeating(int64_t now, int64_t interval,
+                                          Callback callback) {
+  return insert(now, interval, interval, std::move(callback));
+}
+
+TimingWheel::Id TimingWheel::insert(int64_t now, int64_t delay,
+                                    int64_t interval, Callback callback) {
+  if (pending_ == 0 && now > current_) {
+    // nothing in the wheel, skip the idle ticks
+    current_ = now;
+  }
+  Node* node = alloc_node();
+  node->expiration = now + delay;
+  node->interval = interval;
+  node->callback = std::move(callback);
+  link(node);
+  size_++;
+  if (next_expiration_valid_ && node->expiration < next_expiration_) {
+    next_expiration_ = node->expiration;
+  }
+  return node_id(node);
+}
+
+bool TimingWheel::erase(Id id) {
+  Node* node = find_node(id);
+  if (node == NULL || node->slot == kFiringSlot) {
+    return false;
+  }
+  if (node->expiration == next_expiration_) {
+    next_expiration_valid_ = false;
+  }
+  unlink(node);
+  size_--;
+  if (node->in_batch) {
+    // a repeating event of the running batch, freed once the batch is done
+    node->slot = kFiringSlot;
+  } else {
+    free_node(node);
+  }
+  return true;
+}
+
+int64_t TimingWheel::nextExpiration() const {
+  if (!next_expiration_valid_) {
+    next_expiration_ = compute_next_expiration();
+    next_expiration_valid_ = true;
+  }
+  return next_expiration_;
+}
+
+int64_t TimingWheel::runInternal(int64_t now, bool once) {
+  int64_t next;
+  list_head expired;
+  INIT_LIST_HEAD(&expired);
+  do {
+    collect(now, &expired);
+    next_expiration_valid_ = false;
+
+    // reinsert the repeating events before calling the callbacks, so that
+    // the callbacks can erase them
+    batch_.clear();
+    while (!list_empty(&expired)) {
+      Node* node = node_of(expired.next);
+      list_del(&node->link);
+      node->in_batch = true;
+      batch_.push_back(node);
+      if (node->interval >= 0) {
+        node->expiration = now + node->interval;
+        link(node);
+      } else {
+        node->slot = kFiringSlot;
+        size_--;
+      }
+    }
+
+    for (size_t i = 0; i < batch_.size(); i++) {
+      Node* node = batch_[i];
+      // skip the repeating events erased by an earlier callback
+      if (node->slot != kFiringSlot || node->interval < 0) {
+        node->callback(node_id(node), now);
+      }
+    }
+
+    for (size_t i = 0; i < batch_.size(); i++) {
+      Node* node = batch_[i];
+      node->in_batch = false;
+      if (node->slot == kFiringSlot) {
+        free_node(node);
+      }
+    }
+    batch_.clear();
+    next = nextExpiration();
+  } while (!once && next <= now);
+  return next;
+}
+
+TimingWheel::Node* TimingWheel::alloc_node() {
+  if (list_empty(&free_)) {
+    Node* chunk = new Node[kNodesPerChunk];
+    uint32_t base = static_cast<uint32_t>(chunks_.size()) * kNodesPerChunk;
+    chunks_.push_back(chunk);
+    for (int i = 0; i < kNodesPerChunk; i++) {
+      chunk[i].index = base + i;
+      chunk[i].generation = 1;
+      chunk[i].slot = kFreeSlot;
+      chunk[i].in_batch = false;
+      list_add_tail(&chunk[i].link, &free_);
+    }
+  }
+  Node* node = node_of(free_.next);
+  list_del(&node->link);
+  return node;
+}
+
+void TimingWheel::free_node(Node* node) {
+  // release what the callback holds now, not when the node is reused
+  Callback().swap(node->callback);
+  node->generation =
+      node->generation == kMaxGeneration ? 1 : node->generation + 1;
+  node->slot = kFreeSlot;
+  list_add(&node->link, &free_);
+}
+
+TimingWheel::Node* TimingWheel::find_node(Id id) const {
+  uint32_t index = static_cast<uint32_t>(id);
+  uint32_t generation = static_cast<uint32_t>(id >> 32);
+  if (id <= 0 || index / kNodesPerChunk >= chunks_.size()) {
+    return NULL;
+  }
+  Node* node = &chunks_[index / kNodesPerChunk][index % kNodesPerChunk];
+  if (node->generation != generation || node->slot == kFreeSlot) {
+    return NULL;
+  }
+  return node;
+}
+
+void TimingWheel::link(Node* node) {
+  int64_t delta = node->expiration - current_;
+  if (delta < 0) {
+    node->slot = kDueSlot;
+    list_add_tail(&node->link, &due_);
+    return;
+  }
+
+  int slot;
+  if (delta < kLevel0Slots) {
+    slot = static_cast<int>(node->expiration & (kLevel0Slots - 1));
+  } else {
+    int64_t expiration = node->expiration;
+    if (delta >= (1LL << kMaxBits)) {
+      // too far, park it in the last level until it comes closer
+      expiration = current_ + (1LL << kMaxBits) - 1;
+    }
+    int level = 1;
+    while (level < kLevels - 1 &&
+           delta >= (1LL << (level_shift(level) + kLevelBits))) {
+      level++;
+    }
+    slot = level_first_slot(level) +
+           static_cast<int>((expiration >> level_shift(level)) &
+                            (kLevelSlots - 1));
+  }
+  node->slot = slot;
+  list_add_tail(&node->link, &slots_[slot]);
+  set_slot_bit(slot);
+  pending_++;
+}
+
+void TimingWheel::unlink(Node* node) {
+  list_del(&node->link);
+  if (node->slot >= 0) {
+    if (list_empty(&slots_[node->slot])) {
+      clear_slot_bit(node->slot);
+    }
+    pending_--;
+  }
+}
+
+void TimingWheel::cascade() {
+  list_head moving;
+  INIT_LIST_HEAD(&moving);
+  for (int level = 1; level < kLevels; level++) {
+    int index = static_cast<int>((current_ >> level_shift(level)) &
+                                 (kLevelSlots - 1));
+    int slot = level_first_slot(level) + index;
+    list_splice_tail_init(&slots_[slot], &moving);
+    clear_slot_bit(slot);
+    while (!list_empty(&moving)) {
+      Node* node = node_of(moving.next);
+      list_del(&node->link);
+      pending_--;
+      link(node);
+    }
+    if (index != 0) {
+      break;
+    }
+  }
+}
+
+void TimingWheel::collect(int64_t now, list_head* expired) {
+  list_splice_tail_init(&due_, expired);
+  while (current_ <= now) {
+    if (pending_ == 0) {
+      current_ = now + 1;
+      break;
+    }
+    int index = static_cast<int>(current_ & (kLevel0Slots - 1));
+    if (index == 0) {
+      cascade();
+    }
+    // jump to the next non-empty slot of this round, or to where the next
+    // cascade happens
+    int next = find_slot(0, index);
+    int64_t round = current_ - index;
+    int64_t tick;
+    if (next >= index) {
+      tick = round + next;
+    } else if (next >= 0) {
+      tick = round + kLevel0Slots;  // wrapped, in the next round
+    } else {
+      // the first level is empty, skip the empty rounds up to the start of
+      // the next upper level slot instead of walking them one by one
+      tick = next_cascade();
+    }
+    if (tick > now) {
+      current_ = now + 1;
+      break;
+    }
+    if (next < index) {
+      current_ = tick;
+      continue;
+    }
+    current_ = tick + 1;
+    list_head* head = &slots_[next];
+    for (list_head* p = head->next; p != head; p = p->next) {
+      pending_--;
+    }
+    list_splice_tail_init(head, expired);
+    clear_slot_bit(next);
+  }
+}
+
+// the first non-empty slot of a level at or after start, wrapping around,
+// -1 if the level is empty
+int TimingWheel::find_slot(int level, int start) const {
+  int first = level_first_slot(level);
+  int slots = level == 0 ? kLevel0Slots : kLevelSlots;
+  for (int pass = 0; pass < 2; pass++) {
+    int from = pass == 0 ? start : 0;
+    int to = pass == 0 ? slots : start;
+    int i = from;
+    while (i < to) {
+      int bit = first + i;
+      uint64_t word = bitmap_[bit >> 6] >> (bit & 63);
+      if (word == 0) {
+        i += 64 - (bit & 63);
+        continue;
+      }
+      i += lowest_bit(word);
+      return i < to ? i : -1;
+    }
+  }
+  return -1;
+}
+
+int64_t TimingWheel::compute_next_expiration() const {
+  int64_t next = std::numeric_limits<int64_t>::max();
+  for (const list_head* p = due_.next; p != &due_; p = p->next) {
+    const Node* node = node_of(p);
+    if (node->expiration < next) {
+      next = node->expiration;
+    }
+  }
+  if (pending_ == 0) {
+    return next;
+  }
+
+  // the first level holds exact ticks
+  int index = static_cast<int>(current_ & (kLevel0Slots - 1));
+  int slot = find_slot(0, index);
+  if (slot >= 0) {
+    int64_t tick = current_ - index + slot + (slot < index ? kLevel0Slots : 0);
+    if (tick < next) {
+      next = tick;
+    }
+  }
+
+  // An upper level slot only gives a lower bound, the start of the slot,
+  // which is when the wheel has to run to move its events down. Scanning the
+  // slot for the exact time would cost O(n) for the far levels.
+  int64_t cascade = next_cascade();
+  return cascade < next ? cascade : next;
+}
+
+// the first tick when a non-empty upper level slot is moved down, the
+// current one if current_ is at its start
+int64_t TimingWheel::next_cascade() const {
+  int64_t next = std::numeric_limits<int64_t>::max();
+  for (int level = 1; level < kLevels; level++) {
+    int shift = level_shift(level);
+    int64_t base = current_ >> shift;
+    int index = static_cast<int>(base & (kLevelSlots - 1));
+    if ((current_ & ((1LL << shift) - 1)) == 0 &&
+        !list_empty(&slots_[level_first_slot(level) + index])) {
+      // the current slot is moved down when current_ is run
+      if (current_ < next) {
+        next = current_;
+      }
+      continue;
+    }
+    int slot = find_slot(level, (index + 1) & (kLevelSlots - 1));
+    if (slot < 0) {
+      continue;
+    }
+    int distance = (slot - index) & (kLevelSlots - 1);
+    if (distance == 0) {
+      distance = kLevelSlots;
+    }
+    int64_t start = (base + distance) << shift;
+    if (start < next) {
+      next = start;
+    }
+  }
+  return next;
+}
+
+}  // namespace ming
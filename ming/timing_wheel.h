@@ -0,0 +1,145 @@
+#ifndef MING_TIMING_WHEEL_H_
+#define MING_TIMING_WHEEL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <functional>
+#include <vector>
+
+#include "ming/noncopyable.h"
+#include "ming/simple_list.h"
+
+namespace ming {
+
+// Hierarchical timing wheel with the interface of folly::TimeoutQueue.
+//
+// Time is an int64_t in any unit, a tick of the wheel is one unit. The first
+// level has 256 slots of one tick, each of the 5 upper levels has 64 slots
+// 64 times wider than the slots below, so the wheel spans 2^38 ticks (later
+// events wait in the last level). The events of an upper level slot are
+// moved down when the level below wraps around.
+//
+// Events are intrusive list nodes from a pool: add(), erase() and the expiry
+// of an event are O(1) and do not allocate once the pool has grown (except
+// for a callback too large for the inline storage of std::function). An id
+// carries the generation of its node, so a stale id never erases a reused
+// node.
+//
+// Not thread-safe. Callbacks may add and erase events, but must not call
+// runOnce() / runLoop().
+class TimingWheel : private noncopyable {
+ public:
+  typedef int64_t Id;
+  typedef std::function<void(Id, int64_t)> Callback;
+
+  TimingWheel();
+  ~TimingWheel();
+
+  // Add a one-time timeout event that will fire "delay" time units from
+  // "now".
+  Id add(int64_t now, int64_t delay, Callback callback);
+
+  // Add a repeating timeout event that will fire every "interval" time
+  // units. It fires at most once per run*() call.
+  Id addRepeating(int64_t now, int64_t interval, Callback callback);
+
+  // Return true if the event was erased, false if it does not exist (or is
+  // a one-time event that already fired).
+  bool erase(Id id);
+
+  // Process all events that are due at times <= "now" and return the time
+  // that the next event will be due. runLoop() also runs the events that
+  // the callbacks added already due, runOnce() only goes through once.
+  int64_t runOnce(int64_t now) { return runInternal(now, true); }
+  int64_t runLoop(int64_t now) { return runInternal(now, false); }
+
+  // The time that the next event will be due, exact for the events due
+  // within 256 time units, otherwise the earlier time when the wheel has to
+  // run to move the event closer. std::numeric_limits<int64_t>::max() if
+  // there is no event.
+  int64_t nextExpiration() const;
+
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+ private:
+  enum {
+    kLevel0Bits = 8,
+    kLevel0Slots = 1 << kLevel0Bits,
+    kLevelBits = 6,
+    kLevelSlots = 1 << kLevelBits,
+    kLevels = 6,
+    kNumSlots = kLevel0Slots + (kLevels - 1) * kLevelSlots,
+    kMaxBits = kLevel0Bits + (kLevels - 1) * kLevelBits,
+  };
+  enum { kFreeSlot = -1, kDueSlot = -2, kFiringSlot = -3 };
+  enum { kNodesPerChunk = 1024 };
+
+  struct Node {
+    list_head link;  // first, in a slot, the due list or the free list
+    int64_t expiration;
+    int64_t interval;  // < 0 if not repeating
+    uint32_t index;    // in the pool
+    uint32_t generation;
+    int slot;
+    bool in_batch;  // its callback is going to be called by runInternal()
+    Callback callback;
+  };
+
+  // container_of() needs a standard layout type, which Node with its
+  // std::function is not
+  static Node* node_of(list_head* link) {
+    return reinterpret_cast<Node*>(link);
+  }
+  static const Node* node_of(const list_head* link) {
+    return reinterpret_cast<const Node*>(link);
+  }
+
+  int64_t runInternal(int64_t now, bool once);
+  Id insert(int64_t now, int64_t delay, int64_t interval, Callback callback);
+
+  Node* alloc_node();
+  void free_node(Node* node);
+  Node* find_node(Id id) const;
+  static Id node_id(const Node* node) {
+    return (static_cast<Id>(node->generation) << 32) | node->index;
+  }
+
+  void link(Node* node);
+  void unlink(Node* node);
+  void collect(int64_t now, list_head* expired);
+  void cascade();
+  int64_t compute_next_expiration() const;
+  int64_t next_cascade() const;
+
+  static int level_shift(int level) {
+    return level == 0 ? 0 : kLevel0Bits + (level - 1) * kLevelBits;
+  }
+  static int level_first_slot(int level) {
+    return level == 0 ? 0 : kLevel0Slots + (level - 1) * kLevelSlots;
+  }
+  void set_slot_bit(int slot) { bitmap_[slot >> 6] |= 1ULL << (slot & 63); }
+  void clear_slot_bit(int slot) {
+    bitmap_[slot >> 6] &= ~(1ULL << (slot & 63));
+  }
+  int find_slot(int level, int start) const;
+
+  int64_t current_;  // the next tick to expire
+  size_t size_;
+  size_t pending_;  // in the wheel slots
+  list_head slots_[kNumSlots];
+  uint64_t bitmap_[kNumSlots / 64];  // the non-empty slots
+  list_head due_;                    // added with an expiration < current_
+  list_head free_;
+
+  std::vector<Node*> chunks_;
+  std::vector<Node*> batch_;
+
+  mutable int64_t next_expiration_;
+  mutable bool next_expiration_valid_;
+};
+
+}  // namespace ming
+
+#endif  // MING_TIMING_WHEEL_H_
@@ -1,47 +1,1074 @@
 #include "tracing.h"
 
+#include <errno.h>
+#include <stdarg.h>
+#include <stdlib.h>
 #include <string.h>
 
+#if !defined(_MSC_VER)
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#include <condition_variable>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 
-struct Statistic {
-  unsigned int counter;
-  std::vector<unsigned int> timer;
-};
+std::atomic<bool> g_tracing_stat_enabled(false);
+std::atomic<bool> g_tracing_status_report_enabled(false);
+std::atomic<bool> g_tracing_span_enabled(false);
+
+namespace {
 
 enum { kDefaultFlushIntervals = 10 };
+enum { kCacheLineSize = 64 };
+
+//------------------------------------------------------------------------------
+// log-linear histogram of microseconds, every power of two range is split
+// into kSubBuckets linear buckets, so a bucket is at most 12.5% wide.
+enum {
+  kSubBucketBits = 3,
+  kSubBuckets = 1 << kSubBucketBits,
+  kMaxValueBits = 36,  // about 19 hours, larger samples are clamped
+  kHistogramBuckets = (kMaxValueBits - kSubBucketBits + 1) * kSubBuckets,
+};
 
-std::vector<std::string> metrics_name;
-std::vector<Statistic> statistics;
+inline int highest_bit(uint64_t v) {
+#if defined(_MSC_VER)
+  unsigned long index;
+  _BitScanReverse64(&index, v);
+  return static_cast<int>(index);
+#else
+  return 63 - __builtin_clzll(v);
+#endif
+}
 
-unsigned int tracing_metric_id(const char *metric) {
-  int len = metrics_name.size();
-  for (int i = 0; i < len; i++) {
-    if (0 == strcmp(metrics_name[i].c_str(), metric)) {
-      return i;
+inline int bucket_index(uint64_t v) {
+  if (v < kSubBuckets) {
+    return static_cast<int>(v);
+  }
+  if (v >= (1ULL << kMaxValueBits)) {
+    v = (1ULL << kMaxValueBits) - 1;
+  }
+  int shift = highest_bit(v) - kSubBucketBits;
+  return (shift + 1) * kSubBuckets +
+         static_cast<int>((v >> shift) & (kSubBuckets - 1));
+}
+
+inline uint64_t bucket_upper_bound(int index) {
+  if (index < kSubBuckets) {
+    return index;
+  }
+  int shift = index / kSubBuckets - 1;
+  uint64_t lower = static_cast<uint64_t>(kSubBuckets + index % kSubBuckets)
+                   << shift;
+  return lower + (1ULL << shift) - 1;
+}
+
+// Shards are written by their owner thread only, a relaxed load and store
+// is enough and avoids the locked instruction of fetch_add. The tracing
+// thread reads them with relaxed loads.
+inline void shard_add(std::atomic<uint64_t> *v, uint64_t n) {
+  v->store(v->load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+struct Histogram {
+  std::atomic<uint64_t> count;
+  std::atomic<uint64_t> sum;
+  std::atomic<uint64_t> buckets[kHistogramBuckets];
+};
+
+// per thread statistics, aligned to a cache line so that two threads never
+// write to the same line
+struct ThreadStats {
+  // counters are stored as uint64_t and wrap around, the difference of two
+  // values is still right when interpreted as int64_t
+  std::atomic<uint64_t> counters[kTracingMaxMetrics];
+  // allocated on the first tracing_timer_stop() of the metric
+  std::atomic<Histogram *> histograms[kTracingMaxMetrics];
+  std::atomic<bool> exited;
+
+  // status values, written under the seqlock status_seq
+  std::atomic<uint32_t> status_seq;
+  std::atomic<uint64_t> status_values[kTracingMaxStatus];  // double bits
+  std::atomic<uint64_t> status_stamps[kTracingMaxStatus];  // 0 if unset
+};
+
+ThreadStats *thread_stats_alloc() {
+  void *p = NULL;
+#if defined(_MSC_VER)
+  p = _aligned_malloc(sizeof(ThreadStats), kCacheLineSize);
+#else
+  if (posix_memalign(&p, kCacheLineSize, sizeof(ThreadStats)) != 0) {
+    p = NULL;
+  }
+#endif
+  if (p == NULL) {
+    return NULL;
+  }
+  // all zero is a valid initial state of the atomics
+  memset(p, 0, sizeof(ThreadStats));
+  return static_cast<ThreadStats *>(p);
+}
+
+void thread_stats_free(ThreadStats *stats) {
+  for (int i = 0; i < kTracingMaxMetrics; i++) {
+    delete stats->histograms[i].load(std::memory_order_relaxed);
+  }
+#if defined(_MSC_VER)
+  _aligned_free(stats);
+#else
+  free(stats);
+#endif
+}
+
+//------------------------------------------------------------------------------
+// metric registry
+
+std::mutex g_registry_mutex;
+std::unordered_map<std::string, unsigned int> g_metric_ids;
+std::string g_metric_names[kTracingMaxMetrics];
+std::atomic<unsigned int> g_num_metrics(0);
+std::string g_metric_name_prefix;
+
+// all the shards, exited ones are merged and freed by the tracing thread
+std::vector<ThreadStats *> g_thread_stats;
+
+std::unordered_map<std::string, unsigned int> g_status_ids;
+std::string g_status_names[kTracingMaxStatus];
+std::atomic<unsigned int> g_num_status(0);
+
+struct StatusValue {
+  double value;
+  uint64_t stamp;  // when it was reported, the latest one wins
+};
+
+// status values of the exited threads, guarded by g_registry_mutex
+StatusValue g_retired_status[kTracingMaxStatus];
+
+struct ThreadStatsHolder {
+  ThreadStats *stats;
+  ThreadStatsHolder() : stats(NULL) {}
+  ~ThreadStatsHolder() {
+    if (stats != NULL) {
+      stats->exited.store(true, std::memory_order_release);
     }
   }
-  metrics_name.push_back(metric);
-  return metrics_name.size();
+};
+
+thread_local ThreadStats *t_stats = NULL;
+thread_local ThreadStatsHolder t_stats_holder;
+
+ThreadStats *register_thread_stats() {
+  ThreadStats *stats = thread_stats_alloc();
+  if (stats == NULL) {
+    return NULL;
+  }
+  {
+    std::lock_guard<std::mutex> guard(g_registry_mutex);
+    g_thread_stats.push_back(stats);
+  }
+  t_stats_holder.stats = stats;
+  t_stats = stats;
+  return stats;
 }
 
-void tracing_counter_inc(unsigned int metric_id) {}
+inline ThreadStats *thread_stats() {
+  ThreadStats *stats = t_stats;
+  if (stats != NULL) {
+    return stats;
+  }
+  return register_thread_stats();
+}
+
+//------------------------------------------------------------------------------
+// spans
+
+enum { kMaxSpanNames = 1024 };
+enum { kMaxThreadFreeSpans = 16 };
+// kept spans waiting for the tracing thread, more are dropped
+enum { kMaxPendingSpans = 4096 };
+// wake up the tracing thread early when so many spans are pending
+enum { kSpansFlushThreshold = 256 };
+
+std::mutex g_span_name_mutex;
+std::unordered_map<std::string, uint32_t> g_span_name_ids;
+std::string g_span_names[kMaxSpanNames];
+std::atomic<uint32_t> g_num_span_names(0);
+
+uint32_t g_span_sample_rate = 0;
+uint32_t g_span_slow_threshold = 0;
+FILE *g_span_output = NULL;
+bool g_span_output_started = false;
+std::atomic<uint32_t> g_span_thread_ids(0);
+
+std::mutex g_spans_mutex;
+std::vector<Spans *> g_spans_pending;
+std::vector<Spans *> g_spans_free;
+
+struct SpansPool {
+  uint32_t thread_id;
+  uint32_t requests;
+  std::vector<Spans *> free_list;
+  SpansPool()
+      : thread_id(g_span_thread_ids.fetch_add(1, std::memory_order_relaxed)),
+        requests(0) {}
+  ~SpansPool() {
+    std::lock_guard<std::mutex> guard(g_spans_mutex);
+    g_spans_free.insert(g_spans_free.end(), free_list.begin(),
+                        free_list.end());
+  }
+};
+
+thread_local SpansPool t_spans_pool;
+
+Spans *spans_get() {
+  SpansPool &pool = t_spans_pool;
+  if (pool.free_list.empty()) {
+    std::lock_guard<std::mutex> guard(g_spans_mutex);
+    while (!g_spans_free.empty() &&
+           pool.free_list.size() < kMaxThreadFreeSpans / 2) {
+      pool.free_list.push_back(g_spans_free.back());
+      g_spans_free.pop_back();
+    }
+  }
+  if (pool.free_list.empty()) {
+    return new Spans;
+  }
+  Spans *spans = pool.free_list.back();
+  pool.free_list.pop_back();
+  return spans;
+}
 
-void tracing_counter_dec(unsigned int metric_id) {}
+void spans_put(Spans *spans) {
+  SpansPool &pool = t_spans_pool;
+  if (pool.free_list.size() < kMaxThreadFreeSpans) {
+    pool.free_list.push_back(spans);
+    return;
+  }
+  std::lock_guard<std::mutex> guard(g_spans_mutex);
+  g_spans_free.push_back(spans);
+}
 
-uint64_t tracing_timer_start() { return walltime::microseconds_since_epoch(); }
+void write_json_string(FILE *file, const char *s) {
+  fputc('"', file);
+  for (; *s != '\0'; s++) {
+    if (*s == '"' || *s == '\\') {
+      fputc('\\', file);
+    }
+    if (static_cast<unsigned char>(*s) >= 0x20) {
+      fputc(*s, file);
+    }
+  }
+  fputc('"', file);
+}
 
-void tracing_timer_stop(unsigned int metric_id, uint64_t start_time) {}
+// one complete "X" event for the span that starts at span[start], a span
+// that never stopped is marked truncated
+void write_span(FILE *file, const Spans *spans, uint64_t base, uint32_t start,
+                uint32_t stop_timestamp, bool stopped) {
+  const Span &s = spans->span[start];
+  uint32_t num_names = g_num_span_names.load(std::memory_order_acquire);
+  const char *name = s.base.span_name < num_names
+                         ? g_span_names[s.base.span_name].c_str()
+                         : "unknown";
+  fprintf(file,
+          "{\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%llu,\"dur\":%u,"
+          "\"name\":",
+          spans->thread_id,
+          static_cast<unsigned long long>(base + s.base.timestamp),
+          stop_timestamp - s.base.timestamp);
+  write_json_string(file, name);
+  fprintf(file, ",\"args\":{\"id\":%u,\"parent\":%u%s}},\n",
+          spans->span[start + 1].id.span_id,
+          spans->span[start + 1].id.parent_id,
+          stopped ? "" : ",\"truncated\":true");
+}
+
+// Every SPAN_STOP closes the latest open SPAN_START of the same name into a
+// complete event, so the requests that share a thread, like those of an
+// event loop, never nest into each other. A span still open when the arena
+// ends, truncated or never stopped, lasts until the last event recorded.
+void write_spans(FILE *file, const Spans *spans) {
+  uint64_t base = ming::monotonic_to_wall_microseconds(
+      spans->create_timestamp * ming::NSEC_PER_USEC);
+  uint32_t open[kMaxSpanItems / 2];  // the starts not stopped yet
+  uint32_t num_open = 0;
+  uint32_t last_timestamp = 0;
+  // a SPAN_START always has its id record, the arena checks for two items
+  for (uint32_t i = 0; i < spans->num_items; i++) {
+    const Span &s = spans->span[i];
+    last_timestamp = s.base.timestamp;
+    if ((s.base.span_name & kSpanStopFlag) == 0) {
+      open[num_open++] = i++;
+      continue;
+    }
+    uint32_t name_id = s.base.span_name & ~kSpanStopFlag;
+    uint32_t k = num_open;
+    while (k > 0 && spans->span[open[k - 1]].base.span_name != name_id) {
+      k--;
+    }
+    if (k == 0) {
+      continue;  // a stop without its start
+    }
+    write_span(file, spans, base, open[k - 1], s.base.timestamp, true);
+    memmove(&open[k - 1], &open[k], (num_open - k) * sizeof(open[0]));
+    num_open--;
+  }
+  while (num_open > 0) {
+    write_span(file, spans, base, open[--num_open], last_timestamp, false);
+  }
+}
+
+void flush_spans() {
+  std::vector<Spans *> pending;
+  {
+    std::lock_guard<std::mutex> guard(g_spans_mutex);
+    pending.swap(g_spans_pending);
+  }
+  if (pending.empty()) {
+    return;
+  }
+  FILE *file = g_span_output;
+  if (file != NULL) {
+    if (!g_span_output_started) {
+      // the closing ']' is optional in the trace event format, so the file
+      // is valid even if the process is killed
+      fputs("[\n", file);
+      g_span_output_started = true;
+    }
+    for (size_t i = 0; i < pending.size(); i++) {
+      write_spans(file, pending[i]);
+    }
+    fflush(file);
+  }
+  std::lock_guard<std::mutex> guard(g_spans_mutex);
+  g_spans_free.insert(g_spans_free.end(), pending.begin(), pending.end());
+}
+
+//------------------------------------------------------------------------------
+// status
+
+inline uint64_t double_bits(double v) {
+  uint64_t bits;
+  memcpy(&bits, &v, sizeof(bits));
+  return bits;
+}
+
+inline double bits_double(uint64_t bits) {
+  double v;
+  memcpy(&v, &bits, sizeof(v));
+  return v;
+}
+
+// merge the values of a shard into values, retry while the owner thread is
+// writing
+void read_status(const ThreadStats *stats, StatusValue *values) {
+  unsigned int n = g_num_status.load(std::memory_order_acquire);
+  uint64_t bits[kTracingMaxStatus];
+  uint64_t stamps[kTracingMaxStatus];
+  for (int spins = 0;; spins++) {
+    uint32_t seq1 = stats->status_seq.load(std::memory_order_acquire);
+    if ((seq1 & 1) == 0) {
+      for (unsigned int i = 0; i < n; i++) {
+        bits[i] = stats->status_values[i].load(std::memory_order_relaxed);
+        stamps[i] = stats->status_stamps[i].load(std::memory_order_relaxed);
+      }
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (stats->status_seq.load(std::memory_order_relaxed) == seq1) {
+        break;
+      }
+    }
+    if (spins > 16) {
+      std::this_thread::yield();
+    }
+  }
+  for (unsigned int i = 0; i < n; i++) {
+    if (stamps[i] > values[i].stamp) {
+      values[i].value = bits_double(bits[i]);
+      values[i].stamp = stamps[i];
+    }
+  }
+}
+
+// Prometheus names are [a-zA-Z_:][a-zA-Z0-9_:]*
+std::string prometheus_name(const std::string &name) {
+  std::string result = g_metric_name_prefix + name;
+  for (size_t i = 0; i < result.size(); i++) {
+    char c = result[i];
+    if (!((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_' ||
+          c == ':' || (i > 0 && c >= '0' && c <= '9'))) {
+      result[i] = '_';
+    }
+  }
+  return result;
+}
+
+// the names in format are unbounded, a line longer than buf is formatted
+// again into text itself
+void append_format(std::string *text, const char *format, ...) {
+  char buf[512];
+  va_list args, retry;
+  va_start(args, format);
+  va_copy(retry, args);
+  int n = vsnprintf(buf, sizeof(buf), format, args);
+  va_end(args);
+  if (n > 0 && n < static_cast<int>(sizeof(buf))) {
+    text->append(buf, n);
+  } else if (n > 0) {
+    size_t size = text->size();
+    text->resize(size + n + 1);
+    vsnprintf(&(*text)[size], n + 1, format, retry);
+    text->resize(size + n);
+  }
+  va_end(retry);
+}
+
+void append_status_text(std::string *text) {
+  unsigned int n = g_num_status.load(std::memory_order_acquire);
+  StatusValue values[kTracingMaxStatus];
+  {
+    // the shards are only freed under this lock
+    std::lock_guard<std::mutex> guard(g_registry_mutex);
+    memcpy(values, g_retired_status, sizeof(values));
+    for (size_t i = 0; i < g_thread_stats.size(); i++) {
+      read_status(g_thread_stats[i], values);
+    }
+  }
+  for (unsigned int i = 0; i < n; i++) {
+    if (values[i].stamp == 0) {
+      continue;
+    }
+    std::string name = prometheus_name(g_status_names[i]);
+    append_format(text, "# TYPE %s gauge\n%s %.15g\n", name.c_str(),
+                  name.c_str(), values[i].value);
+  }
+}
+
+// statistics of the last interval, rebuilt by the tracing thread
+std::mutex g_stats_text_mutex;
+std::string g_stats_text;
+std::string g_status_file;
+
+void write_status_file() {
+  if (g_status_file.empty()) {
+    return;
+  }
+  std::string text;
+  tracing_status_text(&text);
+  // readers never see a partial file
+  std::string tmp = g_status_file + ".tmp";
+  FILE *file = fopen(tmp.c_str(), "w");
+  if (file == NULL) {
+    return;
+  }
+  bool ok = fwrite(text.data(), 1, text.size(), file) == text.size();
+  ok = (fclose(file) == 0) && ok;
+  if (!ok || rename(tmp.c_str(), g_status_file.c_str()) != 0) {
+    remove(tmp.c_str());
+  }
+}
+
+std::string g_status_socket;
+
+#if !defined(_MSC_VER)
+int g_status_listen_fd = -1;
+std::atomic<bool> g_status_running(false);
+std::thread g_status_thread;
+
+enum { kStatusPollMilliseconds = 200 };
+enum { kStatusRequestTimeout = 100 };  // milliseconds
+
+bool send_all(int fd, const char *data, size_t len) {
+  while (len > 0) {
+    ssize_t n = send(fd, data, len, MSG_NOSIGNAL);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    data += n;
+    len -= n;
+  }
+  return true;
+}
+
+void serve_status(int fd) {
+  // An HTTP client sends a request first, a plain "nc -U" does not. Read
+  // the request headers so that closing the socket does not reset it.
+  std::string request;
+  char buf[1024];
+  while (request.size() < 8192 &&
+         request.find("\r\n\r\n") == std::string::npos) {
+    struct pollfd pfd = {fd, POLLIN, 0};
+    if (poll(&pfd, 1, kStatusRequestTimeout) <= 0) {
+      break;
+    }
+    ssize_t n = recv(fd, buf, sizeof(buf), 0);
+    if (n <= 0) {
+      break;
+    }
+    request.append(buf, n);
+  }
+
+  std::string body;
+  tracing_status_text(&body);
+  if (request.compare(0, 4, "GET ") == 0) {
+    std::string header;
+    append_format(&header,
+                  "HTTP/1.0 200 OK\r\n"
+                  "Content-Type: text/plain; version=0.0.4\r\n"
+                  "Content-Length: %zu\r\n"
+                  "Connection: close\r\n\r\n",
+                  body.size());
+    if (!send_all(fd, header.data(), header.size())) {
+      return;
+    }
+  }
+  send_all(fd, body.data(), body.size());
+}
+
+void status_server_thread(int listen_fd) {
+  while (g_status_running.load(std::memory_order_relaxed)) {
+    struct pollfd pfd = {listen_fd, POLLIN, 0};
+    if (poll(&pfd, 1, kStatusPollMilliseconds) <= 0) {
+      continue;
+    }
+    int fd = accept(listen_fd, NULL, NULL);
+    if (fd < 0) {
+      continue;
+    }
+    serve_status(fd);
+    close(fd);
+  }
+}
+
+bool status_server_start() {
+  if (g_status_socket.empty()) {
+    return true;
+  }
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (g_status_socket.size() >= sizeof(addr.sun_path)) {
+    return false;
+  }
+  memcpy(addr.sun_path, g_status_socket.c_str(), g_status_socket.size());
+
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    return false;
+  }
+  // a stale socket of the last run
+  unlink(g_status_socket.c_str());
+  if (bind(fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) !=
+          0 ||
+      listen(fd, 16) != 0) {
+    close(fd);
+    return false;
+  }
+  g_status_listen_fd = fd;
+  g_status_running.store(true, std::memory_order_relaxed);
+  g_status_thread = std::thread(status_server_thread, fd);
+  return true;
+}
+
+void status_server_stop() {
+  if (g_status_listen_fd < 0) {
+    return;
+  }
+  g_status_running.store(false, std::memory_order_relaxed);
+  g_status_thread.join();
+  close(g_status_listen_fd);
+  g_status_listen_fd = -1;
+  unlink(g_status_socket.c_str());
+}
+#else
+bool status_server_start() { return g_status_socket.empty(); }
+void status_server_stop() {}
+#endif
+
+//------------------------------------------------------------------------------
+// tracing thread
+
+// running totals of a metric as seen by the tracing thread
+struct MetricTotals {
+  uint64_t counter;
+  uint64_t count;
+  uint64_t sum;
+  std::vector<uint64_t> buckets;
+};
+
+struct Aggregator {
+  MetricTotals retired[kTracingMaxMetrics];  // from the exited threads
+  MetricTotals last[kTracingMaxMetrics];     // at the last snapshot
+  MetricTotals current[kTracingMaxMetrics];
+  TracingMetricSnapshot snapshot[kTracingMaxMetrics];
+};
+
+int g_flush_interval = kDefaultFlushIntervals;
+FILE *g_output = NULL;
+tracing_snapshot_handler g_handler = NULL;
+void *g_handler_arg = NULL;
+
+std::mutex g_thread_mutex;
+std::condition_variable g_thread_cond;
+std::thread g_thread;
+bool g_thread_running = false;
+Aggregator *g_aggregator = NULL;
+
+void add_totals(MetricTotals *totals, const ThreadStats *stats, int i) {
+  totals->counter += stats->counters[i].load(std::memory_order_relaxed);
+  Histogram *h = stats->histograms[i].load(std::memory_order_acquire);
+  if (h == NULL) {
+    return;
+  }
+  totals->count += h->count.load(std::memory_order_relaxed);
+  totals->sum += h->sum.load(std::memory_order_relaxed);
+  if (totals->buckets.empty()) {
+    totals->buckets.resize(kHistogramBuckets);
+  }
+  for (int b = 0; b < kHistogramBuckets; b++) {
+    totals->buckets[b] += h->buckets[b].load(std::memory_order_relaxed);
+  }
+}
+
+void merge_shards(Aggregator *agg, int num_metrics) {
+  std::vector<ThreadStats *> live;
+  std::vector<ThreadStats *> exited;
+  {
+    std::lock_guard<std::mutex> guard(g_registry_mutex);
+    for (size_t i = 0; i < g_thread_stats.size(); i++) {
+      ThreadStats *stats = g_thread_stats[i];
+      if (stats->exited.load(std::memory_order_acquire)) {
+        read_status(stats, g_retired_status);
+        exited.push_back(stats);
+      } else {
+        live.push_back(stats);
+      }
+    }
+    g_thread_stats = live;
+  }
+
+  for (size_t s = 0; s < exited.size(); s++) {
+    for (int i = 0; i < num_metrics; i++) {
+      add_totals(&agg->retired[i], exited[s], i);
+    }
+    thread_stats_free(exited[s]);
+  }
+
+  for (int i = 0; i < num_metrics; i++) {
+    MetricTotals *cur = &agg->current[i];
+    cur->counter = agg->retired[i].counter;
+    cur->count = agg->retired[i].count;
+    cur->sum = agg->retired[i].sum;
+    cur->buckets = agg->retired[i].buckets;
+  }
+  // a thread registered after the copy is counted in the next interval
+  for (size_t s = 0; s < live.size(); s++) {
+    for (int i = 0; i < num_metrics; i++) {
+      add_totals(&agg->current[i], live[s], i);
+    }
+  }
+}
+
+uint64_t percentile(const std::vector<uint64_t> &delta, uint64_t count,
+                    double p) {
+  uint64_t rank = static_cast<uint64_t>(count * p);
+  if (rank >= count) {
+    rank = count - 1;
+  }
+  uint64_t seen = 0;
+  for (int b = 0; b < kHistogramBuckets; b++) {
+    seen += delta[b];
+    if (seen > rank) {
+      return bucket_upper_bound(b);
+    }
+  }
+  return bucket_upper_bound(kHistogramBuckets - 1);
+}
+
+// Prometheus text of a metric: counters as gauges because they can be
+// decremented, timers as summaries of the last interval
+void append_metric_text(std::string *text, const std::string &metric_name,
+                        const MetricTotals &totals,
+                        const TracingMetricSnapshot &snap) {
+  std::string name = prometheus_name(metric_name);
+  const char *n = name.c_str();
+  if (totals.buckets.empty() || totals.counter != 0) {
+    append_format(text, "# TYPE %s gauge\n%s %lld\n", n, n,
+                  static_cast<long long>(snap.counter));
+  }
+  if (!totals.buckets.empty()) {
+    append_format(text,
+                  "# TYPE %s_microseconds summary\n"
+                  "%s_microseconds{quantile=\"0.5\"} %llu\n"
+                  "%s_microseconds{quantile=\"0.9\"} %llu\n"
+                  "%s_microseconds{quantile=\"0.99\"} %llu\n"
+                  "%s_microseconds{quantile=\"0.999\"} %llu\n",
+                  n, n, static_cast<unsigned long long>(snap.p50), n,
+                  static_cast<unsigned long long>(snap.p90), n,
+                  static_cast<unsigned long long>(snap.p99), n,
+                  static_cast<unsigned long long>(snap.p999));
+    append_format(text,
+                  "%s_microseconds_sum %llu\n%s_microseconds_count %llu\n",
+                  n, static_cast<unsigned long long>(totals.sum), n,
+                  static_cast<unsigned long long>(totals.count));
+  }
+}
+
+int build_snapshot(Aggregator *agg, int num_metrics, std::string *text) {
+  std::vector<uint64_t> delta(kHistogramBuckets);
+  int n = 0;
+  for (int i = 0; i < num_metrics; i++) {
+    MetricTotals *cur = &agg->current[i];
+    MetricTotals *last = &agg->last[i];
+    TracingMetricSnapshot *snap = &agg->snapshot[n];
+    snap->name = g_metric_names[i].c_str();
+    snap->counter = static_cast<int64_t>(cur->counter);
+    snap->counter_delta = static_cast<int64_t>(cur->counter - last->counter);
+    snap->count = cur->count - last->count;
+    snap->sum = cur->sum - last->sum;
+    snap->p50 = snap->p90 = snap->p99 = snap->p999 = snap->max = 0;
+    if (snap->count > 0) {
+      if (last->buckets.empty()) {
+        last->buckets.resize(kHistogramBuckets);
+      }
+      int highest = 0;
+      for (int b = 0; b < kHistogramBuckets; b++) {
+        delta[b] = cur->buckets[b] - last->buckets[b];
+        if (delta[b] != 0) {
+          highest = b;
+        }
+      }
+      snap->p50 = percentile(delta, snap->count, 0.5);
+      snap->p90 = percentile(delta, snap->count, 0.9);
+      snap->p99 = percentile(delta, snap->count, 0.99);
+      snap->p999 = percentile(delta, snap->count, 0.999);
+      snap->max = bucket_upper_bound(highest);
+    }
+    last->counter = cur->counter;
+    last->count = cur->count;
+    last->sum = cur->sum;
+    last->buckets = cur->buckets;
+    append_metric_text(text, g_metric_names[i], *cur, *snap);
+    // skip the idle metrics
+    if (snap->counter_delta != 0 || snap->count != 0) {
+      n++;
+    }
+  }
+  return n;
+}
+
+void write_snapshot(const TracingMetricSnapshot *metrics, int num_metrics,
+                    void *arg) {
+  FILE *file = static_cast<FILE *>(arg);
+  if (file == NULL) {
+    return;
+  }
+  const char *prefix = g_metric_name_prefix.c_str();
+  for (int i = 0; i < num_metrics; i++) {
+    const TracingMetricSnapshot &m = metrics[i];
+    if (m.count == 0) {
+      fprintf(file, "%s%s counter=%lld delta=%lld\n", prefix, m.name,
+              static_cast<long long>(m.counter),
+              static_cast<long long>(m.counter_delta));
+    } else {
+      fprintf(file,
+              "%s%s count=%llu avg=%llu p50=%llu p90=%llu p99=%llu "
+              "p999=%llu max=%llu\n",
+              prefix, m.name, static_cast<unsigned long long>(m.count),
+              static_cast<unsigned long long>(m.sum / m.count),
+              static_cast<unsigned long long>(m.p50),
+              static_cast<unsigned long long>(m.p90),
+              static_cast<unsigned long long>(m.p99),
+              static_cast<unsigned long long>(m.p999),
+              static_cast<unsigned long long>(m.max));
+    }
+  }
+  fflush(file);
+}
+
+void flush_statistics(Aggregator *agg) {
+  int num_metrics =
+      static_cast<int>(g_num_metrics.load(std::memory_order_acquire));
+  merge_shards(agg, num_metrics);
+  std::string text;
+  int n = build_snapshot(agg, num_metrics, &text);
+  {
+    std::lock_guard<std::mutex> guard(g_stats_text_mutex);
+    g_stats_text.swap(text);
+  }
+  if (n > 0 && tracing_is_stat_enabled()) {
+    if (g_handler != NULL) {
+      g_handler(agg->snapshot, n, g_handler_arg);
+    } else {
+      write_snapshot(agg->snapshot, n, g_output);
+    }
+  }
+  write_status_file();
+}
+
+void tracing_thread(Aggregator *agg) {
+  std::chrono::steady_clock::time_point next =
+      std::chrono::steady_clock::now() +
+      std::chrono::seconds(g_flush_interval);
+  std::unique_lock<std::mutex> lock(g_thread_mutex);
+  while (g_thread_running) {
+    g_thread_cond.wait_until(lock, next);
+    lock.unlock();
+    // also woken up by tracing_spans_free() when many spans are pending
+    flush_spans();
+    if (std::chrono::steady_clock::now() >= next) {
+      flush_statistics(agg);
+      next += std::chrono::seconds(g_flush_interval);
+    }
+    lock.lock();
+  }
+}
+
+}  // namespace
+
+unsigned int tracing_metric_id(const char *metric) {
+  std::lock_guard<std::mutex> guard(g_registry_mutex);
+  std::unordered_map<std::string, unsigned int>::iterator it =
+      g_metric_ids.find(metric);
+  if (it != g_metric_ids.end()) {
+    return it->second;
+  }
+  unsigned int id = g_num_metrics.load(std::memory_order_relaxed);
+  if (id >= kTracingMaxMetrics) {
+    return kTracingMaxMetrics;  // ignored by the recording functions
+  }
+  g_metric_names[id] = metric;
+  g_metric_ids[metric] = id;
+  // publish the name before the tracing thread can see the id
+  g_num_metrics.store(id + 1, std::memory_order_release);
+  return id;
+}
+
+void tracing_counter_inc(unsigned int metric_id) {
+  ThreadStats *stats = thread_stats();
+  if (stats == NULL || metric_id >= kTracingMaxMetrics) {
+    return;
+  }
+  shard_add(&stats->counters[metric_id], 1);
+}
+
+void tracing_counter_dec(unsigned int metric_id) {
+  ThreadStats *stats = thread_stats();
+  if (stats == NULL || metric_id >= kTracingMaxMetrics) {
+    return;
+  }
+  shard_add(&stats->counters[metric_id], static_cast<uint64_t>(-1));
+}
+
+uint64_t tracing_timer_start() { return ming::monotonic_microseconds(); }
+
+void tracing_timer_stop(unsigned int metric_id, uint64_t start_time) {
+  ThreadStats *stats = thread_stats();
+  if (stats == NULL || metric_id >= kTracingMaxMetrics) {
+    return;
+  }
+  uint64_t now = ming::monotonic_microseconds();
+  uint64_t elapsed = now > start_time ? now - start_time : 0;
+
+  Histogram *h = stats->histograms[metric_id].load(std::memory_order_relaxed);
+  if (h == NULL) {
+    h = new Histogram();
+    memset(static_cast<void *>(h), 0, sizeof(Histogram));
+    stats->histograms[metric_id].store(h, std::memory_order_release);
+  }
+  shard_add(&h->count, 1);
+  shard_add(&h->sum, elapsed);
+  shard_add(&h->buckets[bucket_index(elapsed)], 1);
+}
+
+uint32_t tracing_span_name_id(const char *span_name) {
+  std::lock_guard<std::mutex> guard(g_span_name_mutex);
+  std::unordered_map<std::string, uint32_t>::iterator it =
+      g_span_name_ids.find(span_name);
+  if (it != g_span_name_ids.end()) {
+    return it->second;
+  }
+  uint32_t id = g_num_span_names.load(std::memory_order_relaxed);
+  if (id >= kMaxSpanNames) {
+    return kMaxSpanNames;  // written as "unknown"
+  }
+  g_span_names[id] = span_name;
+  g_span_name_ids[span_name] = id;
+  g_num_span_names.store(id + 1, std::memory_order_release);
+  return id;
+}
+
+Spans *tracing_spans_alloc() {
+  SpansPool &pool = t_spans_pool;
+  bool sampling = g_span_sample_rate != 0 &&
+                  (pool.requests++ % g_span_sample_rate) == 0;
+  if (!sampling && g_span_slow_threshold == 0) {
+    return NULL;
+  }
+  Spans *spans = spans_get();
+  spans->sampling = sampling;
+  spans->truncated = false;
+  spans->num_items = 0;
+  spans->thread_id = pool.thread_id;
+  spans->create_timestamp = tracing_timer_start();
+  return spans;
+}
+
+void tracing_spans_free(Spans *spans, bool discard) {
+  bool keep = false;
+  if (!discard && spans->num_items > 0) {
+    keep = spans->sampling;
+    if (!keep && g_span_slow_threshold != 0) {
+      // tail based: the request turned out to be slow
+      keep = tracing_timer_start() - spans->create_timestamp >=
+             g_span_slow_threshold;
+    }
+  }
+  if (!keep) {
+    spans_put(spans);
+    return;
+  }
+
+  size_t pending;
+  {
+    std::lock_guard<std::mutex> guard(g_spans_mutex);
+    pending = g_spans_pending.size();
+    if (pending < kMaxPendingSpans) {
+      g_spans_pending.push_back(spans);
+    }
+  }
+  if (pending >= kMaxPendingSpans) {
+    static unsigned int dropped_id = tracing_metric_id("tracing.spans_dropped");
+    tracing_counter_inc(dropped_id);
+    spans_put(spans);
+  } else if (pending + 1 == kSpansFlushThreshold) {
+    g_thread_cond.notify_one();
+  }
+}
+
+unsigned int tracing_status_id(const char *name) {
+  std::lock_guard<std::mutex> guard(g_registry_mutex);
+  std::unordered_map<std::string, unsigned int>::iterator it =
+      g_status_ids.find(name);
+  if (it != g_status_ids.end()) {
+    return it->second;
+  }
+  unsigned int id = g_num_status.load(std::memory_order_relaxed);
+  if (id >= kTracingMaxStatus) {
+    return kTracingMaxStatus;  // ignored by tracing_status_report()
+  }
+  g_status_names[id] = name;
+  g_status_ids[name] = id;
+  g_num_status.store(id + 1, std::memory_order_release);
+  return id;
+}
+
+void tracing_status_report(unsigned int status_id, double value) {
+  ThreadStats *stats = thread_stats();
+  if (stats == NULL || status_id >= kTracingMaxStatus) {
+    return;
+  }
+  uint64_t now = tracing_timer_start();
+  uint32_t seq = stats->status_seq.load(std::memory_order_relaxed);
+  stats->status_seq.store(seq + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  stats->status_values[status_id].store(double_bits(value),
+                                        std::memory_order_relaxed);
+  stats->status_stamps[status_id].store(now, std::memory_order_relaxed);
+  stats->status_seq.store(seq + 2, std::memory_order_release);
+}
+
+void tracing_status_text(std::string *text) {
+  text->clear();
+  append_status_text(text);
+  std::lock_guard<std::mutex> guard(g_stats_text_mutex);
+  text->append(g_stats_text);
+}
 
 //============================================================================
 
+void tracing_set_flush_interval(int seconds) {
+  g_flush_interval = seconds > 0 ? seconds : kDefaultFlushIntervals;
+}
+
+void tracing_set_output(FILE *file) { g_output = file; }
+
+void tracing_set_span_output(FILE *file) { g_span_output = file; }
+
+void tracing_set_status_file(const char *path) {
+  g_status_file = path != NULL ? path : "";
+}
+
+void tracing_set_status_socket(const char *path) {
+  g_status_socket = path != NULL ? path : "";
+}
+
+void tracing_set_span_sampling(uint32_t sample_rate,
+                               uint32_t slow_threshold_us) {
+  g_span_sample_rate = sample_rate;
+  g_span_slow_threshold = slow_threshold_us;
+}
+
+void tracing_set_snapshot_handler(tracing_snapshot_handler handler,
+                                  void *arg) {
+  g_handler = handler;
+  g_handler_arg = arg;
+}
+
 //============================================================================
 
-bool tracing_thread_start() { return true; }
+bool tracing_thread_start() {
+  std::lock_guard<std::mutex> guard(g_thread_mutex);
+  if (g_thread_running) {
+    return true;
+  }
+  if (g_aggregator == NULL) {
+    g_aggregator = new Aggregator();
+  }
+  g_thread_running = true;
+  g_thread = std::thread(tracing_thread, g_aggregator);
+  return status_server_start();
+}
 
-bool tracing_thread_stop() { return true; }
+bool tracing_thread_stop() {
+  {
+    std::lock_guard<std::mutex> guard(g_thread_mutex);
+    if (!g_thread_running) {
+      return true;
+    }
+    g_thread_running = false;
+  }
+  status_server_stop();
+  g_thread_cond.notify_one();
+  g_thread.join();
+  // the last interval
+  flush_spans();
+  flush_statistics(g_aggregator);
+  return true;
+}
 
-void tracing_init(const char *metric_name_prefix) {}
+void tracing_init(const char *metric_name_prefix) {
+  g_metric_name_prefix = metric_name_prefix != NULL ? metric_name_prefix : "";
+  if (g_output == NULL) {
+    g_output = stderr;
+  }
+  ming::tsc_clock_init();
+  tracing_thread_start();
+}
 
 void tracing_config(bool stat_enabled, bool status_report_enabled,
-                    bool span_enabled) {}
+                    bool span_enabled) {
+  g_tracing_stat_enabled.store(stat_enabled, std::memory_order_relaxed);
+  g_tracing_status_report_enabled.store(status_report_enabled,
+                                        std::memory_order_relaxed);
+  g_tracing_span_enabled.store(span_enabled, std::memory_order_relaxed);
+}
@@ -1,13 +1,54 @@
 #ifndef TRACING_H_
 #define TRACING_H_
 
-#include "walltime.h"
-#include <vector>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <atomic>
+#include <string>
+
+#include "ming/time.h"
 
 void tracing_init(const char *metric_name_prefix);
 void tracing_config(bool stat_enabled, bool status_report_enabled,
                     bool span_enabled);
 
+//------------------------------------------------------------------------------
+// statistics snapshots
+//
+// Counters and timers are recorded in per-thread shards without any atomic
+// read-modify-write. The tracing thread merges the shards every
+// flush_interval seconds and passes a snapshot of the interval to the
+// handler, by default a line per metric written to the output file.
+
+enum { kTracingMaxMetrics = 1024 };
+
+struct TracingMetricSnapshot {
+  const char *name;
+  int64_t counter;        // current value
+  int64_t counter_delta;  // change in this interval
+  uint64_t count;         // timer samples in this interval
+  uint64_t sum;           // in microseconds
+  // in microseconds, the upper bound of the bucket, within 12.5%
+  uint64_t p50;
+  uint64_t p90;
+  uint64_t p99;
+  uint64_t p999;
+  uint64_t max;
+};
+
+typedef void (*tracing_snapshot_handler)(
+    const TracingMetricSnapshot *metrics, int num_metrics, void *arg);
+
+// call before tracing_init()
+void tracing_set_flush_interval(int seconds);
+void tracing_set_output(FILE *file);
+void tracing_set_snapshot_handler(tracing_snapshot_handler handler,
+                                  void *arg);
+
+bool tracing_thread_start();
+bool tracing_thread_stop();
+
 //------------------------------------------------------------------------------
 // internal functions
 unsigned int tracing_metric_id(const char *metric);
@@ -16,47 +57,104 @@ void tracing_counter_dec(unsigned int metric_id);
 uint64_t tracing_timer_start();
 void tracing_timer_stop(unsigned int metric_id, uint64_t start_time);
 
-inline bool tracing_is_stat_enabled();
-inline bool tracing_is_status_report_enabled();
-inline bool tracing_is_span_enabled();
+extern std::atomic<bool> g_tracing_stat_enabled;
+extern std::atomic<bool> g_tracing_status_report_enabled;
+extern std::atomic<bool> g_tracing_span_enabled;
+
+inline bool tracing_is_stat_enabled() {
+  return g_tracing_stat_enabled.load(std::memory_order_relaxed);
+}
+inline bool tracing_is_status_report_enabled() {
+  return g_tracing_status_report_enabled.load(std::memory_order_relaxed);
+}
+inline bool tracing_is_span_enabled() {
+  return g_tracing_span_enabled.load(std::memory_order_relaxed);
+}
 
 //------------------------------------------------------------------------------
 // statistics macros
-#define TRACING_COUNTER_INC(metric)                            \
-  {                                                            \
-    static unsigned int metric_id = tracing_metric_id(metric); \
-    tracing_counter_inc(metric_id);                            \
+#define TRACING_COUNTER_INC(metric)                              \
+  {                                                              \
+    if (tracing_is_stat_enabled()) {                             \
+      static unsigned int metric_id = tracing_metric_id(metric); \
+      tracing_counter_inc(metric_id);                            \
+    }                                                            \
   }
 
-#define TRACING_COUNTER_DEC(metric)                            \
-  {                                                            \
-    static unsigned int metric_id = tracing_metric_id(metric); \
-    tracing_counter_dec(metric_id);                            \
+#define TRACING_COUNTER_DEC(metric)                              \
+  {                                                              \
+    if (tracing_is_stat_enabled()) {                             \
+      static unsigned int metric_id = tracing_metric_id(metric); \
+      tracing_counter_dec(metric_id);                            \
+    }                                                            \
   }
 
-// return current time
-#define TRACING_TIMER_START(start_time) \
-  { start_time = tracing_timer_start(); }
+// return current time, 0 if the statistics are disabled
+#define TRACING_TIMER_START(start_time)                                 \
+  {                                                                     \
+    start_time = tracing_is_stat_enabled() ? tracing_timer_start() : 0; \
+  }
 
-#define TRACING_TIMER_STOP(metric, start_time)                 \
-  {                                                            \
-    static unsigned int metric_id = tracing_metric_id(metric); \
-    tracing_timer_stop(metric_id, start_time);                 \
+#define TRACING_TIMER_STOP(metric, start_time)                   \
+  {                                                              \
+    if (start_time != 0) {                                       \
+      static unsigned int metric_id = tracing_metric_id(metric); \
+      tracing_timer_stop(metric_id, start_time);                 \
+    }                                                            \
   }
 
 //------------------------------------------------------------------------------
 // status report macro
-#define TRACING_STATUS_REPORT(name, value)
+//
+// A status is a gauge holding the last value reported by any thread. Every
+// thread writes its own shard under a seqlock, so a reader copies a
+// consistent snapshot of a thread's values without blocking the writers.
+//
+// The status values and the statistics of the last interval are exported in
+// the Prometheus text format: dumped to the status file every flush interval
+// (written to a temporary file and renamed) and served on a Unix domain
+// socket, e.g. curl --unix-socket /run/app.sock http://localhost/metrics
+
+enum { kTracingMaxStatus = 256 };
+
+// call before tracing_init()
+void tracing_set_status_file(const char *path);
+void tracing_set_status_socket(const char *path);
+
+unsigned int tracing_status_id(const char *name);
+void tracing_status_report(unsigned int status_id, double value);
+// the Prometheus text exposition of all the metrics
+void tracing_status_text(std::string *text);
+
+#define TRACING_STATUS_REPORT(name, value)                     \
+  {                                                            \
+    if (tracing_is_status_report_enabled()) {                  \
+      static unsigned int status_id = tracing_status_id(name); \
+      tracing_status_report(status_id, value);                 \
+    }                                                          \
+  }
 
 //------------------------------------------------------------------------------
 // span macro
+//
+// A Spans records the span events of one request into a fixed arena of 8
+// byte entries, no memory is allocated while recording. Spans objects are
+// recycled through a per-thread pool.
+//
+// Head sampling: one request in span_sample_rate is recorded and kept.
+// Keep-on-slow: when span_slow_threshold is set, the other requests are
+// recorded too and kept only if they took at least that long.
+// The kept ones are written by the tracing thread to the span output as
+// complete events of the Chrome trace event format (load it in
+// chrome://tracing or Perfetto).
+
+enum { kSpanStopFlag = 0x80000000U };
+enum { kMaxSpanItems = 250 };
 
 union Span {
   struct {
-    uint32_t
-        span_name;  // span name index in the span_name_list. -1 for SPAN_STOP
-    uint32_t
-        timestamp;  // Event-triggered time, offset to Spans's create_timestamp
+    uint32_t span_name;  // span name id, with kSpanStopFlag for SPAN_STOP
+    uint32_t timestamp;  // in microseconds since Spans's create_timestamp
   } base;
   struct {
     uint32_t span_id;
@@ -65,15 +163,73 @@ union Span {
 };
 
 struct Spans {
-  bool sampling;  // enable statistic on this spans if sampling is true
-  uint64_t create_timestamp;
+  bool sampling;   // head sampled, always kept
+  bool truncated;  // the arena was full, later events are lost
   uint32_t num_items;
-  std::vector<Span> span;
+  uint32_t thread_id;
+  uint64_t create_timestamp;  // monotonic microseconds
+  Span span[kMaxSpanItems];
 };
 
-#define TRACING_SPANS_ALLOC(spans)
-#define TRACING_SPAN_START(spans, span_name, span_id, parent_id)
-#define TRACING_SPAN_STOP(spans, span_name)
-#define TRACING_SPANS_FREE(spans, discard)
+// call before tracing_init()
+void tracing_set_span_output(FILE *file);
+// sample one in sample_rate requests (0 disables the head sampling), also
+// keep the requests slower than slow_threshold_us (0 disables it)
+void tracing_set_span_sampling(uint32_t sample_rate,
+                               uint32_t slow_threshold_us);
+
+uint32_t tracing_span_name_id(const char *span_name);
+// return NULL if the request is not recorded
+Spans *tracing_spans_alloc();
+void tracing_spans_free(Spans *spans, bool discard);
+
+inline void tracing_span_record(Spans *spans, uint32_t name_id,
+                                uint32_t span_id, uint32_t parent_id,
+                                bool start) {
+  uint32_t n = spans->num_items;
+  if (n + (start ? 2 : 1) > kMaxSpanItems) {
+    spans->truncated = true;
+    return;
+  }
+  Span *s = &spans->span[n];
+  s->base.span_name = start ? name_id : (name_id | kSpanStopFlag);
+  s->base.timestamp =
+      static_cast<uint32_t>(tracing_timer_start() - spans->create_timestamp);
+  if (start) {
+    s[1].id.span_id = span_id;
+    s[1].id.parent_id = parent_id;
+  }
+  spans->num_items = n + (start ? 2 : 1);
+}
+
+#define TRACING_SPANS_ALLOC(spans)                                    \
+  {                                                                   \
+    spans = tracing_is_span_enabled() ? tracing_spans_alloc() : NULL; \
+  }
+
+#define TRACING_SPAN_START(spans, span_name, span_id, parent_id)          \
+  {                                                                       \
+    if (spans != NULL) {                                                  \
+      static uint32_t span_name_id = tracing_span_name_id(span_name);     \
+      tracing_span_record(spans, span_name_id, span_id, parent_id, true); \
+    }                                                                     \
+  }
+
+#define TRACING_SPAN_STOP(spans, span_name)                           \
+  {                                                                   \
+    if (spans != NULL) {                                              \
+      static uint32_t span_name_id = tracing_span_name_id(span_name); \
+      tracing_span_record(spans, span_name_id, 0, 0, false);          \
+    }                                                                 \
+  }
+
+// discard drops the recorded spans even if they were sampled
+#define TRACING_SPANS_FREE(spans, discard) \
+  {                                        \
+    if (spans != NULL) {                   \
+      tracing_spans_free(spans, discard);  \
+      spans = NULL;                        \
+    }                                      \
+  }
 
 #endif  // TRACING_H_
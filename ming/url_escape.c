@@ -1,172 +1,283 @@
-// from golang net/url 
-
-enum encodng {
-  kEncodePath           = 1,
-  kEncodePathSegment    = 2,
-  kEncodeHost           = 3,
-  kEncodeZone           = 4,
-  kEncodeUserPassword   = 5,
-  kEncodeQueryComponent = 6,
-  kEncodeFragment       = 7
-};
+// from golang net/url
+
+#include "ming/url_escape.h"
+
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 const char kHexChar[] = "0123456789ABCDEF";
 
-// Return true if the specified character should be escaped when
-// appearing in a URL string, according to RFC 3986.
+// Bit (1 << mode) is set if the character should be escaped when appearing
+// in that part of a URL string, according to RFC 3986.
 //
-// Please be informed that for now shouldEscape does not check all
-// reserved characters correctly. See golang.org/issue/5684.
-int shouldEscape(char c, int mode ) {
-  // §2.3 Unreserved characters (alphanum)
-  if (('A' <= c && c <= 'Z') || ('a' <= c && c <= 'z') || ('0' <= c && c <= '9')) {
-    return 0;
-  }
+// Unreserved characters (§2.3): alphanum and - _ . ~ are never escaped.
+//
+// §3.2.2 Host allows
+//	sub-delims = "!" / "$" / "&" / "'" / "(" / ")" / "*" / "+" / "," / ";" / "="
+// as part of reg-name.
+// We add : because we include :port as part of host.
+// We add [ ] because we include [ipv6]:port as part of host.
+// We add < > because they're the only characters left that
+// we could possibly allow, and Parse will reject them if we
+// escape them (because hosts can't use %-encoding for
+// ASCII bytes).
+//
+// §2.2 Reserved characters $ & + , / : ; = ? @ are allowed in:
+// - kEncodePath (§3.3): all but ?. The RFC saves / ; , for assigning
+//   meaning to individual path segments, the path is manipulated as a whole.
+// - kEncodePathSegment (§3.3): all but / ; , ?
+// - kEncodeUserPassword (§3.2.1): all but @ / ? and the : the parsing of
+//   userinfo treats as special.
+// - kEncodeQueryComponent (§3.4): none, the RFC reserves everything.
+// - kEncodeFragment (§4.1): all, the grammar allows everything.
+//
+// Everything else must be escaped.
+//
+// Please be informed that for now this does not check all reserved
+// characters correctly. See golang.org/issue/5684.
+static const unsigned char kEscapeTable[256] = {
+    0xfe, 0xfe, 0xfe, 0xfe, 0xfe, 0xfe, 0xfe, 0xfe,  /* 0x00 */
+    0xfe, 0xfe, 0xfe, 0xfe, 0xfe, 0xfe, 0xfe, 0xfe,  /* 0x08 */
+    0xfe, 0xfe, 0xfe, 0xfe, 0xfe, 0xfe, 0xfe, 0xfe,  /* 0x10 */
+    0xfe, 0xfe, 0xfe, 0xfe, 0xfe, 0xfe, 0xfe, 0xfe,  /* 0x18 */
+    0xfe, 0xe6, 0xe6, 0xfe, 0x40, 0xfe, 0x40, 0xe6,  /* 0x20 */
+    0xe6, 0xe6, 0xe6, 0x40, 0x44, 0x00, 0x00, 0x7c,  /* 0x28 */
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,  /* 0x30 */
+    0x00, 0x00, 0x60, 0x44, 0xe6, 0x40, 0xe6, 0x7e,  /* 0x38 */
+    0x78, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,  /* 0x40 */
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,  /* 0x48 */
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,  /* 0x50 */
+    0x00, 0x00, 0x00, 0xe6, 0xfe, 0xe6, 0xfe, 0x00,  /* 0x58 */
+    0xfe, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,  /* 0x60 */
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,  /* 0x68 */
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,  /* 0x70 */
+    0x00, 0x00, 0x00, 0xfe, 0xfe, 0xfe, 0x00, 0xfe,  /* 0x78 */
+    0xfe, 0xfe, 0xfe, 0xfe, 0xfe, 0xfe, 0xfe, 0xfe,  /* 0x80 */
+    0xfe, 0xfe, 0xfe, 0xfe, 0xfe, 0xfe, 0xfe, 0xfe,  /* 0x88 */
+    0xfe, 0xfe, 0xfe, 0xfe, 0xfe, 0xfe, 0xfe, 0xfe,  /* 0x90 */
+    0xfe, 0xfe, 0xfe, 0xfe, 0xfe, 0xfe, 0xfe, 0xfe,  /* 0x98 */
+    0xfe, 0xfe, 0xfe, 0xfe, 0xfe, 0xfe, 0xfe, 0xfe,  /* 0xa0 */
+    0xfe, 0xfe, 0xfe, 0xfe, 0xfe, 0xfe, 0xfe, 0xfe,  /* 0xa8 */
+    0xfe, 0xfe, 0xfe, 0xfe, 0xfe, 0xfe, 0xfe, 0xfe,  /* 0xb0 */
+    0xfe, 0xfe, 0xfe, 0xfe, 0xfe, 0xfe, 0xfe, 0xfe,  /* 0xb8 */
+    0xfe, 0xfe, 0xfe, 0xfe, 0xfe, 0xfe, 0xfe, 0xfe,  /* 0xc0 */
+    0xfe, 0xfe, 0xfe, 0xfe, 0xfe, 0xfe, 0xfe, 0xfe,  /* 0xc8 */
+    0xfe, 0xfe, 0xfe, 0xfe, 0xfe, 0xfe, 0xfe, 0xfe,  /* 0xd0 */
+    0xfe, 0xfe, 0xfe, 0xfe, 0xfe, 0xfe, 0xfe, 0xfe,  /* 0xd8 */
+    0xfe, 0xfe, 0xfe, 0xfe, 0xfe, 0xfe, 0xfe, 0xfe,  /* 0xe0 */
+    0xfe, 0xfe, 0xfe, 0xfe, 0xfe, 0xfe, 0xfe, 0xfe,  /* 0xe8 */
+    0xfe, 0xfe, 0xfe, 0xfe, 0xfe, 0xfe, 0xfe, 0xfe,  /* 0xf0 */
+    0xfe, 0xfe, 0xfe, 0xfe, 0xfe, 0xfe, 0xfe, 0xfe,  /* 0xf8 */
+};
 
-  if (mode == kEncodeHost || mode == kEncodeZone) {
-    // §3.2.2 Host allows
-    //	sub-delims = "!" / "$" / "&" / "'" / "(" / ")" / "*" / "+" / "," / ";" / "="
-    // as part of reg-name.
-    // We add : because we include :port as part of host.
-    // We add [ ] because we include [ipv6]:port as part of host.
-    // We add < > because they're the only characters left that
-    // we could possibly allow, and Parse will reject them if we
-    // escape them (because hosts can't use %-encoding for
-    // ASCII bytes).
-    switch (c) {
-     case '!':
-     case '$':
-     case '&':
-     case '\'':
-     case '(':
-     case ')':
-     case '*':
-     case '+':
-     case ',':
-     case ';':
-     case '=':
-     case ':':
-     case '[':
-     case ']':
-     case '<':
-     case '>':
-     case '"':
-       return 0;
-    }
-  }
+// -1 if not a hex digit
+static const signed char kHexValue[256] = {
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+     0,  1,  2,  3,  4,  5,  6,  7,  8,  9, -1, -1, -1, -1, -1, -1,
+    -1, 10, 11, 12, 13, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, 10, 11, 12, 13, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+};
 
-  switch (c) {
-   case '-':
-   case '_':
-   case '.':
-   case '~':
-     // §2.3 Unreserved characters (mark)
-     return 0;
-
-   case '$':
-   case '&':
-   case '+':
-   case ',':
-   case '/':
-   case ':':
-   case ';':
-   case '=':
-   case '?':
-   case '@':
-     // §2.2 Reserved characters (reserved)
-     // Different sections of the URL allow a few of
-     // the reserved characters to appear unescaped.
-     switch (mode) {
-      case kEncodePath: // §3.3
-        // The RFC allows : @ & = + $ but saves / ; , for assigning
-        // meaning to individual path segments. This package
-        // only manipulates the path as a whole, so we allow those
-        // last three as well. That leaves only ? to escape.
-        return (c == '?')?1:0;
-
-      case kEncodePathSegment: // §3.3
-        // The RFC allows : @ & = + $ but saves / ; , for assigning
-        // meaning to individual path segments.
-        return (c == '/' || c == ';' || c == ',' || c == '?')?1:0;
-
-      case kEncodeUserPassword: // §3.2.1
-        // The RFC allows ';', ':', '&', '=', '+', '$', and ',' in
-        // userinfo, so we must escape only '@', '/', and '?'.
-        // The parsing of userinfo treats ':' as special so we must escape
-        // that too.
-        return (c == '@' || c == '/' || c == '?' || c == ':')?1:0;
-
-      case kEncodeQueryComponent: // §3.4
-        // The RFC reserves (so we must escape) everything.
-        return 1;
-
-      case kEncodeFragment: // §4.1
-        // The RFC text is silent but the grammar allows
-        // everything, so escape nothing.
-        return 0;
-     }
-  }
+int shouldEscape(char c, int mode) {
+  return (kEscapeTable[(unsigned char)c] >> mode) & 1;
+}
 
-  // Everything else must be escaped.
-  return 1;
+#if defined(__SSE2__)
+// 1 in the bytes of b that are in [lo, hi], both below 0x80
+static __m128i in_range(__m128i b, char lo, char hi) {
+  return _mm_and_si128(_mm_cmpgt_epi8(b, _mm_set1_epi8(lo - 1)),
+                       _mm_cmplt_epi8(b, _mm_set1_epi8(hi + 1)));
 }
+#endif
 
-int escape(int mode, char *s, int s_len, char *escaped_s, int escaped_len) {
-  int space_count = 0;
-  int hex_count = 0;
-  int i;
-  char c;
-  int j;
-  char *t;
-  int required_len;
-  for (i = 0; i < s_len; i++) {
-    c = s[i];
-    if (shouldEscape(c, mode)) {
-      if (c == ' ' && mode == kEncodeQueryComponent) {
-        space_count++;
-      } else {
-        hex_count++;
-      }
+// The length of the prefix of s that is unreserved in every mode, most of
+// a URL. 16 bytes are tested at a time with SSE2.
+static int unreserved_length(const char *s, int len) {
+  int i = 0;
+#if defined(__SSE2__)
+  for (; i + 16 <= len; i += 16) {
+    __m128i b = _mm_loadu_si128((const __m128i *)(s + i));
+    __m128i ok = _mm_or_si128(
+        _mm_or_si128(in_range(b, 'a', 'z'), in_range(b, 'A', 'Z')),
+        _mm_or_si128(in_range(b, '-', '.'), in_range(b, '0', '9')));
+    __m128i mark = _mm_or_si128(_mm_cmpeq_epi8(b, _mm_set1_epi8('_')),
+                                _mm_cmpeq_epi8(b, _mm_set1_epi8('~')));
+    int mask = _mm_movemask_epi8(_mm_or_si128(ok, mark)) ^ 0xffff;
+    if (mask != 0) {
+      return i + __builtin_ctz(mask);
     }
   }
-
-  if (space_count == 0 && hex_count == 0) {
-    memcpy(escaped_s, s, s_len);
-    escaped_s[s_len] = '\0';
-    return s_len;
-  }
-
-  required_len = s_len + 2*hex_count;
-  if (required_len >= escaped_len) {
-    return required_len; // no enough space
+#endif
+  while (i < len && kEscapeTable[(unsigned char)s[i]] == 0) {
+    i++;
   }
+  return i;
+}
 
-  j = 0;
-  t = escaped_s;
-  for (i = 0; i < s_len; i++) {
-    c = s[i];
-    if (c == ' ' && mode == kEncodeQueryComponent) {
-      t[j] = '+';
+int escape(int mode, const char *s, int s_len, char *escaped_s,
+           int escaped_len) {
+  int i = 0;
+  int j = 0;  // the length of the result, written while it fits
+  int space = mode == kEncodeQueryComponent;
+  while (i < s_len) {
+    unsigned char c;
+    int n = unreserved_length(s + i, s_len - i);
+    if (n > 0 && j + n < escaped_len) {
+      memcpy(escaped_s + j, s + i, n);
+    }
+    i += n;
+    j += n;
+    if (i == s_len) {
+      break;
+    }
+    c = (unsigned char)s[i++];
+    if (c == ' ' && space) {
+      if (j + 1 < escaped_len) {
+        escaped_s[j] = '+';
+      }
       j++;
-    } else if (shouldEscape(c, mode)) {
-      t[j] = '%';
-      t[j+1] = kHexChar[((unsigned char)(c))>>4];
-      t[j+2] = kHexChar[((unsigned char)(c))&15];
+    } else if ((kEscapeTable[c] >> mode) & 1) {
+      if (j + 3 < escaped_len) {
+        escaped_s[j] = '%';
+        escaped_s[j + 1] = kHexChar[c >> 4];
+        escaped_s[j + 2] = kHexChar[c & 15];
+      }
       j += 3;
     } else {
-      t[j] = s[i];
+      if (j + 1 < escaped_len) {
+        escaped_s[j] = c;
+      }
       j++;
     }
   }
-  t[j] = '\0';
-  return required_len;
+  if (j < escaped_len) {
+    escaped_s[j] = '\0';
+  }
+  return j;
 }
 
 // PathEscape escapes the string so it can be safely placed
 // inside a URL path segment.
-int path_escape(char *s, int s_len, char *escaped_s, int escaped_len) {
-  return escape(kEncodePathSegment, s, s_len,  escaped_s, escaped_len);
+int path_escape(const char *s, int s_len, char *escaped_s, int escaped_len) {
+  return escape(kEncodePathSegment, s, s_len, escaped_s, escaped_len);
 }
 
-int query_escape(char *s, int s_len, char *escaped_s, int escaped_len) {
+int query_escape(const char *s, int s_len, char *escaped_s, int escaped_len) {
   return escape(kEncodeQueryComponent, s, s_len, escaped_s, escaped_len);
 }
+
+// The offset of the first '%', or '+' if plus, in s, len if none.
+static int find_escape(const char *s, int len, int plus) {
+  int i = 0;
+#if defined(__SSE2__)
+  const __m128i percent = _mm_set1_epi8('%');
+  const __m128i plus_sign = _mm_set1_epi8(plus ? '+' : '%');
+  for (; i + 16 <= len; i += 16) {
+    __m128i b = _mm_loadu_si128((const __m128i *)(s + i));
+    int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(b, percent),
+                                              _mm_cmpeq_epi8(b, plus_sign)));
+    if (mask != 0) {
+      return i + __builtin_ctz(mask);
+    }
+  }
+#endif
+  while (i < len && s[i] != '%' && !(plus && s[i] == '+')) {
+    i++;
+  }
+  return i;
+}
+
+int unescape(int mode, const char *s, int s_len, char *unescaped_s,
+             int unescaped_len) {
+  int i = 0;
+  int j = 0;  // the length of the result, written while it fits
+  int plus = mode == kEncodeQueryComponent;
+  while (i < s_len) {
+    char c;
+    int n = find_escape(s + i, s_len - i, plus);
+    if (n > 0 && j + n < unescaped_len) {
+      memcpy(unescaped_s + j, s + i, n);
+    }
+    i += n;
+    j += n;
+    if (i == s_len) {
+      break;
+    }
+    if (s[i] == '+') {
+      c = ' ';
+      i++;
+    } else {
+      int hi, lo;
+      if (i + 2 >= s_len) {
+        return -1;  // truncated
+      }
+      hi = kHexValue[(unsigned char)s[i + 1]];
+      lo = kHexValue[(unsigned char)s[i + 2]];
+      if (hi < 0 || lo < 0) {
+        return -1;
+      }
+      c = (char)(hi << 4 | lo);
+      i += 3;
+    }
+    if (j + 1 < unescaped_len) {
+      unescaped_s[j] = c;
+    }
+    j++;
+  }
+  if (j < unescaped_len) {
+    unescaped_s[j] = '\0';
+  }
+  return j;
+}
+
+int path_unescape(const char *s, int s_len, char *unescaped_s,
+                  int unescaped_len) {
+  return unescape(kEncodePathSegment, s, s_len, unescaped_s, unescaped_len);
+}
+
+int query_unescape(const char *s, int s_len, char *unescaped_s,
+                   int unescaped_len) {
+  return unescape(kEncodeQueryComponent, s, s_len, unescaped_s,
+                  unescaped_len);
+}
+
+int query_split(const char *query, int len, query_pair_callback callback,
+                void *context) {
+  int count = 0;
+  const char *end = query + len;
+  while (query < end) {
+    const char *amp = (const char *)memchr(query, '&', end - query);
+    const char *pair_end = amp != NULL ? amp : end;
+    if (pair_end > query) {
+      const char *eq = (const char *)memchr(query, '=', pair_end - query);
+      int stop;
+      count++;
+      if (eq != NULL) {
+        stop = callback(context, query, (int)(eq - query), eq + 1,
+                        (int)(pair_end - eq - 1));
+      } else {
+        stop = callback(context, query, (int)(pair_end - query), NULL, -1);
+      }
+      if (stop) {
+        break;
+      }
+    }
+    query = pair_end + 1;
+  }
+  return count;
+}
@@ -0,0 +1,82 @@
+#ifndef MING_URL_ESCAPE_H_
+#define MING_URL_ESCAPE_H_
+
+// URL percent-encoding, from golang net/url
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum url_encoding {
+  kEncodePath           = 1,
+  kEncodePathSegment    = 2,
+  kEncodeHost           = 3,
+  kEncodeZone           = 4,
+  kEncodeUserPassword   = 5,
+  kEncodeQueryComponent = 6,
+  kEncodeFragment       = 7
+};
+
+// Return true if c should be escaped in the part of a URL of mode.
+int shouldEscape(char c, int mode);
+
+// Escape s into escaped_s, ending with '\0'. Return the length of the
+// result, which is only complete if it is less than escaped_len, s_len * 3
+// + 1 is always enough. In kEncodeQueryComponent a space becomes '+'.
+int escape(int mode, const char *s, int s_len, char *escaped_s,
+           int escaped_len);
+int path_escape(const char *s, int s_len, char *escaped_s, int escaped_len);
+int query_escape(const char *s, int s_len, char *escaped_s, int escaped_len);
+
+// The reverse, s_len + 1 bytes of unescaped_s are always enough. Return -1
+// if a '%' is not followed by two hex digits. In kEncodeQueryComponent a
+// '+' becomes a space.
+int unescape(int mode, const char *s, int s_len, char *unescaped_s,
+             int unescaped_len);
+int path_unescape(const char *s, int s_len, char *unescaped_s,
+                  int unescaped_len);
+int query_unescape(const char *s, int s_len, char *unescaped_s,
+                   int unescaped_len);
+
+// Called by query_split() for every key=value pair, the key and the value
+// are still escaped and value_len is -1 if there is no '='. Return non zero
+// to stop.
+typedef int (*query_pair_callback)(void *context, const char *key,
+                                   int key_len, const char *value,
+                                   int value_len);
+
+// Split a query string "a=1&b=2" at the '&'s, skipping the empty pairs.
+// Return the number of pairs passed to callback.
+int query_split(const char *query, int len, query_pair_callback callback,
+                void *context);
+
+#ifdef __cplusplus
+}  // extern "C"
+
+#include "ming/buffer.h"
+
+namespace ming {
+
+// Escape s and append it to ob, return false if ob overflows.
+template <int INLINE_SIZE>
+bool url_escape(ChainBuffer<INLINE_SIZE> &ob, int mode, const char *s,
+                int s_len) {
+  // reserve() is limited to a block
+  const int kChunk = 1024;
+  while (s_len > 0) {
+    int n = s_len < kChunk ? s_len : kChunk;
+    char *out = ob.reserve(n * 3 + 1);
+    if (out == 0) {
+      return false;
+    }
+    ob.commit(escape(mode, s, n, out, n * 3 + 1));
+    s += n;
+    s_len -= n;
+  }
+  return true;
+}
+
+}  // namespace ming
+#endif  // __cplusplus
+
+#endif  // MING_URL_ESCAPE_H_
@@ -0,0 +1,228 @@
+#include "ming/url_parser.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace ming {
+
+namespace {
+
+// the offset of the first a or b in s, len if none
+int find_either(const char *s, int len, char a, char b) {
+  int i = 0;
+#if defined(__SSE2__)
+  const __m128i va = _mm_set1_epi8(a);
+  const __m128i vb = _mm_set1_epi8(b);
+  for (; i + 16 <= len; i += 16) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(s + i));
+    int mask = _mm_movemask_epi8(
+        _mm_or_si128(_mm_cmpeq_epi8(v, va), _mm_cmpeq_epi8(v, vb)));
+    if (mask != 0) {
+      return i + __builtin_ctz(mask);
+    }
+  }
+#endif
+  while (i < len && s[i] != a && s[i] != b) {
+    i++;
+  }
+  return i;
+}
+
+bool has_control(const char *s, int len) {
+  for (int i = 0; i < len; i++) {
+    unsigned char c = s[i];
+    if (c < 0x20 || c == 0x7f) {
+      return true;
+    }
+  }
+  return false;
+}
+
+inline bool is_alpha(char c) {
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+inline bool is_digit(char c) { return c >= '0' && c <= '9'; }
+
+// the length of "scheme:" at s, 0 if none (RFC 3986 §3.1)
+int scheme_length(const char *s, int len) {
+  if (len == 0 || !is_alpha(s[0])) {
+    return 0;
+  }
+  for (int i = 1; i < len; i++) {
+    char c = s[i];
+    if (c == ':') {
+      return i + 1;
+    }
+    if (!is_alpha(c) && !is_digit(c) && c != '+' && c != '-' && c != '.') {
+      return 0;
+    }
+  }
+  return 0;
+}
+
+bool parse_authority(const char *s, int len, ParsedUrl *url) {
+  const char *at = NULL;
+  for (int i = len - 1; i >= 0; i--) {
+    if (s[i] == '@') {
+      at = s + i;
+      break;
+    }
+  }
+  if (at != NULL) {
+    url->user_info = UrlPiece(s, static_cast<int>(at - s));
+    len -= static_cast<int>(at + 1 - s);
+    s = at + 1;
+  }
+  const char *end = s + len;
+  const char *colon;
+  if (len > 0 && s[0] == '[') {
+    // [ipv6]:port
+    const char *close = static_cast<const char *>(memchr(s, ']', len));
+    if (close == NULL) {
+      return false;
+    }
+    url->host = UrlPiece(s + 1, static_cast<int>(close - s - 1));
+    colon = close + 1;
+    if (colon != end && *colon != ':') {
+      return false;
+    }
+  } else {
+    colon = static_cast<const char *>(memchr(s, ':', len));
+    if (colon == NULL) {
+      colon = end;
+    }
+    url->host = UrlPiece(s, static_cast<int>(colon - s));
+  }
+  if (colon != end) {
+    url->port = UrlPiece(colon + 1, static_cast<int>(end - colon - 1));
+    for (int i = 0; i < url->port.len; i++) {
+      if (!is_digit(url->port.data[i])) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+}  // namespace
+
+bool UrlPiece::Unescape(std::string *out, int mode) const {
+  out->resize(len + 1);
+  int n = unescape(mode, data, len, &(*out)[0], len + 1);
+  if (n < 0) {
+    out->clear();
+    return false;
+  }
+  out->resize(n);
+  return true;
+}
+
+bool ParsedUrl::Parse(const char *url, int len) {
+  *this = ParsedUrl();
+  if (has_control(url, len)) {
+    return false;
+  }
+
+  // the query and the fragment, everything after the first '?' or '#'
+  int end = find_either(url, len, '?', '#');
+  if (end < len && url[end] == '?') {
+    const char *q = url + end + 1;
+    const char *hash = static_cast<const char *>(memchr(q, '#', url + len - q));
+    int query_len = hash != NULL ? static_cast<int>(hash - q)
+                                 : static_cast<int>(url + len - q);
+    query = UrlPiece(q, query_len);
+    if (hash != NULL) {
+      fragment = UrlPiece(hash + 1, static_cast<int>(url + len - hash - 1));
+    }
+  } else if (end < len) {
+    fragment = UrlPiece(url + end + 1, len - end - 1);
+  }
+
+  // scheme://authority/path
+  const char *s = url;
+  int n = scheme_length(s, end);
+  if (n > 0) {
+    scheme = UrlPiece(s, n - 1);
+    s += n;
+    end -= n;
+  }
+  if (end >= 2 && s[0] == '/' && s[1] == '/') {
+    s += 2;
+    end -= 2;
+    const char *slash = static_cast<const char *>(memchr(s, '/', end));
+    int authority_len = slash != NULL ? static_cast<int>(slash - s) : end;
+    if (!parse_authority(s, authority_len, this)) {
+      return false;
+    }
+    s += authority_len;
+    end -= authority_len;
+  }
+  path = UrlPiece(s, end);
+  return true;
+}
+
+int QueryParams::AddPair(void *context, const char *key, int key_len,
+                         const char *value, int value_len) {
+  QueryParams *params = static_cast<QueryParams *>(context);
+  KeyValue pair;
+  pair.key = UrlPiece(key, key_len);
+  pair.value = value_len < 0 ? UrlPiece() : UrlPiece(value, value_len);
+  if (params->size_ < kInlineParams) {
+    params->inline_[params->size_] = pair;
+  } else {
+    params->overflow_.push_back(pair);
+  }
+  params->size_++;
+  return 0;
+}
+
+int QueryParams::Parse(UrlPiece query) {
+  size_ = 0;
+  overflow_.clear();
+  query_split(query.data, query.len, &QueryParams::AddPair, this);
+  return size_;
+}
+
+bool QueryParams::KeyEquals(const UrlPiece &key, const char *name) {
+  if (memchr(key.data, '%', key.len) == NULL &&
+      memchr(key.data, '+', key.len) == NULL) {
+    return key.Equals(name);
+  }
+  // an escaped key, it is never longer than its escaped form
+  size_t name_len = strlen(name);
+  if (name_len > static_cast<size_t>(key.len)) {
+    return false;
+  }
+  char stack_buf[256];
+  std::string heap_buf;
+  char *buf = stack_buf;
+  if (key.len >= static_cast<int>(sizeof(stack_buf))) {
+    heap_buf.resize(key.len + 1);
+    buf = &heap_buf[0];
+  }
+  int n = key.Unescape(buf, kEncodeQueryComponent);
+  return n >= 0 && static_cast<size_t>(n) == name_len &&
+         memcmp(buf, name, n) == 0;
+}
+
+bool QueryParams::Get(const char *name, UrlPiece *value) const {
+  for (int i = 0; i < size_; i++) {
+    if (KeyEquals(Pair(i).key, name)) {
+      *value = Pair(i).value;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool QueryParams::Get(const char *name, std::string *value) const {
+  UrlPiece raw;
+  if (!Get(name, &raw)) {
+    return false;
+  }
+  return raw.Unescape(value, kEncodeQueryComponent);
+}
+
+}  // namespace ming
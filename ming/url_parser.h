@@ -0,0 +1,101 @@
+#ifndef MING_URL_PARSER_H_
+#define MING_URL_PARSER_H_
+
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "ming/url_escape.h"
+
+namespace ming {
+
+// A view into the buffer that was parsed, which must outlive it. Fields are
+// kept escaped, Unescape() decodes the ones that are actually used.
+struct UrlPiece {
+  UrlPiece() : data(NULL), len(0) {}
+  UrlPiece(const char *d, int l) : data(d), len(l) {}
+
+  bool empty() const { return len == 0; }
+  bool Equals(const char *s) const {
+    return strlen(s) == static_cast<size_t>(len) && memcmp(data, s, len) == 0;
+  }
+  std::string ToString() const { return std::string(data, len); }
+
+  // Decode into dest, which needs len + 1 bytes. Return the length, or -1
+  // if there is a bad escape. mode is a url_encoding, '+' is a space in
+  // kEncodeQueryComponent.
+  int Unescape(char *dest, int mode) const {
+    return unescape(mode, data, len, dest, len + 1);
+  }
+  bool Unescape(std::string *out, int mode) const;
+
+  const char *data;
+  int len;
+};
+
+// The parts of an absolute URL "scheme://user@host:port/path?query#frag" or
+// of the request target of HTTP "/path?query", all empty if absent. host is
+// without the brackets of an IPv6 literal.
+//
+// Parse() finds the '?' and '#' 16 bytes at a time with SSE2 and splits the
+// short prefix before them, it does not allocate nor copy.
+struct ParsedUrl {
+  // return false if the URL is malformed: a bad port, an unclosed '[' or
+  // control characters
+  bool Parse(const char *url, int len);
+
+  UrlPiece scheme;
+  UrlPiece user_info;
+  UrlPiece host;
+  UrlPiece port;
+  UrlPiece path;
+  UrlPiece query;
+  UrlPiece fragment;
+};
+
+// The key=value pairs of a query string, as views into it. The first
+// kInlineParams pairs are kept inline, so a typical request does not
+// allocate.
+class QueryParams {
+ public:
+  enum { kInlineParams = 16 };
+
+  QueryParams() : size_(0) {}
+  explicit QueryParams(UrlPiece query) : size_(0) { Parse(query); }
+
+  // Replace the pairs with those of query, return the number of pairs.
+  int Parse(UrlPiece query);
+
+  int size() const { return size_; }
+  const UrlPiece &key(int i) const { return Pair(i).key; }
+  // escaped, a key without a '=' has a NULL value
+  const UrlPiece &value(int i) const { return Pair(i).value; }
+
+  // The raw value of the first pair whose unescaped key is name, false if
+  // there is none.
+  bool Get(const char *name, UrlPiece *value) const;
+  // The same, unescaped.
+  bool Get(const char *name, std::string *value) const;
+
+ private:
+  struct KeyValue {
+    UrlPiece key;
+    UrlPiece value;
+  };
+
+  static int AddPair(void *context, const char *key, int key_len,
+                     const char *value, int value_len);
+  const KeyValue &Pair(int i) const {
+    return i < kInlineParams ? inline_[i] : overflow_[i - kInlineParams];
+  }
+  static bool KeyEquals(const UrlPiece &key, const char *name);
+
+  int size_;
+  KeyValue inline_[kInlineParams];
+  std::vector<KeyValue> overflow_;
+};
+
+}  // namespace ming
+
+#endif  // MING_URL_PARSER_H_
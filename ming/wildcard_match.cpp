@@ -1,9 +1,56 @@
+#include "ming/wildcard_match.h"
 
 // benchmark: for simple domain name matching, it takes less than 1 millisecond
 //            to match 10 million items. it takes roughly the same time as
 //            strcmp,  and is faster than "strlen(s) != strlen(pattern)"
 //
 // origin: Martin Richter https://www.codeproject.com/articles/188256/a-simple-wildcard-matching-function
+//
+// The recursion on every '*' of the original is exponential on patterns like
+// "*a*a*a*b" against a run of 'a's. Here only the position of the last '*'
+// is remembered: when the rest of the pattern fails, that '*' takes one
+// more character and the rest is tried again. The earlier '*'s never need
+// to, whatever they matched can only help the last one.
+
+namespace {
+
+inline char lower(char c) { return (c >= 'A' && c <= 'Z') ? c + 32 : c; }
+
+template <bool kIgnoreCase>
+inline bool same(char a, char b) {
+  return kIgnoreCase ? lower(a) == lower(b) : a == b;
+}
+
+template <bool kIgnoreCase>
+int match(const char *s, const char *pattern) {
+  const char *star = NULL;  // the pattern after the last '*'
+  const char *resume = s;   // where its match ends
+  while (*s) {
+    if (*pattern == '*') {
+      // 1. '*' matches 0 character
+      star = ++pattern;
+      resume = s;
+    } else if (*pattern == '?' ||
+               (*pattern && same<kIgnoreCase>(*pattern, *s))) {
+      ++s;
+      ++pattern;
+    } else if (star != NULL) {
+      // 2. '*'  matches one more character
+      pattern = star;
+      s = ++resume;
+    } else {
+      return 0;
+    }
+  }
+  // Have a match? Only if the rest of the pattern is '*'s
+  while (*pattern == '*') {
+    ++pattern;
+  }
+  return !*pattern;
+}
+
+}  // namespace
+
 // wildcard_match
 // @s: string to match
 // @pattern: matching pattern that contain ? and *
@@ -11,36 +58,113 @@
 // The wildcard pattern can include the characters ‘?’ and ‘*’
 // '?' – matches any single character
 // '*' – Matches any sequence of characters (including the empty sequence)
-int wildcard_match(const char *s, const char *pattern)
-{
-  while (*pattern) {
-    if (*pattern == '*') {
-      // 1. '*' matches 0 character
-      if (wildcard_match(s, pattern+1))
-        return 1;
+int wildcard_match(const char *s, const char *pattern) {
+  return match<false>(s, pattern);
+}
 
-      // 2. '*'  matches ore or more character
-      if (*s && wildcard_match(s+1, pattern))
-        return 1;
+int wildcard_match_nocase(const char *s, const char *pattern) {
+  return match<true>(s, pattern);
+}
 
-      // '*' mismatch
-      return 0;
+namespace ming {
 
-    } else if (*pattern == '?') {
-      // Matches any character except empty string
-      if (!*s) {
-        return 0;
+CompiledWildcard::CompiledWildcard(const char *pattern, bool ignore_case)
+    : pattern_(pattern),
+      ignore_case_(ignore_case),
+      has_star_(false),
+      min_len_(0) {
+  if (ignore_case_) {
+    for (size_t i = 0; i < pattern_.size(); i++) {
+      pattern_[i] = lower(pattern_[i]);
+    }
+  }
+  Segment segment = {0, 0, false};
+  for (size_t i = 0; i <= pattern_.size(); i++) {
+    if (i == pattern_.size() || pattern_[i] == '*') {
+      segment.len = i - segment.offset;
+      min_len_ += segment.len;
+      // "**" adds nothing but an empty segment
+      if (segment.len > 0 || segments_.empty() || i == pattern_.size()) {
+        segments_.push_back(segment);
+      }
+      if (i < pattern_.size()) {
+        has_star_ = true;
       }
+      segment.offset = i + 1;
+      segment.has_any = false;
+    } else if (pattern_[i] == '?') {
+      segment.has_any = true;
+    }
+  }
+}
+
+bool CompiledWildcard::SegmentAt(const Segment &segment, const char *s) const {
+  const char *p = pattern_.data() + segment.offset;
+  if (!segment.has_any && !ignore_case_) {
+    return memcmp(s, p, segment.len) == 0;
+  }
+  for (size_t i = 0; i < segment.len; i++) {
+    char c = ignore_case_ ? lower(s[i]) : s[i];
+    if (p[i] != '?' && p[i] != c) {
+      return false;
+    }
+  }
+  return true;
+}
 
+const char *CompiledWildcard::Find(const Segment &segment, const char *s,
+                                   size_t len) const {
+  if (segment.len > len) {
+    return NULL;
+  }
+  const char *last = s + len - segment.len;  // the last possible start
+  char first = pattern_[segment.offset];
+  if (!ignore_case_ && first != '?') {
+    // memchr for the first character, the segment is rarely found by chance
+    while (s <= last) {
+      s = static_cast<const char *>(memchr(s, first, last - s + 1));
+      if (s == NULL) {
+        return NULL;
+      }
+      if (SegmentAt(segment, s)) {
+        return s;
+      }
       ++s;
-      ++pattern;
-    } else {
-      if (*s++ != *pattern++)
-        return 0;
     }
+    return NULL;
   }
+  for (; s <= last; ++s) {
+    if (SegmentAt(segment, s)) {
+      return s;
+    }
+  }
+  return NULL;
+}
 
-  // Have a match? Only if both are at the end...
-  return !*s && !*pattern;
+bool CompiledWildcard::Match(const char *s, size_t len) const {
+  if (len < min_len_) {
+    return false;
+  }
+  const Segment &head = segments_.front();
+  if (!has_star_) {
+    return len == head.len && SegmentAt(head, s);
+  }
+  const Segment &tail = segments_.back();
+  if (!SegmentAt(head, s) || !SegmentAt(tail, s + len - tail.len)) {
+    return false;
+  }
+  // the middle segments, each as far left as it goes
+  const char *cur = s + head.len;
+  const char *end = s + len - tail.len;
+  for (size_t i = 1; i + 1 < segments_.size(); i++) {
+    const Segment &segment = segments_[i];
+    const char *found = Find(segment, cur, end - cur);
+    if (found == NULL) {
+      return false;
+    }
+    cur = found + segment.len;
+  }
+  return true;
 }
 
+}  // namespace ming
@@ -0,0 +1,53 @@
+#ifndef MING_WILDCARD_MATCH_H_
+#define MING_WILDCARD_MATCH_H_
+
+#include <stddef.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+// Return 1 if s matches pattern, where '?' matches any single character and
+// '*' any sequence of characters, including the empty one. O(len(s) *
+// len(pattern)) at worst, without recursion.
+int wildcard_match(const char *s, const char *pattern);
+// The same, ignoring the case of ASCII letters.
+int wildcard_match_nocase(const char *s, const char *pattern);
+
+namespace ming {
+
+// A wildcard pattern prepared for matching many strings.
+//
+// The pattern is split at the '*'s into literal segments. The first one has
+// to match at the start of the string, the last one at the end, and the
+// others are searched for from left to right, with memchr for the literal
+// ones. As no segment can be moved back once found, a match is O(len(s) *
+// len(pattern)) at worst and O(len(s)) for the usual patterns.
+class CompiledWildcard {
+ public:
+  explicit CompiledWildcard(const char *pattern, bool ignore_case = false);
+
+  bool Match(const char *s) const { return Match(s, strlen(s)); }
+  bool Match(const char *s, size_t len) const;
+
+ private:
+  struct Segment {
+    size_t offset;  // in pattern_
+    size_t len;
+    bool has_any;   // contains a '?'
+  };
+
+  bool SegmentAt(const Segment &segment, const char *s) const;
+  // the first position of segment in s[0, len), or NULL
+  const char *Find(const Segment &segment, const char *s, size_t len) const;
+
+  std::string pattern_;  // lower case if ignore_case_
+  bool ignore_case_;
+  bool has_star_;
+  std::vector<Segment> segments_;  // the first and the last can be empty
+  size_t min_len_;                 // of a matching string
+};
+
+}  // namespace ming
+
+#endif  // MING_WILDCARD_MATCH_H_
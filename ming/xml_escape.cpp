@@ -2,6 +2,11 @@
 
 #include <string.h>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define MING_XML_ESCAPE_SSE2 1
+#endif
+
 namespace ming {
 /**
  * & --> &amp;
@@ -59,90 +64,159 @@ static const unsigned char XML_LOOKUP_TABLE[] = {
 	5, 5, 5, 5, 5, 5, 5, 5,
 };
 
-// ---------------------------------------
-// if escape string was found in the sr buffer, ob will be set  and  return true
-// else ob will not set and return false
-//----------------------------------------
-bool escape_xml(small_buffer &ob, const unsigned char *src, unsigned int size) {
+// The length of the prefix of src that is copied as is: the printable ASCII
+// characters but & < > " ', and tab, LF and CR. Most of the XML fields have
+// nothing else, 32 bytes are tested at a time with SSE2.
+static unsigned int clean_length(const unsigned char *src, unsigned int size) {
   unsigned int i = 0;
-  unsigned char code = 0;
-
-  // most of the time no replacement is needed,  optimize for the fast path
-  while (i < size) {
-    unsigned int byte;
-    byte = src[i++];
-    code = XML_LOOKUP_TABLE[byte];
-    if (code) {
-      goto REAL_WORK;
+#ifdef MING_XML_ESCAPE_SSE2
+  const __m128i space = _mm_set1_epi8(0x20);
+  const __m128i tab = _mm_set1_epi8('\t');
+  const __m128i lf = _mm_set1_epi8('\n');
+  const __m128i cr = _mm_set1_epi8('\r');
+  const __m128i quot = _mm_set1_epi8('"');
+  const __m128i amp = _mm_set1_epi8('&');
+  const __m128i apos = _mm_set1_epi8('\'');
+  const __m128i lt = _mm_set1_epi8('<');
+  const __m128i gt = _mm_set1_epi8('>');
+  for (; i + 32 <= size; i += 32) {
+    int mask = 0;
+    for (int half = 0; half < 2; half++) {
+      __m128i b = _mm_loadu_si128((const __m128i *)(src + i + half * 16));
+      // signed: the control characters and the non-ASCII bytes
+      __m128i ctrl = _mm_cmplt_epi8(b, space);
+      __m128i white = _mm_or_si128(
+          _mm_cmpeq_epi8(b, tab),
+          _mm_or_si128(_mm_cmpeq_epi8(b, lf), _mm_cmpeq_epi8(b, cr)));
+      __m128i special = _mm_or_si128(
+          _mm_or_si128(_mm_cmpeq_epi8(b, quot), _mm_cmpeq_epi8(b, amp)),
+          _mm_or_si128(_mm_cmpeq_epi8(b, apos),
+                       _mm_or_si128(_mm_cmpeq_epi8(b, lt),
+                                    _mm_cmpeq_epi8(b, gt))));
+      __m128i stop = _mm_or_si128(_mm_andnot_si128(white, ctrl), special);
+      mask |= _mm_movemask_epi8(stop) << (half * 16);
+    }
+    if (mask != 0) {
+      return i + __builtin_ctz(mask);
     }
   }
-  return false;
+#endif
+  while (i < size && XML_LOOKUP_TABLE[src[i]] == 0) {
+    i++;
+  }
+  return i;
+}
 
-REAL_WORK:
-  i--;
-  ob.buf_grow(size * 8);
-  if (i > 0) {
-    ob.put(src, i);
+// The length of the UTF-8 character at src, whose lead byte has the length
+// code, or 0 if it is invalid and then in *skip the bytes to replace with
+// '?': the lead byte and the continuation bytes that follow it.
+static unsigned int utf8_length(const unsigned char *src, unsigned int avail,
+                                unsigned int code, unsigned int *skip) {
+  unsigned int chr = src[0] & (0xff >> code);
+  unsigned int n = 1;
+  for (; n < code && n < avail; n++) {
+    if ((src[n] & 0xc0) != 0x80) break;
+    chr = (chr << 6) + (src[n] & 0x3f);
   }
+  *skip = n;
+  if (n < code) return 0; /* truncated */
 
-  while (i < size) {
-    unsigned int start, end;
-    start = end = i;
-
-    while (i < size) {
-      unsigned int byte;
-
-      byte = src[i++];
-      code = XML_LOOKUP_TABLE[byte];
-
-      if (!code) {
-        /* single character used literally */
-      } else if (code >= CODE_INVALID) {
-        break; /* insert lookup code string */
-      } else if (code > size - end) {
-        code = CODE_INVALID; /* truncated UTF-8 character */
-        break;
-      } else {
-        unsigned int chr = byte & (0xff >> code);
-
-        while (--code) {
-          byte = src[i++];
-          if ((byte & 0xc0) != 0x80) {
-            code = CODE_INVALID;
-            break;
-          }
-          chr = (chr << 6) + (byte & 0x3f);
-        }
-
-        switch (i - end) {
-          case 2:
-            if (chr < 0x80) code = CODE_INVALID;
-            break;
-          case 3:
-            if (chr < 0x800 || (chr > 0xd7ff && chr < 0xe000) || chr > 0xfffd)
-              code = CODE_INVALID;
-            break;
-          case 4:
-            if (chr < 0x10000 || chr > 0x10ffff) code = CODE_INVALID;
-            break;
-          default:
-            break;
-        }
-        if (code == CODE_INVALID) break;
-      }
+  switch (code) {
+    case 2:
+      if (chr < 0x80) return 0;
+      break;
+    case 3:
+      if (chr < 0x800 || (chr > 0xd7ff && chr < 0xe000) || chr > 0xfffd)
+        return 0;
+      break;
+    case 4:
+      if (chr < 0x10000 || chr > 0x10ffff) return 0;
+      break;
+    default:
+      break;
+  }
+  return code;
+}
 
-      end = i;
-    }
+// Escape src into sink, up to the end or, if !last, up to a UTF-8
+// character cut off at the end. Return the end, the bytes from *start to it
+// are left for the caller to write: they need no escaping.
+static unsigned int escape_chunk(XmlSink *sink, const unsigned char *src,
+                                 unsigned int size, bool last,
+                                 unsigned int *start, bool *escaped) {
+  // most of the time no replacement is needed,  optimize for the fast path
+  unsigned int i = clean_length(src, size);
+  *start = 0;
 
-    if (end > start) ob.put(src + start, end - start);
+  while (i < size) {
+    unsigned char code = XML_LOOKUP_TABLE[src[i]];
+    unsigned int skip = 1;
+    if (code == 0) {
+      i++; /* single character used literally */
+    } else if (code < CODE_INVALID &&
+               utf8_length(src + i, size - i, code, &skip) != 0) {
+      i += code; /* valid UTF-8 character */
+    } else if (code < CODE_INVALID && !last && i + skip == size) {
+      return i; /* may be completed by the next chunk */
+    } else {
+      if (code < CODE_INVALID) code = CODE_INVALID;
+      *escaped = true;
+      if (i > *start) sink->Write((const char *)src + *start, i - *start);
+      /* escaping */
+      sink->Write(LOOKUP_CODES[code], strlen(LOOKUP_CODES[code]));
+      i += skip;
+      *start = i;
+    }
+    i += clean_length(src + i, size - i);
+  }
+  return size;
+}
 
-    /* escaping */
-    if (end >= size) break;
+// ---------------------------------------
+// if escape string was found in the sr buffer, ob will be set  and  return true
+// else ob will not set and return false, false too if ob overflowed
+//----------------------------------------
+bool escape_xml(EscapeBuffer &ob, const unsigned char *src, unsigned int size) {
+  XmlBufferSink sink(&ob);
+  unsigned int start;
+  bool escaped = false;
+  escape_chunk(&sink, src, size, true, &start, &escaped);
+  if (!escaped) return false;
+  if (size > start) ob.append((const char *)src + start, size - start);
+  return !ob.overflow();
+}
 
-    ob.puts(LOOKUP_CODES[code]);
+void XmlEscaper::Update(const unsigned char *src, unsigned int size) {
+  bool escaped;
+  unsigned int start;
+  if (pending_len_ > 0) {
+    // complete the character split by the last chunk, or find it invalid,
+    // need is at most 4 but the compiler cannot see it in the table
+    unsigned int need = XML_LOOKUP_TABLE[pending_[0]];
+    while (pending_len_ < need && pending_len_ < sizeof(pending_) &&
+           size > 0 && (*src & 0xc0) == 0x80) {
+      pending_[pending_len_++] = *src++;
+      size--;
+    }
+    if (pending_len_ < need && size == 0) return;
+    unsigned int end = escape_chunk(sink_, pending_, pending_len_, true,
+                                    &start, &escaped);
+    if (end > start) sink_->Write((const char *)pending_ + start, end - start);
+    pending_len_ = 0;
   }
+  unsigned int end = escape_chunk(sink_, src, size, false, &start, &escaped);
+  if (end > start) sink_->Write((const char *)src + start, end - start);
+  memcpy(pending_, src + end, size - end);
+  pending_len_ = size - end;
+}
 
-  return true;
+void XmlEscaper::Finish() {
+  if (pending_len_ > 0) {
+    bool escaped;
+    unsigned int start;
+    escape_chunk(sink_, pending_, pending_len_, true, &start, &escaped);
+    pending_len_ = 0;
+  }
 }
 
 /**
@@ -152,100 +226,112 @@ REAL_WORK:
  *  &quot; -->  "
  *  &apos; -->  '
  */
-// ---------------------------------------
-// if escape string was found in the sr buffer, ob will be set  and  return true
-// else ob will not set and return false
-//----------------------------------------
-bool unescape_xml(small_buffer &ob, const char *src, unsigned int size) {
-  unsigned int i = 0;
-  unsigned int start = 0;
-  while (i < size) {
-    if (src[i] != '&') {
-      i++;
-      continue;
-    } else {
-      goto REAL_WORK;
-    }
-  }
-  return false;
-
-REAL_WORK:
-  ob.buf_grow(size);
-
-MATCH_LOOP:
-
-  char code = 0;
-  unsigned int len = 0;
-  do {
-    if (i + 3 < size) {
-      unsigned int key = *(unsigned int *)&src[i];
-      if (key == ('&' | 'l' << 8 | 't' << 16 | ';' << 24)) {
-        code = '<';
-        len = 4;
-        break;
-      }
-      if (key == ('&' | 'g' << 8 | 't' << 16 | ';' << 24)) {
-        code = '>';
-        len = 4;
-        break;
+static const struct {
+  const char *entity;
+  unsigned int len;
+  char code;
+} XML_ENTITIES[] = {{"&lt;", 4, '<'},
+                    {"&gt;", 4, '>'},
+                    {"&amp;", 5, '&'},
+                    {"&quot;", 6, '"'},
+                    {"&apos;", 6, '\''}};
+
+// The length of the entity at src, which starts with '&', and its character
+// in *code. 0 if it is not one, -1 if src is too short to tell.
+static int match_entity(const char *src, unsigned int avail, char *code) {
+  int result = 0;
+  for (size_t k = 0; k < sizeof(XML_ENTITIES) / sizeof(XML_ENTITIES[0]);
+       k++) {
+    unsigned int len = XML_ENTITIES[k].len;
+    if (avail >= len) {
+      if (memcmp(src, XML_ENTITIES[k].entity, len) == 0) {
+        *code = XML_ENTITIES[k].code;
+        return len;
       }
-    } else {
-      break;
+    } else if (memcmp(src, XML_ENTITIES[k].entity, avail) == 0) {
+      result = -1;
     }
+  }
+  return result;
+}
 
-    if (i + 4 < size) {
-      unsigned int key = *(unsigned int *)&src[i + 1];
-      if (key == ('a' | 'm' << 8 | 'p' << 16 | ';' << 24)) {
-        code = '&';
-        len = 5;
-        break;
-      }
+// Unescape src into sink like escape_chunk(), if !last an entity cut off
+// at the end is left.
+static unsigned int unescape_chunk(XmlSink *sink, const char *src,
+                                   unsigned int size, bool last,
+                                   unsigned int *start, bool *unescaped) {
+  *start = 0;
+  const char *amp = (const char *)memchr(src, '&', size);
+  while (amp != NULL) {
+    unsigned int i = amp - src;
+    char code;
+    int len = match_entity(amp, size - i, &code);
+    if (len < 0 && !last) return i; /* may be completed by the next chunk */
+    if (len > 0) {
+      *unescaped = true;
+      if (i > *start) sink->Write(src + *start, i - *start);
+      sink->Write(&code, 1);
+      i += len;
+      *start = i;
     } else {
-      break;
+      i++;
     }
+    amp = (const char *)memchr(src + i, '&', size - i);
+  }
+  return size;
+}
 
-    if (i + 5 < size && src[i + 5] == ';') {
-      unsigned int key = *(unsigned int *)&src[i + 1];
-      if (key == ('q' | 'u' << 8 | 'o' << 16 | 't' << 24)) {
-        code = '"';
-        len = 6;
-        break;
-      }
-      if (key == ('a' | 'p' << 8 | 'o' << 16 | 's' << 24)) {
-        code = '\'';
-        len = 6;
-        break;
-      }
-    } else {
-      break;
-    }
-  } while (0);
+// ---------------------------------------
+// if escape string was found in the sr buffer, ob will be set  and  return true
+// else ob will not set and return false, false too if ob overflowed
+//----------------------------------------
+bool unescape_xml(EscapeBuffer &ob, const char *src, unsigned int size) {
+  XmlBufferSink sink(&ob);
+  unsigned int start;
+  bool unescaped = false;
+  unescape_chunk(&sink, src, size, true, &start, &unescaped);
+  if (!unescaped) return false;
+  if (size > start) ob.append(src + start, size - start);
+  return !ob.overflow();
+}
 
-  if (code) {
-    if (i > start) {
-      ob.put(&src[start], i - start);
+void XmlUnescaper::Update(const char *src, unsigned int size) {
+  bool unescaped;
+  unsigned int start;
+  if (pending_len_ > 0) {
+    // the entity split by the last chunk, at most sizeof(pending_) bytes
+    unsigned int n = sizeof(pending_) - pending_len_;
+    if (n > size) n = size;
+    memcpy(pending_ + pending_len_, src, n);
+    char code;
+    int len = match_entity(pending_, pending_len_ + n, &code);
+    if (len < 0) {
+      pending_len_ += n;  // still too short to tell, n == size
+      return;
     }
-    ob.putchar(code);
-    i += len;
-    start = i;
-  } else {
-    i++;
-  }
-
-  while (i < size) {
-    if (src[i] != '&') {
-      i++;
-      continue;
+    if (len > 0) {
+      sink_->Write(&code, 1);
+      // the bytes of the entity that came with this chunk
+      src += len - pending_len_;
+      size -= len - pending_len_;
     } else {
-      goto MATCH_LOOP;
+      // a '&' and letters, the chunk starts after them
+      sink_->Write(pending_, pending_len_);
     }
+    pending_len_ = 0;
   }
+  unsigned int end = unescape_chunk(sink_, src, size, false, &start,
+                                    &unescaped);
+  if (end > start) sink_->Write(src + start, end - start);
+  memcpy(pending_, src + end, size - end);
+  pending_len_ = size - end;
+}
 
-  if (i > start) {
-    ob.put(&src[start], i - start);
+void XmlUnescaper::Finish() {
+  if (pending_len_ > 0) {
+    sink_->Write(pending_, pending_len_);
+    pending_len_ = 0;
   }
-
-  return true;
 }
 
 }  // namespace ming
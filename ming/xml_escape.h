@@ -1,39 +1,94 @@
 #ifndef XML_ESCAPE_H_
 #define XML_ESCAPE_H_
 
+#include <limits.h>
 #include <string.h>
 
+#include "ming/buffer.h"
+#include "ming/noncopyable.h"
+
 namespace ming {
-class small_buffer {
+
+// The output of the escape functions: the first 1024 bytes inline, the rest
+// in pooled blocks that are never moved, export it with to_iovec(). Set
+// overflow() instead of writing past max_size.
+typedef ChainBuffer<1024> EscapeBuffer;
+
+// EscapeBuffer with the interface of the old small_buffer. Unbounded by
+// default like the old one, which buf_grow() grew to any size.
+class small_buffer : public EscapeBuffer {
  public:
-  small_buffer() : size_(0), extra_buf_((char *)&data_) {}
-  ~small_buffer() {
-    if (extra_buf_ != (char *)&data_) {
-      delete[] extra_buf_;
-    }
-  }
-  void buf_grow(unsigned int size) {
-    if (size > 1024) {
-      extra_buf_ = new char[size];
-    }
-  }
+  explicit small_buffer(int max_size = INT_MAX) : EscapeBuffer(max_size) {}
+
+  void buf_grow(unsigned int) {}  // it grows as it is written
   void put(const void *b, unsigned int len) {
-    memcpy(extra_buf_ + size_, b, len);
-    size_ += len;
+    append(static_cast<const char *>(b), len);
   }
-  void putchar(char c) { extra_buf_[size_++] = c; }
+  void putchar(char c) { append(&c, 1); }
   void puts(const char *string) { put(string, strlen(string)); }
-  char *data() { return extra_buf_; }
-  unsigned int size() { return size_; }
+  // Mutable like the data() of the old small_buffer. Past the inline bytes
+  // it points to a copy, and writes through it are lost on the next data().
+  using EscapeBuffer::data;
+  char *data() { return const_cast<char *>(EscapeBuffer::data()); }
+  unsigned int size() const { return length(); }
+};
+
+// Return false if src needs no escaping and ob is not written, or if the
+// result is larger than the max_size of ob and ob.overflow() is set.
+bool escape_xml(EscapeBuffer &ob, const unsigned char *src, unsigned int size);
+bool unescape_xml(EscapeBuffer &ob, const char *src, unsigned int size);
+
+// Where the streaming escapers write, a socket or an EscapeBuffer.
+class XmlSink {
+ public:
+  virtual ~XmlSink() {}
+  virtual void Write(const char *data, unsigned int len) = 0;
+};
+
+class XmlBufferSink : public XmlSink {
+ public:
+  explicit XmlBufferSink(EscapeBuffer *buffer) : buffer_(buffer) {}
+  virtual void Write(const char *data, unsigned int len) {
+    buffer_->append(data, len);
+  }
+
+ private:
+  EscapeBuffer *buffer_;
+};
+
+// Escape a document that comes in chunks into a sink, like escape_xml()
+// but everything is written. A UTF-8 character split between two chunks is
+// kept until the next one, nothing else is buffered.
+class XmlEscaper : private noncopyable {
+ public:
+  explicit XmlEscaper(XmlSink *sink) : sink_(sink), pending_len_(0) {}
+
+  void Update(const unsigned char *src, unsigned int size);
+  // end of the document, a character left incomplete becomes '?'
+  void Finish();
+  void Reset() { pending_len_ = 0; }
 
  private:
-  char data_[1024];
-  unsigned int size_;
-  char *extra_buf_;
+  XmlSink *sink_;
+  unsigned char pending_[4];
+  unsigned int pending_len_;
 };
 
-bool escape_xml(small_buffer &ob, const unsigned char *src, unsigned int size);
-bool unescape_xml(small_buffer &ob, const char *src, unsigned int size);
+// The reverse, an entity split between two chunks is kept until the next.
+class XmlUnescaper : private noncopyable {
+ public:
+  explicit XmlUnescaper(XmlSink *sink) : sink_(sink), pending_len_(0) {}
+
+  void Update(const char *src, unsigned int size);
+  // end of the document, an incomplete entity is written as it is
+  void Finish();
+  void Reset() { pending_len_ = 0; }
+
+ private:
+  XmlSink *sink_;
+  char pending_[6];  // the longest entity, &quot; and &apos;
+  unsigned int pending_len_;
+};
 
 }  // naamespace ming
 #endif  // XML_ESCAPE_H_